@@ -4,16 +4,8 @@
 using namespace netvent;
 
 struct Vector2 {
-    float x, y;
-    Vector2(float x, float y) : x(x), y(y) {}
-
-    Value to_value() const {
-        // serialize the vector2
-        return Value(map_table({
-            {"x", x},
-            {"y", y}
-        }));
-    }
+    float x = 0.0f;
+    float y = 0.0f;
 };
 
 // customized player stuct
@@ -21,24 +13,28 @@ struct Player {
     int x = 60;
     float y = 60.0f;
     bool visible = true;
-    Vector2 velocity = Vector2(0.0f, 0.0f);
+    Vector2 velocity;
     std::string name = "testplayer";
+};
 
-    std::map<std::string, Value> to_serialize() const {
-        return {
-            // serialize the player
-            {"x", Value(x)},
-            {"y", Value(y)},
-            {"visible", Value(visible)},
-            {"velocity", velocity.to_value()},
-            {"name", Value(name)}
-        };
-    }
+// the member names, in order, are all netvent needs to serialize them
+template<> struct netvent::FieldNames<Vector2> {
+    static constexpr std::string_view names[] = {"x", "y"};
+};
+
+template<> struct netvent::FieldNames<Player> {
+    static constexpr std::string_view event = "new_player";
+    static constexpr std::string_view names[] = {"x", "y", "visible", "velocity", "name"};
 };
 
 int main() {
     // test the player serialize
     Player player;
-    std::string serialized = serialize_to_netvent(Value("new_player"), player.to_serialize());
+    player.velocity = {1.5f, -0.5f};
+    std::string serialized = encode(player);
     std::cout << serialized << std::endl;
-}
\ No newline at end of file
+
+    // and back
+    Player copy = decode<Player>(serialized);
+    std::cout << copy.name << " moving at " << copy.velocity.x << ", " << copy.velocity.y << std::endl;
+}
@@ -1,466 +1,7796 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <variant>
 #include <sstream>
 #include <stdexcept>
 #include <map>
+#include <deque>
 #include <vector>
 #include <memory>
 #include <iomanip>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cmath>
+#include <functional>
+#include <charconv>
+#include <optional>
+#include <cctype>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <cstdlib>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define NETVENT_X86 1
+#define NETVENT_TARGET(isa) __attribute__((target(isa)))
+#endif
 
 namespace netvent {
 
-class Table;
-class Value;
+// ---- simd dispatch ----
+// vector kernels are compiled for every instruction set up front and picked at runtime, so one
+// binary runs on any x86 machine. the level is read from cpuid once and cached; the NETVENT_SIMD
+// environment variable (scalar, sse4.2, avx2, avx512) or force_simd_level() can lower it
+
+enum class SimdLevel { Scalar, SSE42, AVX2, AVX512 };
+
+inline const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE42: return "sse4.2";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+    }
+    return "scalar";
+}
+
+// the best level this cpu runs
+inline SimdLevel supported_simd_level() {
+    static const SimdLevel level = [] {
+#if defined(NETVENT_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return SimdLevel::AVX512;
+        if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+        if (__builtin_cpu_supports("sse4.2")) return SimdLevel::SSE42;
+#endif
+        return SimdLevel::Scalar;
+    }();
+    return level;
+}
+
+namespace detail {
+
+inline std::atomic<int>& simd_level_slot() {
+    static std::atomic<int> level{-1};
+    return level;
+}
+
+inline SimdLevel initial_simd_level() {
+    SimdLevel level = supported_simd_level();
+    if (const char* env = std::getenv("NETVENT_SIMD")) {
+        for (SimdLevel l : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512})
+            if (std::strcmp(env, simd_level_name(l)) == 0 && l < level) level = l;
+    }
+    return level;
+}
+
+} // namespace detail
+
+// the level the kernels run at
+inline SimdLevel simd_level() {
+    int level = detail::simd_level_slot().load(std::memory_order_relaxed);
+    if (level < 0) {
+        level = static_cast<int>(detail::initial_simd_level());
+        detail::simd_level_slot().store(level, std::memory_order_relaxed);
+    }
+    return static_cast<SimdLevel>(level);
+}
+
+// for tests and benchmarks, throws if the cpu can't run the level
+inline void force_simd_level(SimdLevel level) {
+    if (level > supported_simd_level())
+        throw std::runtime_error(std::string("This cpu doesn't support ") + simd_level_name(level));
+    detail::simd_level_slot().store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+namespace detail {
+
+// every group of kernels keeps one table per level, scalar first. levels past the end of a
+// table use its last entry
+template<typename T, size_t N>
+inline const T& pick_kernels(const T (&tables)[N]) {
+    return tables[std::min(static_cast<size_t>(simd_level()), N - 1)];
+}
+
+} // namespace detail
+
+namespace detail {
+
+// ---- integer text kernels ----
+// formatting writes two digits per step from a pair table, or eight at once with sse4.2. parsing
+// checks and converts eight digits per step as one 64 bit word, or sixteen at once with sse4.2.
+// both work on raw buffers, append_int/append_ints/parse_int below are the entry points
+
+inline constexpr char digit_pairs[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+    "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+// v's digits ending right before end, returns where they start
+inline char* write_digits_backwards(char* end, uint32_t v) {
+    while (v >= 100) {
+        const char* pair = digit_pairs + (v % 100) * 2;
+        v /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (v >= 10) {
+        *--end = digit_pairs[v * 2 + 1];
+        *--end = digit_pairs[v * 2];
+    } else {
+        *--end = static_cast<char>('0' + v);
+    }
+    return end;
+}
+
+inline uint32_t magnitude(int v) {
+    return v < 0 ? 0u - static_cast<uint32_t>(v) : static_cast<uint32_t>(v);
+}
+
+// writes at most 11 chars (the simd version may touch 16), returns how many
+inline size_t format_int_scalar(char* out, int v) {
+    char buf[12];
+    char* end = buf + sizeof(buf);
+    char* start = write_digits_backwards(end, magnitude(v));
+    if (v < 0) *--start = '-';
+    std::memcpy(out, start, static_cast<size_t>(end - start));
+    return static_cast<size_t>(end - start);
+}
+
+inline uint64_t load_le64(const char* p) {
+    uint64_t w;
+    std::memcpy(&w, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+// all eight bytes of w are '0'..'9'
+inline bool is_eight_digits(uint64_t w) {
+    return ((w & 0xF0F0F0F0F0F0F0F0ull) | (((w + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+}
+
+// eight digit bytes -> their value, pairs then quads then the whole word
+inline uint32_t parse_eight_digits(uint64_t w) {
+    w = (w & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+    w = (w & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+    return static_cast<uint32_t>((w & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32);
+}
+
+// n digits after the sign has been taken off
+inline bool parse_int_digits(const char* p, size_t n, bool negative, int& out) {
+    if (n == 0) return false;
+    const uint64_t limit = negative ? 2147483648ull : 2147483647ull;
+    uint64_t v = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w = load_le64(p + i);
+        if (!is_eight_digits(w)) return false;
+        v = v * 100000000 + parse_eight_digits(w);
+        if (v > limit) return false;
+    }
+    for (; i < n; i++) {
+        unsigned d = static_cast<unsigned char>(p[i]) - static_cast<unsigned>('0');
+        if (d > 9) return false;
+        v = v * 10 + d;
+        if (v > limit) return false;
+    }
+    out = static_cast<int>(negative ? -static_cast<int64_t>(v) : static_cast<int64_t>(v));
+    return true;
+}
+
+// strict, an optional '-' then only digits. false on anything else or overflow
+inline bool parse_int_scalar(const char* p, size_t n, int& out) {
+    const bool negative = n > 0 && *p == '-';
+    return negative ? parse_int_digits(p + 1, n - 1, true, out) : parse_int_digits(p, n, false, out);
+}
+
+#if defined(NETVENT_X86)
+
+// the eight digits of v < 100000000 as ascii, most significant first (milo yip's sse2 itoa)
+NETVENT_TARGET("sse4.2") inline __m128i eight_digits_sse(uint32_t v) {
+    const __m128i div_powers = _mm_setr_epi16(8389, 5243, 13108, -32768, 8389, 5243, 13108, -32768);
+    const __m128i shift_powers = _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, -32768, 1 << 7, 1 << 11, 1 << 13, -32768);
+    __m128i abcdefgh = _mm_cvtsi32_si128(static_cast<int>(v));
+    __m128i abcd = _mm_srli_epi64(_mm_mul_epu32(abcdefgh, _mm_set1_epi32(static_cast<int>(0xd1b71759))), 45);
+    __m128i efgh = _mm_sub_epi32(abcdefgh, _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+    __m128i halves = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+    __m128i spread = _mm_unpacklo_epi32(_mm_unpacklo_epi16(halves, halves), _mm_unpacklo_epi16(halves, halves));
+    __m128i prefixes = _mm_mulhi_epu16(_mm_mulhi_epu16(spread, div_powers), shift_powers); // a ab abc abcd e ef efg efgh
+    __m128i digits = _mm_sub_epi16(prefixes, _mm_slli_epi64(_mm_mullo_epi16(prefixes, _mm_set1_epi16(10)), 16));
+    return _mm_add_epi8(_mm_packus_epi16(digits, _mm_setzero_si128()), _mm_set1_epi8('0'));
+}
+
+NETVENT_TARGET("sse4.2") inline size_t format_int_sse(char* out, int v) {
+    uint32_t u = magnitude(v);
+    char* p = out;
+    if (v < 0) *p++ = '-';
+    if (u < 100000000) {
+        // shift the leading zeros out, keeping at least one digit. the store always writes eight
+        // bytes, callers leave room for that
+        static const int8_t shift[24] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1};
+        __m128i digits = eight_digits_sse(u);
+        unsigned zeros = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(digits, _mm_set1_epi8('0'))));
+        unsigned skip = static_cast<unsigned>(__builtin_ctz(~zeros | 0x80u));
+        digits = _mm_shuffle_epi8(digits, _mm_loadu_si128(reinterpret_cast<const __m128i*>(shift + skip)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), digits);
+        return static_cast<size_t>(p - out) + 8 - skip;
+    }
+    // up to two digits above the low eight
+    uint32_t high = u / 100000000;
+    if (high >= 10) {
+        *p++ = digit_pairs[high * 2];
+        *p++ = digit_pairs[high * 2 + 1];
+    } else {
+        *p++ = static_cast<char>('0' + high);
+    }
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p), eight_digits_sse(u - high * 100000000));
+    return static_cast<size_t>(p - out) + 8;
+}
+
+// nine to sixteen digits come in as two overlapping words, the front one shifted so its digits
+// are right aligned behind '0's, then get checked with one compare and multiplied down to two
+// eight digit halves. shorter tokens are cheaper the scalar way, longer ones (leading zeros) need
+// its overflow checks
+NETVENT_TARGET("sse4.2") inline bool parse_int_sse(const char* p, size_t n, int& out) {
+    const bool negative = n > 0 && *p == '-';
+    if (negative) { p++; n--; }
+    if (n <= 8 || n > 16) return parse_int_digits(p, n, negative, out);
+    const unsigned shift = static_cast<unsigned>(16 - n) * 8;
+    uint64_t front = load_le64(p);
+    if (shift) front = (front << shift) | (0x3030303030303030ull >> (64 - shift));
+    __m128i text = _mm_set_epi64x(static_cast<long long>(load_le64(p + n - 8)), static_cast<long long>(front));
+    __m128i d = _mm_sub_epi8(text, _mm_set1_epi8('0'));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d)) != 0xFFFF) return false;
+    __m128i pairs = _mm_maddubs_epi16(d, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+    __m128i quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+    quads = _mm_packus_epi32(quads, quads);
+    __m128i eights = _mm_madd_epi16(quads, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+    uint64_t v = static_cast<uint64_t>(_mm_cvtsi128_si32(eights)) * 100000000 + static_cast<uint32_t>(_mm_extract_epi32(eights, 1));
+    if (v > (negative ? 2147483648ull : 2147483647ull)) return false;
+    out = static_cast<int>(negative ? -static_cast<int64_t>(v) : static_cast<int64_t>(v));
+    return true;
+}
+
+#endif
+
+struct IntTextKernels {
+    size_t (*format_int)(char*, int);
+    bool (*parse_int)(const char*, size_t, int&);
+};
+
+inline const IntTextKernels int_text_kernels[] = {
+    {format_int_scalar, parse_int_scalar},
+#if defined(NETVENT_X86)
+    {format_int_sse, parse_int_sse},
+#endif
+};
+
+// strict int parse of a whole token, no whitespace or '+'
+inline bool parse_int(std::string_view text, int& out) {
+    return pick_kernels(int_text_kernels).parse_int(text.data(), text.size(), out);
+}
+
+} // namespace detail
+
+namespace detail {
+
+// ---- float text ----
+// printing is ryu (ulf adams, 2018) for floats: the shortest digits that read back to the same
+// float. parsing is eisel-lemire (as in fast_float): clinger's exact path for short values, a
+// 64x64 multiply or two against a power of five table otherwise, and from_chars for the inputs
+// with more than 19 digits it can't settle
+
+inline constexpr uint64_t ryu_pow5_inv_split[31] = {
+    0x0800000000000001ull, 0x0666666666666667ull, 0x051eb851eb851eb9ull, 0x04189374bc6a7efaull,
+    0x068db8bac710cb2aull, 0x053e2d6238da3c22ull, 0x0431bde82d7b634eull, 0x06b5fca6af2bd216ull,
+    0x055e63b88c230e78ull, 0x044b82fa09b5a52dull, 0x06df37f675ef6eaeull, 0x057f5ff85e592558ull,
+    0x0465e6604b7a8447ull, 0x0709709a125da071ull, 0x05a126e1a84ae6c1ull, 0x0480ebe7b9d58567ull,
+    0x0734aca5f6226f0bull, 0x05c3bd5191b525a3ull, 0x049c97747490eae9ull, 0x0760f253edb4ab0eull,
+    0x05e72843249088d8ull, 0x04b8ed0283a6d3e0ull, 0x078e480405d7b966ull, 0x060b6cd004ac9452ull,
+    0x04d5f0a66a23a9dbull, 0x07bcb43d769f762bull, 0x063090312bb2c4efull, 0x04f3a68dbc8f03f3ull,
+    0x07ec3daf94180651ull, 0x065697bfa9acd1daull, 0x051212ffbaf0a7e2ull,
+};
+
+inline constexpr uint64_t ryu_pow5_split[48] = {
+    0x1000000000000000ull, 0x1400000000000000ull, 0x1900000000000000ull, 0x1f40000000000000ull,
+    0x1388000000000000ull, 0x186a000000000000ull, 0x1e84800000000000ull, 0x1312d00000000000ull,
+    0x17d7840000000000ull, 0x1dcd650000000000ull, 0x12a05f2000000000ull, 0x174876e800000000ull,
+    0x1d1a94a200000000ull, 0x12309ce540000000ull, 0x16bcc41e90000000ull, 0x1c6bf52634000000ull,
+    0x11c37937e0800000ull, 0x16345785d8a00000ull, 0x1bc16d674ec80000ull, 0x1158e460913d0000ull,
+    0x15af1d78b58c4000ull, 0x1b1ae4d6e2ef5000ull, 0x10f0cf064dd59200ull, 0x152d02c7e14af680ull,
+    0x1a784379d99db420ull, 0x108b2a2c28029094ull, 0x14adf4b7320334b9ull, 0x19d971e4fe8401e7ull,
+    0x1027e72f1f128130ull, 0x1431e0fae6d7217cull, 0x193e5939a08ce9dbull, 0x1f8def8808b02452ull,
+    0x13b8b5b5056e16b3ull, 0x18a6e32246c99c60ull, 0x1ed09bead87c0378ull, 0x13426172c74d822bull,
+    0x1812f9cf7920e2b6ull, 0x1e17b84357691b64ull, 0x12ced32a16a1b11eull, 0x178287f49c4a1d66ull,
+    0x1d6329f1c35ca4bfull, 0x125dfa371a19e6f7ull, 0x16f578c4e0a060b5ull, 0x1cb2d6f618c878e3ull,
+    0x11efc659cf7d4b8dull, 0x166bb7f0435c9e71ull, 0x1c06a5ec5433c60dull, 0x118427b3b4a05bc8ull,
+};
+
+// 5^q for q in [-65, 38], normalized to 128 bits (high word first)
+inline constexpr uint64_t lemire_pow5[208] = {
+    0x86ccbb52ea94baeaull, 0x98e947129fc2b4e9ull, 0xa87fea27a539e9a5ull, 0x3f2398d747b36224ull,
+    0xd29fe4b18e88640eull, 0x8eec7f0d19a03aadull, 0x83a3eeeef9153e89ull, 0x1953cf68300424acull,
+    0xa48ceaaab75a8e2bull, 0x5fa8c3423c052dd7ull, 0xcdb02555653131b6ull, 0x3792f412cb06794dull,
+    0x808e17555f3ebf11ull, 0xe2bbd88bbee40bd0ull, 0xa0b19d2ab70e6ed6ull, 0x5b6aceaeae9d0ec4ull,
+    0xc8de047564d20a8bull, 0xf245825a5a445275ull, 0xfb158592be068d2eull, 0xeed6e2f0f0d56712ull,
+    0x9ced737bb6c4183dull, 0x55464dd69685606bull, 0xc428d05aa4751e4cull, 0xaa97e14c3c26b886ull,
+    0xf53304714d9265dfull, 0xd53dd99f4b3066a8ull, 0x993fe2c6d07b7fabull, 0xe546a8038efe4029ull,
+    0xbf8fdb78849a5f96ull, 0xde98520472bdd033ull, 0xef73d256a5c0f77cull, 0x963e66858f6d4440ull,
+    0x95a8637627989aadull, 0xdde7001379a44aa8ull, 0xbb127c53b17ec159ull, 0x5560c018580d5d52ull,
+    0xe9d71b689dde71afull, 0xaab8f01e6e10b4a6ull, 0x9226712162ab070dull, 0xcab3961304ca70e8ull,
+    0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d22ull, 0xe45c10c42a2b3b05ull, 0x8cb89a7db77c506aull,
+    0x8eb98a7a9a5b04e3ull, 0x77f3608e92adb242ull, 0xb267ed1940f1c61cull, 0x55f038b237591ed3ull,
+    0xdf01e85f912e37a3ull, 0x6b6c46dec52f6688ull, 0x8b61313bbabce2c6ull, 0x2323ac4b3b3da015ull,
+    0xae397d8aa96c1b77ull, 0xabec975e0a0d081aull, 0xd9c7dced53c72255ull, 0x96e7bd358c904a21ull,
+    0x881cea14545c7575ull, 0x7e50d64177da2e54ull, 0xaa242499697392d2ull, 0xdde50bd1d5d0b9e9ull,
+    0xd4ad2dbfc3d07787ull, 0x955e4ec64b44e864ull, 0x84ec3c97da624ab4ull, 0xbd5af13bef0b113eull,
+    0xa6274bbdd0fadd61ull, 0xecb1ad8aeacdd58eull, 0xcfb11ead453994baull, 0x67de18eda5814af2ull,
+    0x81ceb32c4b43fcf4ull, 0x80eacf948770ced7ull, 0xa2425ff75e14fc31ull, 0xa1258379a94d028dull,
+    0xcad2f7f5359a3b3eull, 0x096ee45813a04330ull, 0xfd87b5f28300ca0dull, 0x8bca9d6e188853fcull,
+    0x9e74d1b791e07e48ull, 0x775ea264cf55347eull, 0xc612062576589ddaull, 0x95364afe032a819eull,
+    0xf79687aed3eec551ull, 0x3a83ddbd83f52205ull, 0x9abe14cd44753b52ull, 0xc4926a9672793543ull,
+    0xc16d9a0095928a27ull, 0x75b7053c0f178294ull, 0xf1c90080baf72cb1ull, 0x5324c68b12dd6339ull,
+    0x971da05074da7beeull, 0xd3f6fc16ebca5e04ull, 0xbce5086492111aeaull, 0x88f4bb1ca6bcf585ull,
+    0xec1e4a7db69561a5ull, 0x2b31e9e3d06c32e6ull, 0x9392ee8e921d5d07ull, 0x3aff322e62439fd0ull,
+    0xb877aa3236a4b449ull, 0x09befeb9fad487c3ull, 0xe69594bec44de15bull, 0x4c2ebe687989a9b4ull,
+    0x901d7cf73ab0acd9ull, 0x0f9d37014bf60a11ull, 0xb424dc35095cd80full, 0x538484c19ef38c95ull,
+    0xe12e13424bb40e13ull, 0x2865a5f206b06fbaull, 0x8cbccc096f5088cbull, 0xf93f87b7442e45d4ull,
+    0xafebff0bcb24aafeull, 0xf78f69a51539d749ull, 0xdbe6fecebdedd5beull, 0xb573440e5a884d1cull,
+    0x89705f4136b4a597ull, 0x31680a88f8953031ull, 0xabcc77118461cefcull, 0xfdc20d2b36ba7c3eull,
+    0xd6bf94d5e57a42bcull, 0x3d32907604691b4dull, 0x8637bd05af6c69b5ull, 0xa63f9a49c2c1b110ull,
+    0xa7c5ac471b478423ull, 0x0fcf80dc33721d54ull, 0xd1b71758e219652bull, 0xd3c36113404ea4a9ull,
+    0x83126e978d4fdf3bull, 0x645a1cac083126eaull, 0xa3d70a3d70a3d70aull, 0x3d70a3d70a3d70a4ull,
+    0xccccccccccccccccull, 0xcccccccccccccccdull, 0x8000000000000000ull, 0x0000000000000000ull,
+    0xa000000000000000ull, 0x0000000000000000ull, 0xc800000000000000ull, 0x0000000000000000ull,
+    0xfa00000000000000ull, 0x0000000000000000ull, 0x9c40000000000000ull, 0x0000000000000000ull,
+    0xc350000000000000ull, 0x0000000000000000ull, 0xf424000000000000ull, 0x0000000000000000ull,
+    0x9896800000000000ull, 0x0000000000000000ull, 0xbebc200000000000ull, 0x0000000000000000ull,
+    0xee6b280000000000ull, 0x0000000000000000ull, 0x9502f90000000000ull, 0x0000000000000000ull,
+    0xba43b74000000000ull, 0x0000000000000000ull, 0xe8d4a51000000000ull, 0x0000000000000000ull,
+    0x9184e72a00000000ull, 0x0000000000000000ull, 0xb5e620f480000000ull, 0x0000000000000000ull,
+    0xe35fa931a0000000ull, 0x0000000000000000ull, 0x8e1bc9bf04000000ull, 0x0000000000000000ull,
+    0xb1a2bc2ec5000000ull, 0x0000000000000000ull, 0xde0b6b3a76400000ull, 0x0000000000000000ull,
+    0x8ac7230489e80000ull, 0x0000000000000000ull, 0xad78ebc5ac620000ull, 0x0000000000000000ull,
+    0xd8d726b7177a8000ull, 0x0000000000000000ull, 0x878678326eac9000ull, 0x0000000000000000ull,
+    0xa968163f0a57b400ull, 0x0000000000000000ull, 0xd3c21bcecceda100ull, 0x0000000000000000ull,
+    0x84595161401484a0ull, 0x0000000000000000ull, 0xa56fa5b99019a5c8ull, 0x0000000000000000ull,
+    0xcecb8f27f4200f3aull, 0x0000000000000000ull, 0x813f3978f8940984ull, 0x4000000000000000ull,
+    0xa18f07d736b90be5ull, 0x5000000000000000ull, 0xc9f2c9cd04674edeull, 0xa400000000000000ull,
+    0xfc6f7c4045812296ull, 0x4d00000000000000ull, 0x9dc5ada82b70b59dull, 0xf020000000000000ull,
+    0xc5371912364ce305ull, 0x6c28000000000000ull, 0xf684df56c3e01bc6ull, 0xc732000000000000ull,
+    0x9a130b963a6c115cull, 0x3c7f400000000000ull, 0xc097ce7bc90715b3ull, 0x4b9f100000000000ull,
+    0xf0bdc21abb48db20ull, 0x1e86d40000000000ull, 0x96769950b50d88f4ull, 0x1314448000000000ull,
+};
+
+inline uint32_t pow5_bits(int32_t e) { return ((static_cast<uint32_t>(e) * 1217359) >> 19) + 1; }
+inline uint32_t log10_pow2(int32_t e) { return (static_cast<uint32_t>(e) * 78913) >> 18; }
+inline uint32_t log10_pow5(int32_t e) { return (static_cast<uint32_t>(e) * 732923) >> 20; }
+
+inline uint32_t pow5_factor(uint32_t v) {
+    uint32_t count = 0;
+    while (v % 5 == 0) { v /= 5; count++; }
+    return count;
+}
+
+// (m * factor) >> shift, shift > 32
+inline uint32_t mul_shift32(uint32_t m, uint64_t factor, int32_t shift) {
+    uint64_t low = static_cast<uint64_t>(m) * static_cast<uint32_t>(factor);
+    uint64_t high = static_cast<uint64_t>(m) * (factor >> 32);
+    return static_cast<uint32_t>(((low >> 32) + high) >> (shift - 32));
+}
+
+// high and low word of a * b
+inline void mul_64x64(uint64_t a, uint64_t b, uint64_t& high, uint64_t& low) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    high = static_cast<uint64_t>(product >> 64);
+    low = static_cast<uint64_t>(product);
+#else
+    uint64_t a0 = static_cast<uint32_t>(a), a1 = a >> 32, b0 = static_cast<uint32_t>(b), b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t middle = (p00 >> 32) + static_cast<uint32_t>(p01) + static_cast<uint32_t>(p10);
+    high = p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32);
+    low = (middle << 32) | static_cast<uint32_t>(p00);
+#endif
+}
+
+// a finite nonzero float as digits * 10^exponent with as few digits as round trip
+struct FloatDecimal {
+    uint32_t digits;
+    int32_t exponent;
+};
+
+inline FloatDecimal shortest_decimal(uint32_t mantissa_bits, uint32_t exponent_bits) {
+    int32_t e2;
+    uint32_t m2;
+    if (exponent_bits == 0) {
+        e2 = 1 - 127 - 23 - 2;
+        m2 = mantissa_bits;
+    } else {
+        e2 = static_cast<int32_t>(exponent_bits) - 127 - 23 - 2;
+        m2 = (1u << 23) | mantissa_bits;
+    }
+    const bool accept_bounds = (m2 & 1) == 0;
+
+    // the float and the halfway points to its neighbours, all times 4
+    const uint32_t mv = 4 * m2;
+    const uint32_t mp = 4 * m2 + 2;
+    const uint32_t mm_shift = mantissa_bits != 0 || exponent_bits <= 1;
+    const uint32_t mm = 4 * m2 - 1 - mm_shift;
+
+    uint32_t vr, vp, vm;
+    int32_t e10;
+    bool vm_trailing_zeros = false, vr_trailing_zeros = false;
+    uint8_t last_removed = 0;
+    if (e2 >= 0) {
+        const uint32_t q = log10_pow2(e2);
+        e10 = static_cast<int32_t>(q);
+        const int32_t k = 59 + static_cast<int32_t>(pow5_bits(static_cast<int32_t>(q))) - 1;
+        const int32_t i = -e2 + static_cast<int32_t>(q) + k;
+        vr = mul_shift32(mv, ryu_pow5_inv_split[q], i);
+        vp = mul_shift32(mp, ryu_pow5_inv_split[q], i);
+        vm = mul_shift32(mm, ryu_pow5_inv_split[q], i);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+            // the loop below drops at least one digit, so get the one before it right
+            const int32_t l = 59 + static_cast<int32_t>(pow5_bits(static_cast<int32_t>(q - 1))) - 1;
+            last_removed = static_cast<uint8_t>(mul_shift32(mv, ryu_pow5_inv_split[q - 1], -e2 + static_cast<int32_t>(q) - 1 + l) % 10);
+        }
+        if (q <= 9) {
+            // only one of mp, mv and mm can be a multiple of 5, if any
+            if (mv % 5 == 0) vr_trailing_zeros = pow5_factor(mv) >= q;
+            else if (accept_bounds) vm_trailing_zeros = pow5_factor(mm) >= q;
+            else vp -= pow5_factor(mp) >= q;
+        }
+    } else {
+        const uint32_t q = log10_pow5(-e2);
+        e10 = static_cast<int32_t>(q) + e2;
+        const int32_t i = -e2 - static_cast<int32_t>(q);
+        const int32_t k = static_cast<int32_t>(pow5_bits(i)) - 61;
+        int32_t j = static_cast<int32_t>(q) - k;
+        vr = mul_shift32(mv, ryu_pow5_split[i], j);
+        vp = mul_shift32(mp, ryu_pow5_split[i], j);
+        vm = mul_shift32(mm, ryu_pow5_split[i], j);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+            j = static_cast<int32_t>(q) - 1 - (static_cast<int32_t>(pow5_bits(i + 1)) - 61);
+            last_removed = static_cast<uint8_t>(mul_shift32(mv, ryu_pow5_split[i + 1], j) % 10);
+        }
+        if (q <= 1) {
+            // mv has at least q trailing zero bits, mp and mm depend on the rounding
+            vr_trailing_zeros = true;
+            if (accept_bounds) vm_trailing_zeros = mm_shift == 1;
+            else vp--;
+        } else if (q < 31) {
+            vr_trailing_zeros = (mv & ((1u << (q - 1)) - 1)) == 0;
+        }
+    }
+
+    // drop digits while the interval still holds a shorter number
+    int32_t removed = 0;
+    uint32_t output;
+    if (vm_trailing_zeros || vr_trailing_zeros) {
+        while (vp / 10 > vm / 10) {
+            vm_trailing_zeros &= vm % 10 == 0;
+            vr_trailing_zeros &= last_removed == 0;
+            last_removed = static_cast<uint8_t>(vr % 10);
+            vr /= 10; vp /= 10; vm /= 10;
+            removed++;
+        }
+        if (vm_trailing_zeros) {
+            while (vm % 10 == 0) {
+                vr_trailing_zeros &= last_removed == 0;
+                last_removed = static_cast<uint8_t>(vr % 10);
+                vr /= 10; vp /= 10; vm /= 10;
+                removed++;
+            }
+        }
+        if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0) last_removed = 4; // round half to even
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5);
+    } else {
+        while (vp / 10 > vm / 10) {
+            last_removed = static_cast<uint8_t>(vr % 10);
+            vr /= 10; vp /= 10; vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || last_removed >= 5);
+    }
+    return {output, e10 + removed};
+}
+
+// writes at most 24 chars. plain notation from 1e-6 up to 1e21 and exponents outside that, always
+// with a '.' so the text parser keeps it a float. inf, -inf and nan have none, the parser knows
+// those by name
+inline size_t format_float(char* out, float v) {
+    uint32_t bits;
+    std::memcpy(&bits, &v, 4);
+    char* p = out;
+    if (bits >> 31) *p++ = '-';
+    const uint32_t mantissa_bits = bits & ((1u << 23) - 1);
+    const uint32_t exponent_bits = (bits >> 23) & 0xFF;
+    if (exponent_bits == 0xFF) {
+        if (mantissa_bits) { std::memcpy(out, "nan", 3); return 3; }
+        std::memcpy(p, "inf", 3);
+        return static_cast<size_t>(p - out) + 3;
+    }
+    if (exponent_bits == 0 && mantissa_bits == 0) {
+        std::memcpy(p, "0.0", 3);
+        return static_cast<size_t>(p - out) + 3;
+    }
+
+    FloatDecimal d = shortest_decimal(mantissa_bits, exponent_bits);
+    char digits[10];
+    char* digits_end = digits + sizeof(digits);
+    char* first = write_digits_backwards(digits_end, d.digits);
+    const int32_t count = static_cast<int32_t>(digits_end - first);
+    const int32_t point = count + d.exponent; // digits before the '.'
+
+    if (point > 21 || point < -5) {
+        *p++ = first[0];
+        *p++ = '.';
+        if (count > 1) {
+            std::memcpy(p, first + 1, static_cast<size_t>(count - 1));
+            p += count - 1;
+        } else {
+            *p++ = '0';
+        }
+        *p++ = 'e';
+        int32_t exponent = point - 1;
+        if (exponent < 0) { *p++ = '-'; exponent = -exponent; }
+        p = std::copy(write_digits_backwards(digits_end, static_cast<uint32_t>(exponent)), digits_end, p);
+    } else if (point <= 0) {
+        *p++ = '0';
+        *p++ = '.';
+        std::memset(p, '0', static_cast<size_t>(-point));
+        p += -point;
+        std::memcpy(p, first, static_cast<size_t>(count));
+        p += count;
+    } else if (point >= count) {
+        std::memcpy(p, first, static_cast<size_t>(count));
+        p += count;
+        std::memset(p, '0', static_cast<size_t>(point - count));
+        p += point - count;
+        *p++ = '.';
+        *p++ = '0';
+    } else {
+        std::memcpy(p, first, static_cast<size_t>(point));
+        p += point;
+        *p++ = '.';
+        std::memcpy(p, first + point, static_cast<size_t>(count - point));
+        p += count - point;
+    }
+    return static_cast<size_t>(p - out);
+}
+
+// the bits of w * 10^q rounded to nearest even, sign left off. w is nonzero
+inline uint32_t eisel_lemire(uint64_t w, int64_t q) {
+    if (q < -65) return 0;
+    if (q > 38) return 0x7F800000;
+    const int lz = __builtin_clzll(w);
+    w <<= lz;
+    const uint64_t* pow5 = lemire_pow5 + 2 * (q + 65);
+    uint64_t high, low;
+    mul_64x64(w, pow5[0], high, low);
+    // the low bits of the top word decide nothing unless they're all ones, then take the next word
+    const uint64_t precision_mask = ~uint64_t(0) >> 26;
+    if ((high & precision_mask) == precision_mask) {
+        uint64_t second_high, second_low;
+        mul_64x64(w, pow5[1], second_high, second_low);
+        low += second_high;
+        if (second_high > low) high++;
+    }
+    const int upper_bit = static_cast<int>(high >> 63);
+    const int shift = upper_bit + 64 - 23 - 3;
+    uint64_t mantissa = high >> shift;
+    int64_t power2 = (((152170 + 65536) * q) >> 16) + 63 + upper_bit - lz + 127;
+
+    if (power2 <= 0) {
+        // subnormal
+        if (-power2 + 1 >= 64) return 0;
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = mantissa < (uint64_t(1) << 23) ? 0 : 1;
+        return static_cast<uint32_t>(mantissa | (static_cast<uint64_t>(power2) << 23));
+    }
+    // exactly halfway between two floats rounds to even
+    if (low <= 1 && q >= -17 && q <= 10 && (mantissa & 3) == 1 && (mantissa << shift) == high) mantissa &= ~uint64_t(1);
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (uint64_t(2) << 23)) {
+        mantissa = uint64_t(1) << 23;
+        power2++;
+    }
+    mantissa &= ~(uint64_t(1) << 23);
+    if (power2 >= 0xFF) return 0x7F800000;
+    return static_cast<uint32_t>(mantissa | (static_cast<uint64_t>(power2) << 23));
+}
+
+// strict float parse of a whole token: [-]digits[.digits][e[+-]digits], or inf/nan through
+// from_chars. no whitespace or '+'
+inline bool parse_float(std::string_view text, float& out) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    const bool negative = p != end && *p == '-';
+    if (negative) p++;
+
+    // up to 19 significant digits go into w, the rest only count toward the exponent
+    uint64_t w = 0;
+    int digits = 0;
+    int64_t exponent = 0;
+    bool truncated = false;
+    bool any_digit = false;
+    auto take_digits = [&](bool fraction) {
+        while (p != end) {
+            // eight at a time once past the leading zeros
+            if (w != 0 && digits + 8 <= 19 && end - p >= 8 && is_eight_digits(load_le64(p))) {
+                w = w * 100000000 + parse_eight_digits(load_le64(p));
+                digits += 8;
+                if (fraction) exponent -= 8;
+                p += 8;
+                any_digit = true;
+                continue;
+            }
+            unsigned d = static_cast<unsigned char>(*p) - static_cast<unsigned>('0');
+            if (d > 9) break;
+            any_digit = true;
+            if (digits < 19) {
+                w = w * 10 + d;
+                if (w != 0) digits++;
+                if (fraction) exponent--;
+            } else {
+                truncated |= d != 0;
+                if (!fraction) exponent++;
+            }
+            p++;
+        }
+    };
+    take_digits(false);
+    if (p != end && *p == '.') {
+        p++;
+        take_digits(true);
+    }
+    if (!any_digit) {
+        // inf, nan and friends
+        auto res = std::from_chars(text.data(), end, out);
+        return !text.empty() && res.ec == std::errc() && res.ptr == end;
+    }
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool exponent_negative = p != end && *p == '-';
+        if (p != end && (*p == '-' || *p == '+')) p++;
+        if (p == end) return false;
+        int64_t e = 0;
+        for (; p != end; p++) {
+            unsigned d = static_cast<unsigned char>(*p) - static_cast<unsigned>('0');
+            if (d > 9) return false;
+            if (e < 100000) e = e * 10 + d;
+        }
+        exponent += exponent_negative ? -e : e;
+    }
+    if (p != end) return false;
+
+    uint32_t bits;
+    if (w == 0) {
+        bits = 0;
+    } else if (!truncated && w <= (uint64_t(1) << 24) && exponent >= -10 && exponent <= 10) {
+        // both w and the power of ten are exact floats, so one rounding gives the right answer
+        static const float powers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+        float f = static_cast<float>(w);
+        f = exponent < 0 ? f / powers[-exponent] : f * powers[exponent];
+        std::memcpy(&bits, &f, 4);
+    } else {
+        bits = eisel_lemire(w, exponent);
+        // the dropped digits can only push it up to w + 1, if that lands elsewhere ask from_chars
+        if (truncated && bits != eisel_lemire(w + 1, exponent)) {
+            auto res = std::from_chars(text.data(), end, out);
+            return res.ec == std::errc();
+        }
+    }
+    if (negative) bits |= 0x80000000u;
+    std::memcpy(&out, &bits, 4);
+    return true;
+}
+
+// a number as it may appear in event text: parse_int and parse_float are strict, but a value can
+// also start with a '+' (not "+-")
+inline std::string_view number_text(std::string_view v) {
+    if (v.size() > 1 && v[0] == '+' && v[1] != '-') v.remove_prefix(1);
+    return v;
+}
+
+} // namespace detail
+
+// how Value::serialize writes blobs: the raw bytes behind their length, or printable as base64
+// or hex for links that have to stay plain text. readers take all three
+enum class BlobText { Raw, Base64, Hex };
+
+namespace detail {
+
+// ---- string text ----
+// strings are written between quotes with ", \ and control characters escaped (\", \\, \n, \r,
+// \t, \u00XX). the kernels find how much of a string needs nothing, that part is copied as is
+
+inline size_t clean_prefix_scalar(const char* p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        const unsigned char c = static_cast<unsigned char>(p[i]);
+        if (c == '"' || c == '\\' || c < 0x20) return i;
+    }
+    return n;
+}
+
+#if defined(NETVENT_X86)
+
+NETVENT_TARGET("sse4.2") inline size_t clean_prefix_sse(const char* p, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i bad = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                                   _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v));
+        if (int mask = _mm_movemask_epi8(bad)) return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+    return i + clean_prefix_scalar(p + i, n - i);
+}
+
+NETVENT_TARGET("avx2") inline size_t clean_prefix_avx2(const char* p, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i bad = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+                                      _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v));
+        if (uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(bad))) return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+    return i + clean_prefix_sse(p + i, n - i);
+}
+
+NETVENT_TARGET("avx512f,avx512bw") inline size_t clean_prefix_avx512(const char* p, size_t n) {
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512(p + i);
+        __mmask64 bad = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('"')) | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\\')) |
+                        _mm512_cmple_epu8_mask(v, _mm512_set1_epi8(0x1F));
+        if (bad) return i + static_cast<size_t>(__builtin_ctzll(bad));
+    }
+    return i + clean_prefix_avx2(p + i, n - i);
+}
+
+#endif
+
+struct StringKernels {
+    size_t (*clean_prefix)(const char*, size_t);
+};
+
+inline const StringKernels string_kernels[] = {
+    {clean_prefix_scalar},
+#if defined(NETVENT_X86)
+    {clean_prefix_sse},
+    {clean_prefix_avx2},
+    {clean_prefix_avx512},
+#endif
+};
+
+inline void append_escaped(std::string& out, std::string_view v) {
+    const auto clean_prefix = pick_kernels(string_kernels).clean_prefix;
+    while (!v.empty()) {
+        size_t clean = clean_prefix(v.data(), v.size());
+        out.append(v.data(), clean);
+        if (clean == v.size()) return;
+        const unsigned char c = static_cast<unsigned char>(v[clean]);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: {
+                const char hex[] = "0123456789abcdef";
+                const char u[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                out.append(u, sizeof(u));
+            }
+        }
+        v.remove_prefix(clean + 1);
+    }
+}
+
+// the closing quote of the string opening at text[open], npos if it never closes
+constexpr size_t string_end(std::string_view text, size_t open) {
+    for (size_t i = open + 1; i < text.size(); i++) {
+        if (text[i] == '\\') i++;
+        else if (text[i] == '"') return i;
+    }
+    return std::string_view::npos;
+}
+
+// raw bytes are written as #<length>:<bytes>. the length up front lets a reader jump straight
+// past them without looking at what's inside. this reads the header of one starting at text[at]:
+// where its bytes start and how many there are, false if there's no header there
+constexpr bool blob_header(std::string_view text, size_t at, size_t& bytes_at, size_t& length) {
+    if (at >= text.size() || text[at] != '#') return false;
+    size_t i = at + 1, n = 0;
+    while (i < text.size() && text[i] >= '0' && text[i] <= '9' && i - at <= 18) n = n * 10 + static_cast<size_t>(text[i++] - '0');
+    if (i == at + 1 || i >= text.size() || text[i] != ':') return false;
+    bytes_at = i + 1;
+    length = n;
+    return true;
+}
+
+// a whole blob, bytes and all, starts at text[at]
+constexpr bool blob_at(std::string_view text, size_t at, size_t& bytes_at, size_t& length) {
+    return blob_header(text, at, bytes_at, length) && length <= text.size() - bytes_at;
+}
+
+// printable blobs are #base64:<standard alphabet, = padded> or #hex:<digits>. this reads one
+// starting at text[at]: its encoding and where its characters start and end. the padding is
+// only taken up to the next multiple of 4, whatever follows isn't part of it
+constexpr bool encoded_blob(std::string_view text, size_t at, BlobText& kind, size_t& chars_at, size_t& chars_end) {
+    if (at >= text.size() || text[at] != '#') return false;
+    const std::string_view rest = text.substr(at + 1);
+    size_t i = 0;
+    if (rest.substr(0, 7) == "base64:") {
+        kind = BlobText::Base64;
+        chars_at = i = at + 8;
+        auto letter = [](char c) { return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '+' || c == '/'; };
+        while (i < text.size() && letter(text[i])) i++;
+        while (i < text.size() && text[i] == '=' && (i - chars_at) % 4) i++;
+    } else if (rest.substr(0, 4) == "hex:") {
+        kind = BlobText::Hex;
+        chars_at = i = at + 5;
+        auto digit = [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); };
+        while (i < text.size() && digit(text[i])) i++;
+    } else {
+        return false;
+    }
+    chars_end = i;
+    return true;
+}
+
+// the last character of the string or blob starting at text[i], npos if a string never closes.
+// anything else is its own end
+constexpr size_t literal_end(std::string_view text, size_t i) {
+    if (text[i] == '"') return string_end(text, i);
+    if (text[i] != '#') return i;
+    size_t bytes_at = 0, length = 0;
+    if (blob_at(text, i, bytes_at, length)) return bytes_at + length - 1;
+    BlobText kind = BlobText::Raw;
+    if (encoded_blob(text, i, kind, bytes_at, length)) return length - 1;
+    return i;
+}
+
+// v without the blanks around it, except blanks that are a blob's last bytes
+constexpr std::string_view trim_value(std::string_view v) {
+    size_t start = v.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos) return {};
+    size_t end = v.find_last_not_of(" \t\r") + 1;
+    for (size_t i = start; i < end; i++) {
+        if (v[i] != '"' && v[i] != '#') continue;
+        i = literal_end(v, i);
+        if (i == std::string_view::npos) break;
+        if (i >= end) end = i + 1;
+    }
+    return v.substr(start, end - start);
+}
+
+// where a "//" comment starts in a line, ignoring ones inside strings and blobs. npos if none
+constexpr size_t comment_start(std::string_view line) {
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '"' || line[i] == '#') {
+            i = literal_end(line, i);
+            if (i == std::string_view::npos) return i;
+        } else if (line[i] == '/' && i + 1 < line.size() && line[i + 1] == '/') {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// the first c outside a string or blob, npos if none
+constexpr size_t find_unquoted(std::string_view text, char c) {
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == c) return i;
+        if (text[i] == '"' || text[i] == '#') {
+            i = literal_end(text, i);
+            if (i == std::string_view::npos) return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// text is exactly one quoted string
+constexpr bool is_quoted(std::string_view text) {
+    return text.size() >= 2 && text.front() == '"' && string_end(text, 0) == text.size() - 1;
+}
+
+inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+inline void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// the inside of a quoted string with its escapes resolved. runs without a backslash are copied
+// whole, \uXXXX (and surrogate pairs) become utf-8
+inline std::string unescape(std::string_view v) {
+    std::string out;
+    out.reserve(v.size());
+    while (!v.empty()) {
+        const void* slash = std::memchr(v.data(), '\\', v.size());
+        if (!slash) {
+            out.append(v.data(), v.size());
+            break;
+        }
+        size_t at = static_cast<size_t>(static_cast<const char*>(slash) - v.data());
+        out.append(v.data(), at);
+        if (at + 1 >= v.size()) throw std::runtime_error("Bad escape at the end of a string");
+        char c = v[at + 1];
+        v.remove_prefix(at + 2);
+        switch (c) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u': {
+                auto read_hex4 = [&v]() {
+                    if (v.size() < 4) throw std::runtime_error("Bad \\u escape in a string");
+                    uint32_t cp = 0;
+                    for (int i = 0; i < 4; i++) {
+                        int d = hex_digit(v[i]);
+                        if (d < 0) throw std::runtime_error("Bad \\u escape in a string");
+                        cp = cp << 4 | static_cast<uint32_t>(d);
+                    }
+                    v.remove_prefix(4);
+                    return cp;
+                };
+                uint32_t cp = read_hex4();
+                if (cp >= 0xD800 && cp < 0xDC00 && v.size() >= 6 && v[0] == '\\' && v[1] == 'u') {
+                    v.remove_prefix(2);
+                    uint32_t low = read_hex4();
+                    if (low < 0xDC00 || low > 0xDFFF) throw std::runtime_error("Bad surrogate pair in a string");
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+                    throw std::runtime_error("Bad surrogate pair in a string");
+                }
+                append_utf8(out, cp);
+                break;
+            }
+            default: throw std::runtime_error(std::string("Unknown escape \\") + c + " in a string");
+        }
+    }
+    return out;
+}
+
+// ---- utf-8 ----
+// the lookup-table check from simdjson (keiser and lemire): the high nibble of each byte, the low
+// and high nibble of the byte before it each index a 16 entry table of error classes, and a byte
+// is bad when all three agree. the second to fourth bytes of longer sequences are checked by
+// looking two and three bytes back. a block of plain ascii only has to check that the block
+// before didn't end partway through a character
+
+constexpr uint8_t utf8_too_short = 1 << 0;     // a lead byte not followed by enough continuations
+constexpr uint8_t utf8_too_long = 1 << 1;      // a continuation after ascii
+constexpr uint8_t utf8_overlong_3 = 1 << 2;
+constexpr uint8_t utf8_too_large = 1 << 3;     // past U+10FFFF
+constexpr uint8_t utf8_surrogate = 1 << 4;
+constexpr uint8_t utf8_overlong_2 = 1 << 5;
+constexpr uint8_t utf8_too_large_1000 = 1 << 6;
+constexpr uint8_t utf8_overlong_4 = 1 << 6;
+constexpr uint8_t utf8_two_conts = 1 << 7;     // two continuations in a row, fine if a lead came before
+constexpr uint8_t utf8_carry = utf8_too_short | utf8_too_long | utf8_two_conts;
+
+alignas(16) inline constexpr uint8_t utf8_byte1_high[16] = {
+    utf8_too_long, utf8_too_long, utf8_too_long, utf8_too_long,
+    utf8_too_long, utf8_too_long, utf8_too_long, utf8_too_long,
+    utf8_two_conts, utf8_two_conts, utf8_two_conts, utf8_two_conts,
+    utf8_too_short | utf8_overlong_2,
+    utf8_too_short,
+    utf8_too_short | utf8_overlong_3 | utf8_surrogate,
+    utf8_too_short | utf8_too_large | utf8_too_large_1000 | utf8_overlong_4,
+};
+
+alignas(16) inline constexpr uint8_t utf8_byte1_low[16] = {
+    utf8_carry | utf8_overlong_3 | utf8_overlong_2 | utf8_overlong_4,
+    utf8_carry | utf8_overlong_2,
+    utf8_carry,
+    utf8_carry,
+    utf8_carry | utf8_too_large,
+    utf8_carry | utf8_too_large | utf8_too_large_1000,
+    utf8_carry | utf8_too_large | utf8_too_large_1000,
+    utf8_carry | utf8_too_large | utf8_too_large_1000,
+    utf8_carry | utf8_too_large | utf8_too_large_1000,
+    utf8_carry | utf8_too_large | utf8_too_large_1000,
+    utf8_carry | utf8_too_large | utf8_too_large_1000,
+    utf8_carry | utf8_too_large | utf8_too_large_1000,
+    utf8_carry | utf8_too_large | utf8_too_large_1000,
+    utf8_carry | utf8_too_large | utf8_too_large_1000 | utf8_surrogate,
+    utf8_carry | utf8_too_large | utf8_too_large_1000,
+    utf8_carry | utf8_too_large | utf8_too_large_1000,
+};
+
+alignas(16) inline constexpr uint8_t utf8_byte2_high[16] = {
+    utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short,
+    utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short,
+    utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_overlong_3 | utf8_too_large_1000 | utf8_overlong_4,
+    utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_overlong_3 | utf8_too_large,
+    utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_surrogate | utf8_too_large,
+    utf8_too_long | utf8_overlong_2 | utf8_two_conts | utf8_surrogate | utf8_too_large,
+    utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short,
+};
+
+// the last three bytes of a block that would need more after them
+alignas(16) inline constexpr uint8_t utf8_incomplete_max[16] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+// the length of the character starting at p, 0 if it isn't valid there
+inline size_t utf8_char_length(const unsigned char* p, size_t n) {
+    const unsigned char c = p[0];
+    if (c < 0x80) return 1;
+    size_t need;
+    unsigned char lo = 0x80, hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) need = 1;
+    else if (c >= 0xE0 && c <= 0xEF) {
+        need = 2;
+        if (c == 0xE0) lo = 0xA0;
+        else if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        need = 3;
+        if (c == 0xF0) lo = 0x90;
+        else if (c == 0xF4) hi = 0x8F;
+    } else {
+        return 0;
+    }
+    if (n <= need || p[1] < lo || p[1] > hi) return 0;
+    for (size_t i = 2; i <= need; i++)
+        if (p[i] < 0x80 || p[i] > 0xBF) return 0;
+    return need + 1;
+}
+
+inline bool valid_utf8_scalar(const char* text, size_t n) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(text);
+    size_t i = 0;
+    while (i < n) {
+        if (i + 8 <= n && (load_le64(text + i) & 0x8080808080808080ull) == 0) {
+            i += 8;
+            continue;
+        }
+        size_t length = utf8_char_length(p + i, n - i);
+        if (!length) return false;
+        i += length;
+    }
+    return true;
+}
+
+#if defined(NETVENT_X86)
+
+NETVENT_TARGET("sse4.2") inline __m128i utf8_errors_sse(__m128i input, __m128i prev_input) {
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+    const __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    const __m128i byte1_high = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte1_high)),
+                                                _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble));
+    const __m128i byte1_low = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte1_low)),
+                                               _mm_and_si128(prev1, low_nibble));
+    const __m128i byte2_high = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_byte2_high)),
+                                                _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble));
+    const __m128i special = _mm_and_si128(_mm_and_si128(byte1_high, byte1_low), byte2_high);
+    // two and three back: a third or fourth byte has to be a continuation, and nothing else can be
+    const __m128i third = _mm_subs_epu8(_mm_alignr_epi8(input, prev_input, 14), _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    const __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(input, prev_input, 13), _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    const __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(must23, special);
+}
+
+NETVENT_TARGET("sse4.2") inline bool valid_utf8_sse(const char* text, size_t n) {
+    const __m128i incomplete_max = _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_incomplete_max));
+    __m128i prev = _mm_setzero_si128(), prev_incomplete = _mm_setzero_si128(), error = _mm_setzero_si128();
+    size_t i = 0;
+    // the tail runs padded with zeros, which also catches a character cut off at the end
+    char tail[16] = {};
+    for (bool last = false; !last; i += 16) {
+        __m128i input;
+        if (i + 16 <= n) {
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        } else {
+            if (n > i) std::memcpy(tail, text + i, n - i);
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail));
+            last = true;
+        }
+        if (_mm_movemask_epi8(input) == 0) {
+            error = _mm_or_si128(error, prev_incomplete);
+            prev_incomplete = _mm_setzero_si128();
+        } else {
+            error = _mm_or_si128(error, utf8_errors_sse(input, prev));
+            prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+        }
+        prev = input;
+        // bail early on long bad input
+        if ((i & 1023) == 0 && !_mm_testz_si128(error, error)) return false;
+    }
+    return _mm_testz_si128(error, error);
+}
+
+NETVENT_TARGET("avx2") inline __m256i utf8_table_avx2(const uint8_t* table) {
+    return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+}
+
+// the input shifted right by n bytes, with the end of prev_input coming in
+#define NETVENT_UTF8_PREV_AVX2(input, prev_input, n) \
+    _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev_input, input, 0x21), 16 - (n))
+
+NETVENT_TARGET("avx2") inline __m256i utf8_errors_avx2(__m256i input, __m256i prev_input) {
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    const __m256i prev1 = NETVENT_UTF8_PREV_AVX2(input, prev_input, 1);
+    const __m256i byte1_high = _mm256_shuffle_epi8(utf8_table_avx2(utf8_byte1_high), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble));
+    const __m256i byte1_low = _mm256_shuffle_epi8(utf8_table_avx2(utf8_byte1_low), _mm256_and_si256(prev1, low_nibble));
+    const __m256i byte2_high = _mm256_shuffle_epi8(utf8_table_avx2(utf8_byte2_high), _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble));
+    const __m256i special = _mm256_and_si256(_mm256_and_si256(byte1_high, byte1_low), byte2_high);
+    const __m256i third = _mm256_subs_epu8(NETVENT_UTF8_PREV_AVX2(input, prev_input, 2), _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    const __m256i fourth = _mm256_subs_epu8(NETVENT_UTF8_PREV_AVX2(input, prev_input, 3), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    const __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must23, special);
+}
+
+#undef NETVENT_UTF8_PREV_AVX2
+
+NETVENT_TARGET("avx2") inline bool valid_utf8_avx2(const char* text, size_t n) {
+    // only the top lane's last three bytes can run into the next block
+    const __m256i incomplete_max = _mm256_inserti128_si256(_mm256_set1_epi8(static_cast<char>(0xFF)),
+                                                           _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_incomplete_max)), 1);
+    __m256i prev = _mm256_setzero_si256(), prev_incomplete = _mm256_setzero_si256(), error = _mm256_setzero_si256();
+    size_t i = 0;
+    char tail[32] = {};
+    for (bool last = false; !last; i += 32) {
+        __m256i input;
+        if (i + 32 <= n) {
+            input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        } else {
+            if (n > i) std::memcpy(tail, text + i, n - i);
+            input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail));
+            last = true;
+        }
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+            prev_incomplete = _mm256_setzero_si256();
+        } else {
+            error = _mm256_or_si256(error, utf8_errors_avx2(input, prev));
+            prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+        }
+        prev = input;
+        if ((i & 1023) == 0 && !_mm256_testz_si256(error, error)) return false;
+    }
+    return _mm256_testz_si256(error, error);
+}
+
+#endif
+
+struct Utf8Kernels {
+    bool (*valid)(const char*, size_t);
+};
+
+// avx-512 runs the avx2 check, a block per 32 bytes already keeps up with memory
+inline const Utf8Kernels utf8_kernels[] = {
+    {valid_utf8_scalar},
+#if defined(NETVENT_X86)
+    {valid_utf8_sse},
+    {valid_utf8_avx2},
+#endif
+};
+
+inline bool valid_utf8(std::string_view text) {
+    return pick_kernels(utf8_kernels).valid(text.data(), text.size());
+}
+
+// text with every invalid sequence replaced by U+FFFD, one per maximal bad subpart like the
+// unicode standard recommends (and browsers do)
+inline std::string repair_utf8(std::string_view text) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+    const size_t n = text.size();
+    std::string out;
+    out.reserve(n + 8);
+    size_t i = 0, run = 0;
+    while (i < n) {
+        size_t length = utf8_char_length(p + i, n - i);
+        if (length) {
+            i += length;
+            continue;
+        }
+        out.append(text.data() + run, i - run);
+        out += "\xEF\xBF\xBD";
+        // skip the lead and whatever continuations it could still have taken
+        size_t skip = 1;
+        const unsigned char c = p[i];
+        const size_t need = c >= 0xF0 && c <= 0xF4 ? 3 : c >= 0xE0 && c <= 0xEF ? 2 : c >= 0xC2 && c <= 0xDF ? 1 : 0;
+        const unsigned char lo = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+        const unsigned char hi = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+        while (skip <= need && i + skip < n && p[i + skip] >= (skip == 1 ? lo : 0x80) && p[i + skip] <= (skip == 1 ? hi : 0xBF)) skip++;
+        i += skip;
+        run = i;
+    }
+    out.append(text.data() + run, n - run);
+    return out;
+}
+
+// ---- base64 and hex ----
+// for blobs in text that has to stay printable. the kernels take whole blocks (12 or 24 bytes
+// to base64, 16 or 32 chars back) and finish the rest with the scalar loop, decoders stop at the
+// first character that doesn't belong and report how far they got
+
+inline constexpr char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+inline constexpr char hex_alphabet[] = "0123456789abcdef";
+
+struct Base64Values {
+    uint8_t v[256];
+    constexpr Base64Values() : v() {
+        for (uint8_t& x : v) x = 0xFF;
+        for (int i = 0; i < 64; i++) v[static_cast<uint8_t>(base64_alphabet[i])] = static_cast<uint8_t>(i);
+    }
+};
+
+inline constexpr Base64Values base64_values{};
+
+// whole groups of 3 bytes into 4 chars, returns the bytes used
+inline size_t encode_base64_scalar(const char* in, size_t n, char* out) {
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3) {
+        const uint32_t v = static_cast<uint32_t>(static_cast<uint8_t>(in[i])) << 16 |
+                           static_cast<uint32_t>(static_cast<uint8_t>(in[i + 1])) << 8 | static_cast<uint8_t>(in[i + 2]);
+        *out++ = base64_alphabet[v >> 18];
+        *out++ = base64_alphabet[(v >> 12) & 63];
+        *out++ = base64_alphabet[(v >> 6) & 63];
+        *out++ = base64_alphabet[v & 63];
+    }
+    return i;
+}
+
+// whole groups of 4 chars into 3 bytes, returns the chars used
+inline size_t decode_base64_scalar(const char* in, size_t n, char* out) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const uint32_t a = base64_values.v[static_cast<uint8_t>(in[i])], b = base64_values.v[static_cast<uint8_t>(in[i + 1])];
+        const uint32_t c = base64_values.v[static_cast<uint8_t>(in[i + 2])], d = base64_values.v[static_cast<uint8_t>(in[i + 3])];
+        if ((a | b | c | d) & 0x80) break;
+        const uint32_t v = a << 18 | b << 12 | c << 6 | d;
+        *out++ = static_cast<char>(v >> 16);
+        *out++ = static_cast<char>(v >> 8);
+        *out++ = static_cast<char>(v);
+    }
+    return i;
+}
+
+inline void encode_hex_scalar(const char* in, size_t n, char* out) {
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t c = static_cast<uint8_t>(in[i]);
+        *out++ = hex_alphabet[c >> 4];
+        *out++ = hex_alphabet[c & 15];
+    }
+}
+
+// pairs of hex digits into bytes, returns the chars used
+inline size_t decode_hex_scalar(const char* in, size_t n, char* out) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const int hi = hex_digit(in[i]), lo = hex_digit(in[i + 1]);
+        if ((hi | lo) < 0) break;
+        *out++ = static_cast<char>(hi << 4 | lo);
+    }
+    return i;
+}
+
+#if defined(NETVENT_X86)
+
+// the base64 steps from Wojciech Mula and Alfred Klomp's work: shuffle each 3 bytes into the 4
+// bytes that hold their 6 bit pieces, shift them into place with multiplies, then add the offset
+// of each piece's range in the alphabet. decoding checks every char against two nibble tables,
+// turns it into its value with a third and packs the values back with multiply-adds
+
+NETVENT_TARGET("sse4.2") inline __m128i base64_pieces_sse(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    const __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    const __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
+}
+
+NETVENT_TARGET("sse4.2") inline __m128i base64_chars_sse(__m128i pieces) {
+    const __m128i offsets = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i index = _mm_subs_epu8(pieces, _mm_set1_epi8(51));
+    index = _mm_sub_epi8(index, _mm_cmpgt_epi8(pieces, _mm_set1_epi8(25)));
+    return _mm_add_epi8(pieces, _mm_shuffle_epi8(offsets, index));
+}
+
+NETVENT_TARGET("sse4.2") inline size_t encode_base64_sse(const char* in, size_t n, char* out) {
+    size_t i = 0;
+    // 12 bytes in, but the load reads 16
+    for (; i + 16 <= n; i += 12, out += 16) {
+        const __m128i chars = base64_chars_sse(base64_pieces_sse(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chars);
+    }
+    return i + encode_base64_scalar(in + i, n - i, out);
+}
+
+// the values of 16 base64 chars, false if one of them isn't in the alphabet
+NETVENT_TARGET("sse4.2") inline bool base64_values_sse(__m128i& chars) {
+    const __m128i low_table = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i high_table = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i roll_table = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2F);
+    const __m128i high = _mm_and_si128(_mm_srli_epi32(chars, 4), mask_2f);
+    const __m128i low = _mm_and_si128(chars, mask_2f);
+    if (!_mm_testz_si128(_mm_shuffle_epi8(low_table, low), _mm_shuffle_epi8(high_table, high))) return false;
+    const __m128i roll = _mm_shuffle_epi8(roll_table, _mm_add_epi8(_mm_cmpeq_epi8(chars, mask_2f), high));
+    chars = _mm_add_epi8(chars, roll);
+    return true;
+}
+
+NETVENT_TARGET("sse4.2") inline size_t decode_base64_sse(const char* in, size_t n, char* out) {
+    size_t i = 0;
+    // 12 bytes out, but the store writes 16
+    for (; i + 16 <= n; i += 16, out += 12) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        if (!base64_values_sse(values)) break;
+        const __m128i merged = _mm_madd_epi16(_mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+    }
+    return i + decode_base64_scalar(in + i, n - i, out);
+}
+
+NETVENT_TARGET("sse4.2") inline void encode_hex_sse(const char* in, size_t n, char* out) {
+    const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hex_alphabet));
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16, out += 32) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m128i high = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble));
+        const __m128i low = _mm_shuffle_epi8(digits, _mm_and_si128(v, low_nibble));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm_unpackhi_epi8(high, low));
+    }
+    encode_hex_scalar(in + i, n - i, out);
+}
+
+// the values of 16 hex digits, false if one isn't
+NETVENT_TARGET("sse4.2") inline bool hex_values_sse(__m128i& chars) {
+    const __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    const __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    const __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    const __m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+    if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xFFFF) return false;
+    chars = _mm_blendv_epi8(_mm_add_epi8(letter, _mm_set1_epi8(10)), digit, is_digit);
+    return true;
+}
+
+NETVENT_TARGET("sse4.2") inline size_t decode_hex_sse(const char* in, size_t n, char* out) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16, out += 8) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        if (!hex_values_sse(values)) break;
+        const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi16(0x0110));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(pairs, pairs));
+    }
+    return i + decode_hex_scalar(in + i, n - i, out);
+}
+
+NETVENT_TARGET("avx2") inline size_t encode_base64_avx2(const char* in, size_t n, char* out) {
+    const __m256i offsets = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+                                             65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    const __m256i order = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                           1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    size_t i = 0;
+    // 24 bytes in, each lane reads 16 of them starting 12 apart
+    for (; i + 28 <= n; i += 24, out += 32) {
+        __m256i v = _mm256_set_m128i(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12)),
+                                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        v = _mm256_shuffle_epi8(v, order);
+        const __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+        const __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+        const __m256i pieces = _mm256_or_si256(t0, t1);
+        __m256i index = _mm256_subs_epu8(pieces, _mm256_set1_epi8(51));
+        index = _mm256_sub_epi8(index, _mm256_cmpgt_epi8(pieces, _mm256_set1_epi8(25)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_add_epi8(pieces, _mm256_shuffle_epi8(offsets, index)));
+    }
+    return i + encode_base64_sse(in + i, n - i, out);
+}
+
+NETVENT_TARGET("avx2") inline size_t decode_base64_avx2(const char* in, size_t n, char* out) {
+    const __m256i low_table = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                               0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i high_table = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                                0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i roll_table = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+    size_t i = 0;
+    // 24 bytes out, but the store writes 32
+    for (; i + 32 <= n; i += 32, out += 24) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        const __m256i high = _mm256_and_si256(_mm256_srli_epi32(chars, 4), mask_2f);
+        const __m256i low = _mm256_and_si256(chars, mask_2f);
+        if (!_mm256_testz_si256(_mm256_shuffle_epi8(low_table, low), _mm256_shuffle_epi8(high_table, high))) break;
+        chars = _mm256_add_epi8(chars, _mm256_shuffle_epi8(roll_table, _mm256_add_epi8(_mm256_cmpeq_epi8(chars, mask_2f), high)));
+        __m256i merged = _mm256_madd_epi16(_mm256_maddubs_epi16(chars, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), merged);
+    }
+    return i + decode_base64_sse(in + i, n - i, out);
+}
+
+NETVENT_TARGET("avx2") inline void encode_hex_avx2(const char* in, size_t n, char* out) {
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex_alphabet)));
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32, out += 64) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        const __m256i high = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+        const __m256i low = _mm256_shuffle_epi8(digits, _mm256_and_si256(v, low_nibble));
+        // the unpacks work per lane, so put the halves back in order
+        const __m256i first = _mm256_unpacklo_epi8(high, low), second = _mm256_unpackhi_epi8(high, low);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    encode_hex_sse(in + i, n - i, out);
+}
+
+NETVENT_TARGET("avx2") inline size_t decode_hex_avx2(const char* in, size_t n, char* out) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32, out += 16) {
+        const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        const __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+        const __m256i letter = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+        const __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+        const __m256i is_letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+        if (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_letter))) != 0xFFFFFFFFu) break;
+        const __m256i values = _mm256_blendv_epi8(_mm256_add_epi8(letter, _mm256_set1_epi8(10)), digit, is_digit);
+        const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi16(0x0110));
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+    }
+    return i + decode_hex_sse(in + i, n - i, out);
+}
+
+#endif
+
+struct BinaryTextKernels {
+    size_t (*encode_base64)(const char*, size_t, char*);
+    size_t (*decode_base64)(const char*, size_t, char*);
+    void (*encode_hex)(const char*, size_t, char*);
+    size_t (*decode_hex)(const char*, size_t, char*);
+};
+
+// avx-512 runs the avx2 kernels, these are already bound by memory
+inline const BinaryTextKernels binary_text_kernels[] = {
+    {encode_base64_scalar, decode_base64_scalar, encode_hex_scalar, decode_hex_scalar},
+#if defined(NETVENT_X86)
+    {encode_base64_sse, decode_base64_sse, encode_hex_sse, decode_hex_sse},
+    {encode_base64_avx2, decode_base64_avx2, encode_hex_avx2, decode_hex_avx2},
+#endif
+};
+
+// standard base64 with = padding
+inline void append_base64(std::string& out, std::string_view bytes) {
+    const size_t size = out.size();
+    out.resize(size + (bytes.size() + 2) / 3 * 4);
+    char* p = &out[size];
+    const size_t done = pick_kernels(binary_text_kernels).encode_base64(bytes.data(), bytes.size(), p);
+    p += done / 3 * 4;
+    if (bytes.size() - done == 1) {
+        const uint8_t a = static_cast<uint8_t>(bytes[done]);
+        p[0] = base64_alphabet[a >> 2];
+        p[1] = base64_alphabet[(a & 3) << 4];
+        p[2] = p[3] = '=';
+    } else if (bytes.size() - done == 2) {
+        const uint8_t a = static_cast<uint8_t>(bytes[done]), b = static_cast<uint8_t>(bytes[done + 1]);
+        p[0] = base64_alphabet[a >> 2];
+        p[1] = base64_alphabet[(a & 3) << 4 | b >> 4];
+        p[2] = base64_alphabet[(b & 15) << 2];
+        p[3] = '=';
+    }
+}
+
+// appends the bytes, false (with out as it was) if text isn't base64
+inline bool decode_base64(std::string_view text, std::string& out) {
+    if (text.size() % 4) return false;
+    size_t pad = 0;
+    if (!text.empty() && text.back() == '=') pad = text[text.size() - 2] == '=' ? 2 : 1;
+    const size_t body = pad ? text.size() - 4 : text.size();
+    const size_t size = out.size();
+    // the kernels store whole vectors past the end of what they decode
+    out.resize(size + text.size() / 4 * 3 + 32);
+    char* p = &out[size];
+    if (pick_kernels(binary_text_kernels).decode_base64(text.data(), body, p) != body) {
+        out.resize(size);
+        return false;
+    }
+    p += body / 4 * 3;
+    if (pad) {
+        const uint8_t a = base64_values.v[static_cast<uint8_t>(text[body])], b = base64_values.v[static_cast<uint8_t>(text[body + 1])];
+        const uint8_t c = pad == 1 ? base64_values.v[static_cast<uint8_t>(text[body + 2])] : 0;
+        if ((a | b | c) & 0x80) {
+            out.resize(size);
+            return false;
+        }
+        *p++ = static_cast<char>(a << 2 | b >> 4);
+        if (pad == 1) *p++ = static_cast<char>(b << 4 | c >> 2);
+    }
+    out.resize(static_cast<size_t>(p - out.data()));
+    return true;
+}
+
+inline void append_hex(std::string& out, std::string_view bytes) {
+    const size_t size = out.size();
+    out.resize(size + bytes.size() * 2);
+    pick_kernels(binary_text_kernels).encode_hex(bytes.data(), bytes.size(), &out[size]);
+}
+
+// appends the bytes, false (with out as it was) if text isn't hex. either case is fine
+inline bool decode_hex(std::string_view text, std::string& out) {
+    if (text.size() % 2) return false;
+    const size_t size = out.size();
+    out.resize(size + text.size() / 2);
+    if (pick_kernels(binary_text_kernels).decode_hex(text.data(), text.size(), &out[size]) != text.size()) {
+        out.resize(size);
+        return false;
+    }
+    return true;
+}
+
+// appends the bytes of text when it's exactly one #base64: or #hex: blob, false if it's not
+// one. throws when it is but the characters don't decode
+inline bool decode_encoded_blob(std::string_view text, std::string& out) {
+    BlobText kind = BlobText::Raw;
+    size_t chars_at = 0, chars_end = 0;
+    if (!encoded_blob(text, 0, kind, chars_at, chars_end) || chars_end != text.size()) return false;
+    const std::string_view chars = text.substr(chars_at, chars_end - chars_at);
+    if (kind == BlobText::Base64 && !decode_base64(chars, out)) throw std::runtime_error("Bad base64 in a blob");
+    if (kind == BlobText::Hex && !decode_hex(chars, out)) throw std::runtime_error("Bad hex in a blob");
+    return true;
+}
+
+} // namespace detail
+
+namespace detail {
+
+// ---- line tokenizer ----
+// netvent event text is turned into bitmasks 64 bytes at a time: newlines, blanks (space, tab,
+// \r) and slashes. walking a line is then a few bit scans, all moving forward so each block is
+// looked at once: skip the indent, find the end of the key, the start of the value and whatever
+// ends the line first, a newline or a "//"
+
+struct LineMasks {
+    uint64_t newline;
+    uint64_t blank;
+    uint64_t slash;
+};
+
+inline LineMasks line_masks_scalar(const char* p) {
+    LineMasks m{0, 0, 0};
+    for (int i = 0; i < 64; i++) {
+        const char c = p[i];
+        m.newline |= static_cast<uint64_t>(c == '\n') << i;
+        m.blank |= static_cast<uint64_t>(c == ' ' || c == '\t' || c == '\r') << i;
+        m.slash |= static_cast<uint64_t>(c == '/') << i;
+    }
+    return m;
+}
+
+#if defined(NETVENT_X86)
+
+NETVENT_TARGET("sse4.2") inline LineMasks line_masks_sse(const char* p) {
+    LineMasks m{0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * 16));
+        __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        m.newline |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')))) << (i * 16);
+        m.blank |= static_cast<uint64_t>(_mm_movemask_epi8(blank)) << (i * 16);
+        m.slash |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('/')))) << (i * 16);
+    }
+    return m;
+}
+
+NETVENT_TARGET("avx2") inline LineMasks line_masks_avx2(const char* p) {
+    LineMasks m{0, 0, 0};
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i * 32));
+        __m256i blank = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        m.newline |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))))) << (i * 32);
+        m.blank |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(blank))) << (i * 32);
+        m.slash |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'))))) << (i * 32);
+    }
+    return m;
+}
+
+NETVENT_TARGET("avx512f,avx512bw") inline LineMasks line_masks_avx512(const char* p) {
+    __m512i v = _mm512_loadu_si512(p);
+    return {_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\n')),
+            _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(' ')) | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\t')) |
+                _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\r')),
+            _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('/'))};
+}
+
+#endif
+
+struct LineMaskKernels {
+    LineMasks (*masks)(const char*);
+};
+
+inline const LineMaskKernels line_mask_kernels[] = {
+    {line_masks_scalar},
+#if defined(NETVENT_X86)
+    {line_masks_sse},
+    {line_masks_avx2},
+    {line_masks_avx512},
+#endif
+};
+
+// hands out the event name line and then key/value views, skipping blank lines, '#' lines and
+// "//" comments. a key runs to the first blank, lines without a value are skipped
+// where the line content starting at text[i] stops: its newline, or a "//" comment outside its
+// strings and blobs. a blob is stepped over wherever it sits in the value, so newlines and slashes in its
+// bytes belong to it. a string that never closes runs to the end of its line
+constexpr size_t value_end(std::string_view text, size_t i) {
+    for (; i < text.size(); i++) {
+        if (text[i] == '\n' || (text[i] == '/' && i + 1 < text.size() && text[i + 1] == '/')) return i;
+        if (text[i] == '"') {
+            const size_t line_end = std::min(text.find('\n', i), text.size());
+            i = string_end(text.substr(0, line_end), i);
+            if (i == std::string_view::npos) return line_end;
+        } else if (text[i] == '#') {
+            i = literal_end(text, i);
+        }
+    }
+    return text.size();
+}
+
+class LineTokenizer {
+    private:
+        std::string_view text;
+        size_t pos = 0;
+        size_t block = ~size_t(0);      // start of the block masks belongs to
+        LineMasks masks{0, 0, 0};       // slash already narrowed to comment starts
+        LineMasks (*kernel)(const char*) = nullptr;
+
+        static constexpr uint64_t blank_bits(const LineMasks& m) { return m.blank; }
+        static constexpr uint64_t content_bits(const LineMasks& m) { return ~m.blank; }
+        static constexpr uint64_t newline_bits(const LineMasks& m) { return m.newline; }
+        static constexpr uint64_t line_end_bits(const LineMasks& m) { return m.newline | m.slash; }
+        static constexpr uint64_t key_end_bits(const LineMasks& m) { return m.blank | m.newline | m.slash; }
+
+        void load(size_t start) {
+            if (!kernel) kernel = pick_kernels(line_mask_kernels).masks;
+            block = start;
+            if (text.size() - start >= 64) {
+                masks = kernel(text.data() + start);
+            } else {
+                // the tail, zero bytes set no bits
+                char tail[64] = {};
+                std::memcpy(tail, text.data() + start, text.size() - start);
+                masks = kernel(tail);
+            }
+            // a comment starts at a slash followed by another, the last one looks past the block
+            const bool slash_after = start + 64 < text.size() && text[start + 64] == '/';
+            masks.slash &= (masks.slash >> 1) | (static_cast<uint64_t>(slash_after) << 63);
+        }
+
+        // the first position at or after from whose bit is set, text.size() if none
+        size_t find(size_t from, uint64_t (*bits_of)(const LineMasks&)) {
+            while (from < text.size()) {
+                const size_t base = from & ~size_t(63);
+                if (base != block) load(base);
+                const uint64_t bits = bits_of(masks) & (~uint64_t(0) << (from - base));
+                if (bits) return std::min(base + static_cast<size_t>(__builtin_ctzll(bits)), text.size());
+                from = base + 64;
+            }
+            return text.size();
+        }
+
+        size_t trim_end(size_t start, size_t end) const {
+            while (end > start && (text[end - 1] == ' ' || text[end - 1] == '\t' || text[end - 1] == '\r')) end--;
+            return end;
+        }
+
+        // a "//" on a line with a quote or a '#' before it might be inside a string or a base64
+        // blob, so walk that line byte by byte instead
+        void quoted_line(size_t start, size_t& key_end, size_t& value_start, size_t& end) {
+            const size_t line_end = find(end, newline_bits);
+            const size_t comment = comment_start(text.substr(start, line_end - start));
+            end = comment == std::string_view::npos ? line_end : start + comment;
+            key_end = start;
+            while (key_end < end && text[key_end] != ' ' && text[key_end] != '\t' && text[key_end] != '\r') key_end++;
+            value_start = key_end;
+            while (value_start < end && (text[value_start] == ' ' || text[value_start] == '\t' || text[value_start] == '\r')) value_start++;
+        }
+
+        // the next line with something on it: where it starts, where the key ends and the
+        // value starts, and where the content ends
+        bool next_line(size_t& start, size_t& key_end, size_t& value_start, size_t& end) {
+            while (pos < text.size()) {
+                start = find(pos, content_bits);
+                key_end = find(start, key_end_bits);
+                value_start = key_end;
+                if (key_end < text.size() && text[key_end] != '\n' && text[key_end] != '/') value_start = find(key_end, content_bits);
+                end = find(value_start, line_end_bits);
+                if (text[start] != '#' && value_start < end && std::memchr(text.data() + value_start, '#', find(end, newline_bits) - value_start)) {
+                    // a value with blobs in it, their bytes may hold newlines and slashes
+                    const size_t stop = value_end(text, start);
+                    pos = find(stop, newline_bits) + 1;
+                    end = start + trim_value(text.substr(start, stop - start)).size();
+                    return true;
+                }
+                if (end < text.size() && text[end] == '/' &&
+                    (std::memchr(text.data() + start, '"', end - start) || std::memchr(text.data() + start, '#', end - start)))
+                    quoted_line(start, key_end, value_start, end);
+                pos = end < text.size() && text[end] == '/' ? find(end, newline_bits) + 1 : end + 1;
+                end = trim_end(start, end);
+                if (start == end || text[start] == '#') continue;
+                return true;
+            }
+            return false;
+        }
+
+    public:
+        constexpr explicit LineTokenizer(std::string_view t) : text(t) {}
+
+        // the event name line, call once before next()
+        bool event(std::string_view& name) {
+            size_t start, key_end, value_start, end;
+            if (!next_line(start, key_end, value_start, end)) return false;
+            name = text.substr(start, end - start);
+            return true;
+        }
+
+        bool next(std::string_view& key, std::string_view& value) {
+            size_t start, key_end, value_start, end;
+            while (next_line(start, key_end, value_start, end)) {
+                if (value_start >= end) continue;
+                key = text.substr(start, key_end - start);
+                value = text.substr(value_start, end - value_start);
+                return true;
+            }
+            return false;
+        }
+};
+
+} // namespace detail
+
+class Table;
+class Value;
+
+// raw bytes (voice frames, compressed map chunks) that go through untouched. the bytes live in
+// a shared buffer, so copying a blob is cheap, and a blob can point into a buffer filled by
+// someone else, like the text of a received event, without copying anything
+class Blob {
+    private:
+        std::shared_ptr<const std::string> buffer;
+        size_t offset = 0;
+        size_t length = 0;
+
+    public:
+        Blob() = default;
+        explicit Blob(std::string bytes) : buffer(std::make_shared<const std::string>(std::move(bytes))), length(buffer->size()) {}
+        Blob(const void* bytes, size_t n) : Blob(std::string(static_cast<const char*>(bytes), n)) {}
+
+        // length bytes of shared starting at at, nothing is copied
+        Blob(std::shared_ptr<const std::string> shared, size_t at, size_t n) : buffer(std::move(shared)), offset(at), length(n) {
+            if (!buffer || at > buffer->size() || n > buffer->size() - at) throw std::runtime_error("Blob is outside its buffer");
+        }
+
+        const char* data() const { return buffer ? buffer->data() + offset : nullptr; }
+        size_t size() const { return length; }
+        bool empty() const { return length == 0; }
+        std::string_view view() const { return std::string_view(data(), length); }
+        std::string str() const { return std::string(view()); }
+
+        // the buffer the bytes sit in, shared with whoever else holds it
+        const std::shared_ptr<const std::string>& shared_buffer() const { return buffer; }
+
+        friend bool operator==(const Blob& lhs, const Blob& rhs) { return lhs.view() == rhs.view(); }
+        friend bool operator!=(const Blob& lhs, const Blob& rhs) { return !(lhs == rhs); }
+        friend bool operator<(const Blob& lhs, const Blob& rhs) { return lhs.view() < rhs.view(); }
+};
+
+// a long string (chat history, a serialized sub-document) kept as a list of chunks. copies share
+// the list, appending a segment that arrived in its own buffer doesn't copy it or what came
+// before, and GatherOutput writes the chunks out from where they are
+class Rope {
+    private:
+        std::shared_ptr<std::vector<Blob>> pieces;
+        size_t length = 0;
+
+        // the list is only ever changed while nobody else holds it
+        std::vector<Blob>& own() {
+            if (!pieces) pieces = std::make_shared<std::vector<Blob>>();
+            else if (pieces.use_count() > 1) pieces = std::make_shared<std::vector<Blob>>(*pieces);
+            return *pieces;
+        }
+
+    public:
+        Rope() = default;
+        explicit Rope(std::string text) { append(std::move(text)); }
+
+        Rope& append(std::string text) {
+            if (!text.empty()) append(Blob(std::move(text)));
+            return *this;
+        }
+
+        // shares the chunk's buffer
+        Rope& append(const Blob& chunk) {
+            if (chunk.empty()) return *this;
+            own().push_back(chunk);
+            length += chunk.size();
+            return *this;
+        }
+
+        Rope& append(const Rope& other) {
+            if (other.empty()) return *this;
+            auto theirs = other.pieces; // other might be *this
+            for (const Blob& chunk : *theirs) append(chunk);
+            return *this;
+        }
+
+        size_t size() const { return length; }
+        bool empty() const { return length == 0; }
+
+        const std::vector<Blob>& chunks() const {
+            static const std::vector<Blob> none;
+            return pieces ? *pieces : none;
+        }
+
+        // the whole string in one piece, this is the copy a rope is there to avoid
+        std::string str() const {
+            std::string out;
+            out.reserve(length);
+            for (const Blob& chunk : chunks()) out.append(chunk.data(), chunk.size());
+            return out;
+        }
+
+        // like std::string::compare, a chunk at a time
+        int compare(const Rope& other) const {
+            const std::vector<Blob>& a = chunks();
+            const std::vector<Blob>& b = other.chunks();
+            size_t i = 0, j = 0, at_a = 0, at_b = 0;
+            while (i < a.size() && j < b.size()) {
+                const size_t n = std::min(a[i].size() - at_a, b[j].size() - at_b);
+                if (int c = std::memcmp(a[i].data() + at_a, b[j].data() + at_b, n)) return c < 0 ? -1 : 1;
+                at_a += n;
+                at_b += n;
+                if (at_a == a[i].size()) i++, at_a = 0;
+                if (at_b == b[j].size()) j++, at_b = 0;
+            }
+            return length < other.length ? -1 : length > other.length ? 1 : 0;
+        }
+
+        friend bool operator==(const Rope& lhs, const Rope& rhs) { return lhs.length == rhs.length && lhs.compare(rhs) == 0; }
+        friend bool operator!=(const Rope& lhs, const Rope& rhs) { return !(lhs == rhs); }
+        friend bool operator<(const Rope& lhs, const Rope& rhs) { return lhs.compare(rhs) < 0; }
+};
+
+// serialized text as a list of pieces for writev() or a stream. small parts are copied into
+// buffers it owns, big rope chunks and raw blob bytes are pointed at where they already are
+class GatherOutput {
+    private:
+        std::deque<std::string> buffers;    // a deque so the views into them stay put
+        std::vector<Blob> held;             // keeps the pointed-at chunks alive
+        std::vector<std::string_view> parts;
+        std::string pending;
+
+        void flush() {
+            if (pending.empty()) return;
+            buffers.push_back(std::move(pending));
+            pending.clear();
+            parts.push_back(buffers.back());
+        }
+
+    public:
+        // smaller chunks are cheaper to copy than to hand over as a piece of their own
+        static constexpr size_t min_shared = 1024;
+
+        void append(std::string_view text) { pending.append(text.data(), text.size()); }
+        void append(char c) { pending += c; }
+
+        void append_shared(const Blob& chunk) {
+            if (chunk.size() < min_shared) {
+                append(chunk.view());
+                return;
+            }
+            flush();
+            held.push_back(chunk);
+            parts.push_back(chunk.view());
+        }
+
+        const std::vector<std::string_view>& pieces() {
+            flush();
+            return parts;
+        }
+
+        size_t size() const {
+            size_t n = pending.size();
+            for (std::string_view part : parts) n += part.size();
+            return n;
+        }
+
+        std::string str() {
+            std::string out;
+            out.reserve(size());
+            for (std::string_view part : pieces()) out.append(part.data(), part.size());
+            return out;
+        }
+
+        void write(std::ostream& out) {
+            for (std::string_view part : pieces()) out.write(part.data(), static_cast<std::streamsize>(part.size()));
+        }
+};
+
+// comparison operators
+bool operator<(const Value& lhs, const Value& rhs);
+bool operator==(const Value& lhs, const Value& rhs);
+
+namespace detail {
+
+// scalar text encoding, shared by Value::serialize and the generated schema codecs
+inline void append_int(std::string& out, int v) {
+    char buf[16];
+    out.append(buf, pick_kernels(int_text_kernels).format_int(buf, v));
+}
+
+// a run of ints split by sep, formatted straight into out's buffer
+inline void append_ints(std::string& out, const int* v, size_t n, char sep = ',') {
+    if (n == 0) return;
+    const auto format = pick_kernels(int_text_kernels).format_int;
+    size_t size = out.size();
+    out.resize(size + n * 12 + 4);
+    char* p = &out[size];
+    p += format(p, v[0]);
+    for (size_t i = 1; i < n; i++) {
+        *p++ = sep;
+        p += format(p, v[i]);
+    }
+    out.resize(static_cast<size_t>(p - out.data()));
+}
+
+inline void append_float(std::string& out, float v) {
+    char buf[32];
+    out.append(buf, format_float(buf, v));
+}
+
+// a run of floats split by sep, formatted straight into out's buffer
+inline void append_floats(std::string& out, const float* v, size_t n, char sep = ',') {
+    if (n == 0) return;
+    size_t size = out.size();
+    out.resize(size + n * 25);
+    char* p = &out[size];
+    p += format_float(p, v[0]);
+    for (size_t i = 1; i < n; i++) {
+        *p++ = sep;
+        p += format_float(p, v[i]);
+    }
+    out.resize(static_cast<size_t>(p - out.data()));
+}
+
+// the other way, false (with out holding what came before) at the first bad one
+inline bool parse_floats(std::string_view text, std::vector<float>& out, char sep = ',') {
+    if (text.empty()) return true;
+    for (size_t start = 0;;) {
+        size_t end = std::min(text.find(sep, start), text.size());
+        float v;
+        if (!parse_float(text.substr(start, end - start), v)) return false;
+        out.push_back(v);
+        if (end == text.size()) return true;
+        start = end + 1;
+    }
+}
+
+inline void append_bool(std::string& out, bool v) {
+    out += v ? "true" : "false";
+}
+
+inline void append_string(std::string& out, std::string_view v) {
+    out += '"';
+    append_escaped(out, v);
+    out += '"';
+}
+
+// the #<length>: in front of a raw blob
+inline std::string blob_text_header(size_t length) {
+    char header[24];
+    header[0] = '#';
+    char* end = std::to_chars(header + 1, header + sizeof(header) - 1, length).ptr;
+    *end++ = ':';
+    return std::string(header, end);
+}
+
+// #<length>:<bytes>, the bytes as they are, or #base64:/#hex: when it has to be printable
+inline void append_blob(std::string& out, std::string_view bytes, BlobText mode = BlobText::Raw) {
+    if (mode == BlobText::Base64) {
+        out += "#base64:";
+        append_base64(out, bytes);
+        return;
+    }
+    if (mode == BlobText::Hex) {
+        out += "#hex:";
+        append_hex(out, bytes);
+        return;
+    }
+    const std::string header = blob_text_header(bytes.size());
+    out.reserve(out.size() + header.size() + bytes.size());
+    out += header;
+    out.append(bytes.data(), bytes.size());
+}
+
+} // namespace detail
+
+// how a map-mode Table keeps its keys: sorted (the default), or in the order they were added
+// with a hash index for lookups
+enum class TableOrder { Sorted, Insertion };
+
+// what Table::merge does with a key both tables have: take the incoming value, keep the one
+// that's there, or merge two tables into each other and take incoming values below that
+enum class MergePolicy { Replace, KeepExisting, Deep };
+
+namespace detail {
+
+// hashes values the way operator== compares them
+struct ValueHash {
+    size_t operator()(const Value& v) const;
+};
+
+} // namespace detail
+
+class Value {
+    private:
+        std::variant<int, float, bool, std::string, std::shared_ptr<Table>, Blob, Rope> data;
+
+    public:
+        // creates a null value (0)
+        Value() : data(0) {}
+        
+        // constructors for different types
+        Value(int v) : data(v) {}
+        Value(float v) : data(v) {}
+        Value(bool v) : data(v) {}
+        Value(const char* v) : data(std::string(v)) {}
+        Value(const std::string& v) : data(v) {}
+        Value(const Table& v) : data(std::make_shared<Table>(v)) {}
+        Value(const std::shared_ptr<Table>& v) : data(v) {}
+        Value(const Blob& v) : data(v) {}
+        Value(const Rope& v) : data(v) {}
+
+        // type checkers
+        bool is_int() const { return std::holds_alternative<int>(data); }
+        bool is_float() const { return std::holds_alternative<float>(data); }
+        bool is_bool() const { return std::holds_alternative<bool>(data); }
+        bool is_string() const { return std::holds_alternative<std::string>(data); }
+        bool is_table() const { return std::holds_alternative<std::shared_ptr<Table>>(data); }
+        bool is_blob() const { return std::holds_alternative<Blob>(data); }
+        bool is_rope() const { return std::holds_alternative<Rope>(data); }
+
+        // getters
+        int as_int() const { return std::get<int>(data); }
+        float as_float() const { return std::get<float>(data); }
+        bool as_bool() const { return std::get<bool>(data); }
+        std::string as_string() const { return std::get<std::string>(data); }
+        // the same without copying it, good while the value lives and isn't changed
+        std::string_view as_string_view() const { return std::get<std::string>(data); }
+        const Table& as_table() const { return *std::get<std::shared_ptr<Table>>(data); }
+        Table& as_table() { return *std::get<std::shared_ptr<Table>>(data); }
+        // the table to change in place, copied first when another value shares it
+        Table& as_own_table();
+        const Blob& as_blob() const { return std::get<Blob>(data); }
+        const Rope& as_rope() const { return std::get<Rope>(data); }
+
+
+        // comparison operators
+        friend bool operator<(const Value& lhs, const Value& rhs);
+        friend bool operator==(const Value& lhs, const Value& rhs);
+        friend struct detail::ValueHash;
+
+        // serialize and deserialize, binary picks how blobs are written and order how the
+        // tables read back keep their keys
+        std::string serialize(BlobText binary = BlobText::Raw) const;
+        void serialize(GatherOutput& out, BlobText binary = BlobText::Raw) const;
+        static Value deserialize(const std::string& data, TableOrder order = TableOrder::Sorted);
+    };
+
+class Table {
+    // table is like lua table, it can be nested and can be array or objects
+    private:
+        std::map<Value, Value> data;
+        bool is_array = false;
+
+        // insertion-ordered maps keep their entries here instead, in the order they were added,
+        // with an open-addressed index of (hash, entry + 1) slots into them like python's dicts.
+        // a deque so references handed out by operator[] stay good as it grows
+        struct OrderedEntries {
+            std::deque<std::pair<Value, Value>> entries;
+            std::vector<std::pair<size_t, size_t>> slots;
+        };
+        // only made for TableOrder::Insertion, sorted maps and arrays don't pay for it
+        std::unique_ptr<OrderedEntries> ordered;
+
+        // the slot holding key, or the empty one it would go in
+        size_t slot_of(const Value& key, size_t hash) const {
+            const auto& slots = ordered->slots;
+            const size_t mask = slots.size() - 1;
+            for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                const auto& slot = slots[i];
+                if (!slot.second || (slot.first == hash && ordered->entries[slot.second - 1].first == key)) return i;
+            }
+        }
+
+        // the entry for key, added at the end when it's new
+        size_t entry_of(const Value& key) {
+            auto& [entries, slots] = *ordered;
+            if ((entries.size() + 1) * 2 > slots.size()) {
+                // at most half full, so probes stay short
+                std::vector<std::pair<size_t, size_t>> old(std::max<size_t>(8, slots.size() * 2));
+                old.swap(slots);
+                for (const auto& slot : old)
+                    if (slot.second) slots[slot_of(entries[slot.second - 1].first, slot.first)] = slot;
+            }
+            const size_t hash = detail::ValueHash{}(key);
+            auto& slot = slots[slot_of(key, hash)];
+            if (!slot.second) {
+                entries.emplace_back(key, Value());
+                slot = {hash, entries.size()};
+            }
+            return slot.second - 1;
+        }
+
+        size_t count() const { return ordered ? ordered->entries.size() : data.size(); }
+
+        Value* find_mutable(const Value& key) { return const_cast<Value*>(find(key)); }
+
+        // nothing to do when the value is already there: the very same table, or an equal
+        // scalar. tables that only look the same are still replaced, comparing costs more
+        static bool unchanged(const Value& existing, const Value& incoming) {
+            if (existing.is_table() || incoming.is_table())
+                return existing.is_table() && incoming.is_table() && &existing.as_table() == &incoming.as_table();
+            return existing == incoming;
+        }
+
+        size_t merge_value(const Value& key, Value&& incoming, MergePolicy policy);
+
+        const Value* find_entry(const Value& key) const {
+            if (ordered->slots.empty()) return nullptr;
+            const auto& slot = ordered->slots[slot_of(key, detail::ValueHash{}(key))];
+            return slot.second ? &ordered->entries[slot.second - 1].second : nullptr;
+        }
+
+        // every key and value, in the order serialize writes them
+        template<typename F>
+        void each(F&& f) const {
+            if (ordered) {
+                for (const auto& pair : ordered->entries) f(pair.first, pair.second);
+            } else {
+                for (const auto& pair : data) f(pair.first, pair.second);
+            }
+        }
+
+        friend struct detail::ValueHash;
+
+    public:
+        Table() = default;
+        // an empty map that keeps its keys in order (or sorted, same as Table())
+        explicit Table(TableOrder order) {
+            if (order == TableOrder::Insertion) ordered = std::make_unique<OrderedEntries>();
+        }
+        // copies get their own ordered entries
+        Table(const Table& other)
+            : data(other.data), is_array(other.is_array),
+              ordered(other.ordered ? std::make_unique<OrderedEntries>(*other.ordered) : nullptr) {}
+        Table(Table&&) = default;
+        Table& operator=(const Table& other) {
+            if (this != &other) *this = Table(other);
+            return *this;
+        }
+        Table& operator=(Table&&) = default;
+        Table(TableOrder order, std::initializer_list<std::pair<Value, Value>> init) : Table(order) {
+            for (const auto& [key, value] : init) (*this)[key] = value;
+        }
+        Table(const std::map<Value, Value>& d) : data(d) {}
+        Table(const std::vector<Value>& d) {
+            for (size_t i = 0; i < d.size(); i++) {
+                data[Value(static_cast<int>(i))] = d[i];
+            }
+            is_array = true;
+        }
+        Table(std::initializer_list<std::pair<Value, Value>> init) : data(init.begin(), init.end()) {}
+        Table(std::initializer_list<Value> init) : data() {
+            size_t i = 0;
+            for (const auto& v : init) {
+                data[Value(static_cast<int>(i++))] = v;
+            }
+            is_array = true;
+        }
+        Table(std::initializer_list<std::pair<const char*, Value>> init) {
+            for (const auto& [key, value] : init) {
+                data[Value(key)] = value;
+            }
+        }
+
+        void push_back(const Value& value) {
+            if (!is_array) throw std::runtime_error("Table is not an array");
+            data[Value(static_cast<int>(data.size()))] = value;
+        }
+
+        void push_back(const Value& key, const Value& value) {
+            if (is_array) throw std::runtime_error("Table is not an array");
+            (*this)[key] = value;
+        }
+
+        Value& operator[](const Value& key) {
+            if (ordered) return ordered->entries[entry_of(key)].second;
+            return data[key];
+        }
+
+        bool exists(const Value& key) const {
+            return find(key) != nullptr;
+        }
+
+        // nullptr when the key isn't there
+        const Value* find(const Value& key) const {
+            if (ordered) return find_entry(key);
+            auto it = data.find(key);
+            return it == data.end() ? nullptr : &it->second;
+        }
+
+        size_t size() const { return count(); }
+        bool get_is_array() const { return is_array; }
+        bool get_is_ordered() const { return ordered != nullptr; }
+        std::variant<std::map<Value, Value>, std::vector<Value>> get_data() const {
+            if (is_array) {
+                std::vector<Value> vec;
+                for (const auto& pair : data) {
+                    vec.push_back(pair.second);
+                }
+                return vec;
+            }
+            return get_data_map();
+        }
+
+        std::map<Value, Value> get_data_map() const {
+            if (!is_array) {
+                std::map<Value, Value> map;
+                each([&map](const Value& key, const Value& value) { map[key] = value; });
+                return map;
+            }
+            throw std::runtime_error("Table is not a map");
+        }
+
+        // the keys and values in table order: by index, sorted, or as they were added
+        std::vector<std::pair<Value, Value>> get_entries() const {
+            std::vector<std::pair<Value, Value>> out;
+            each([&out](const Value& key, const Value& value) { out.emplace_back(key, value); });
+            return out;
+        }
+
+        // the same in key order whatever the mode, as pointers into the table that are good
+        // until it changes
+        std::vector<std::pair<const Value*, const Value*>> sorted_entries() const {
+            std::vector<std::pair<const Value*, const Value*>> out;
+            out.reserve(count());
+            each([&out](const Value& key, const Value& value) { out.emplace_back(&key, &value); });
+            if (ordered) std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) { return *a.first < *b.first; });
+            return out;
+        }
+
+        // tables compare by what's in them, entry by entry in key order. arrays sort before
+        // maps, and an insertion-ordered map equals a sorted one holding the same entries
+        friend bool operator==(const Table& lhs, const Table& rhs);
+        friend bool operator!=(const Table& lhs, const Table& rhs) { return !(lhs == rhs); }
+        friend bool operator<(const Table& lhs, const Table& rhs);
+
+        std::vector<Value> get_data_vector() const {
+            if (is_array) {
+                std::vector<Value> vec;
+                for (const auto& pair : data) {
+                    vec.push_back(pair.second);
+                }
+                return vec;
+            }
+            throw std::runtime_error("Table is not an array");
+        }
+
+        // moves other's entries in, arrays by index. values already there aren't touched, and
+        // shared sub-tables are copied before being changed. returns how many values were set
+        size_t merge(Table&& other, MergePolicy policy = MergePolicy::Replace);
+
+        // sets the value at the end of a path of keys, making map tables for the keys that
+        // aren't there yet. false when the value was already there
+        bool update_path(const std::vector<Value>& path, Value&& value);
+
+        std::string serialize(BlobText binary = BlobText::Raw) const;
+        void serialize(GatherOutput& out, BlobText binary = BlobText::Raw) const;
+        static Table deserialize(const std::string& data, TableOrder order = TableOrder::Sorted);
+    };
+
+inline std::string Value::serialize(BlobText binary) const {
+    std::string out;
+    if (is_int()) {
+        detail::append_int(out, as_int());
+    } else if (is_float()) {
+        detail::append_float(out, as_float());
+    } else if (is_bool()) {
+        detail::append_bool(out, as_bool());
+    } else if (is_string()) {
+        detail::append_string(out, std::get<std::string>(data));
+    } else if (is_table()) {
+        out += as_table().serialize(binary);
+    } else if (is_blob()) {
+        detail::append_blob(out, as_blob().view(), binary);
+    } else if (is_rope()) {
+        out += '"';
+        for (const Blob& chunk : as_rope().chunks()) detail::append_escaped(out, chunk.view());
+        out += '"';
+    }
+    return out;
+}
+
+// the same text, with rope chunks that need no escaping and raw blob bytes left where they are
+inline void Value::serialize(GatherOutput& out, BlobText binary) const {
+    if (is_table()) {
+        as_table().serialize(out, binary);
+    } else if (is_blob() && binary == BlobText::Raw) {
+        const Blob& blob = as_blob();
+        out.append(detail::blob_text_header(blob.size()));
+        out.append_shared(blob);
+    } else if (is_rope()) {
+        out.append('"');
+        const auto clean_prefix = detail::pick_kernels(detail::string_kernels).clean_prefix;
+        std::string escaped;
+        for (const Blob& chunk : as_rope().chunks()) {
+            if (chunk.size() >= GatherOutput::min_shared && clean_prefix(chunk.data(), chunk.size()) == chunk.size()) {
+                out.append_shared(chunk);
+                continue;
+            }
+            escaped.clear();
+            detail::append_escaped(escaped, chunk.view());
+            out.append(escaped);
+        }
+        out.append('"');
+    } else {
+        out.append(serialize(binary));
+    }
+}
+
+inline Value Value::deserialize(const std::string& data, TableOrder order) {
+    if (data.empty()) throw std::runtime_error("Empty data");
+
+    // blobs are copied out whole, their bytes are never looked at
+    size_t bytes_at = 0, length = 0;
+    if (detail::blob_header(data, 0, bytes_at, length)) {
+        if (bytes_at + length != data.size()) throw std::runtime_error("Blob length doesn't match its bytes");
+        return Value(Blob(data.data() + bytes_at, length));
+    }
+    std::string bytes;
+    if (data[0] == '#' && detail::decode_encoded_blob(data, bytes)) return Value(Blob(std::move(bytes)));
+
+    // plain ints are the common case
+    const std::string_view number = detail::number_text(data);
+    int i = 0;
+    if (detail::parse_int(number, i)) return Value(i);
+
+    // test if it's a float, anything with junk after the number isn't one
+    float f = 0;
+    if (number.find('.') != std::string_view::npos && detail::parse_float(number, f)) return Value(f);
+    if (number == "inf" || number == "-inf") return Value(number[0] == '-' ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity());
+    if (number == "nan") return Value(std::numeric_limits<float>::quiet_NaN());
+
+    // test if it's a bool
+    if (data == "true") return Value(true);
+    if (data == "false") return Value(false);
+
+    // test if it's a string (quoted)
+    if (detail::is_quoted(data)) {
+        return Value(detail::unescape(std::string_view(data).substr(1, data.length() - 2)));
+    }
+    
+    // test if it's a table
+    if (data[0] == '[' || data[0] == '{') {
+        return Value(Table::deserialize(data, order));
+    }
+
+    // default to string
+    return Value(data);
+}
+
+// serialize the table
+inline std::string Table::serialize(BlobText binary) const {
+    std::string out;
+    if (is_array) {
+        out += '[';
+        // runs of ints or floats are formatted in one go
+        std::vector<int> ints;
+        std::vector<float> floats;
+        for (auto it = data.begin(); it != data.end();) {
+            if (it != data.begin()) out += ',';
+            if (it->second.is_int()) {
+                ints.clear();
+                for (; it != data.end() && it->second.is_int(); ++it) ints.push_back(it->second.as_int());
+                detail::append_ints(out, ints.data(), ints.size());
+            } else if (it->second.is_float()) {
+                floats.clear();
+                for (; it != data.end() && it->second.is_float(); ++it) floats.push_back(it->second.as_float());
+                detail::append_floats(out, floats.data(), floats.size());
+            } else {
+                out += it->second.serialize(binary);
+                ++it;
+            }
+        }
+        out += ']';
+        return out;
+    }
+    out += '{';
+    bool first = true;
+    each([&](const Value& key, const Value& value) {
+        if (!first) out += ',';
+        first = false;
+        out += key.serialize(binary);
+        out += '=';
+        out += value.serialize(binary);
+    });
+    out += '}';
+    return out;
+}
+
+inline void Table::serialize(GatherOutput& out, BlobText binary) const {
+    out.append(is_array ? '[' : '{');
+    bool first = true;
+    each([&](const Value& key, const Value& value) {
+        if (!first) out.append(',');
+        first = false;
+        if (!is_array) {
+            key.serialize(out, binary);
+            out.append('=');
+        }
+        value.serialize(out, binary);
+    });
+    out.append(is_array ? ']' : '}');
+}
+
+inline Table& Value::as_own_table() {
+    auto& table = std::get<std::shared_ptr<Table>>(data);
+    if (table.use_count() > 1) table = std::make_shared<Table>(*table);
+    return *table;
+}
+
+inline size_t Table::merge_value(const Value& key, Value&& incoming, MergePolicy policy) {
+    Value* existing = find_mutable(key);
+    if (!existing) {
+        (*this)[key] = std::move(incoming);
+        return 1;
+    }
+    if (policy == MergePolicy::KeepExisting || unchanged(*existing, incoming)) return 0;
+    if (policy == MergePolicy::Deep && existing->is_table() && incoming.is_table() &&
+        existing->as_table().is_array == incoming.as_table().is_array)
+        return existing->as_own_table().merge(std::move(incoming.as_own_table()), policy);
+    *existing = std::move(incoming);
+    return 1;
+}
+
+inline size_t Table::merge(Table&& other, MergePolicy policy) {
+    if (&other == this) return 0;
+    if (other.is_array != is_array) throw std::runtime_error(is_array ? "Can't merge a map into an array" : "Can't merge an array into a map");
+    size_t changed = 0;
+    if (other.ordered) {
+        for (auto& [key, value] : other.ordered->entries) changed += merge_value(key, std::move(value), policy);
+    } else {
+        for (auto it = other.data.begin(); it != other.data.end();) {
+            auto next = std::next(it);
+            if (!ordered && !data.count(it->first)) {
+                // a new key takes the whole node along, nothing is copied
+                data.insert(other.data.extract(it));
+                changed++;
+            } else {
+                changed += merge_value(it->first, std::move(it->second), policy);
+            }
+            it = next;
+        }
+    }
+    other.data.clear();
+    if (other.ordered) *other.ordered = OrderedEntries();
+    return changed;
+}
+
+inline bool Table::update_path(const std::vector<Value>& path, Value&& value) {
+    if (path.empty()) throw std::runtime_error("Empty path");
+    Table* at = this;
+    for (size_t i = 0; i + 1 < path.size(); i++) {
+        Value* next = at->find_mutable(path[i]);
+        if (!next) {
+            next = &(*at)[path[i]];
+            *next = Value(Table(at->ordered ? TableOrder::Insertion : TableOrder::Sorted));
+        } else if (!next->is_table()) {
+            throw std::runtime_error("Path goes through a value that isn't a table: " + path[i].serialize());
+        }
+        at = &next->as_own_table();
+    }
+    const Value* existing = at->find(path.back());
+    if (existing && unchanged(*existing, value)) return false;
+    (*at)[path.back()] = std::move(value);
+    return true;
+}
+
+inline Table Table::deserialize(const std::string& data, TableOrder order) {
+    if (data.empty()) throw std::runtime_error("Empty data");
+    
+    if (data[0] == '[') {
+        if (data.length() < 2 || data.back() != ']') 
+            throw std::runtime_error("Malformed array");
+            
+        if (data.length() == 2) // empty array == "[]"
+            return Table(std::vector<Value>());
+            
+        std::vector<Value> vec;
+        std::string content = data.substr(1, data.length() - 2);
+        size_t pos = 0;
+        size_t next;
+        int depth = 0;
+        std::string item;
+        
+        for (size_t i = 0; i < content.length(); i++) {
+            char c = content[i];
+            if (c == '"' || c == '#') {
+                // commas and brackets inside strings and blobs don't count
+                i = std::min(detail::literal_end(content, i), content.length() - 1);
+            }
+            else if (c == '[' || c == '{') depth++;
+            else if (c == ']' || c == '}') depth--;
+            else if (c == ',' && depth == 0) {
+                item = content.substr(pos, i - pos);
+                if (!item.empty()) {
+                    // get rid of whitespace
+                    item = std::string(detail::trim_value(item));
+                    if (!item.empty())
+                        vec.push_back(Value::deserialize(item, order));
+                }
+                pos = i + 1;
+            }
+        }
+        
+        item = content.substr(pos);
+        // only add final item if it's not empty (for trailing commas)
+        if (!item.empty()) {
+            // get rid of whitespace
+            item = std::string(detail::trim_value(item));
+            if (!item.empty())
+                vec.push_back(Value::deserialize(item, order));
+        }
+            
+        return Table(vec);
+    } 
+    else if (data[0] == '{') {
+        if (data.length() < 2 || data.back() != '}') 
+            throw std::runtime_error("Malformed table");
+            
+        if (data.length() == 2) // empty table "{}"
+            return Table(order);
+            
+        Table map(order);
+        std::string content = data.substr(1, data.length() - 2);
+        size_t pos = 0;
+        size_t next;
+        int depth = 0;
+        std::string item;
+        
+        for (size_t i = 0; i < content.length(); i++) {
+            char c = content[i];
+            if (c == '"' || c == '#') {
+                // commas and brackets inside strings and blobs don't count
+                i = std::min(detail::literal_end(content, i), content.length() - 1);
+            }
+            else if (c == '[' || c == '{') depth++;
+            else if (c == ']' || c == '}') depth--;
+            else if (c == ',' && depth == 0) {
+                item = content.substr(pos, i - pos);
+                if (!item.empty()) {
+                    // Trim whitespace
+                    item = std::string(detail::trim_value(item));
+                    if (!item.empty()) {
+                        size_t equals = detail::find_unquoted(item, '=');
+                        if (equals == std::string::npos) 
+                            throw std::runtime_error("Invalid table format: missing '='");
+                        std::string key = item.substr(0, equals);
+                        std::string value = item.substr(equals + 1);
+                        // Trim whitespace from key and value
+                        key = std::string(detail::trim_value(key));
+                        value = std::string(detail::trim_value(value));
+                        if (!key.empty() && !value.empty())
+                            map[Value::deserialize(key, order)] = Value::deserialize(value, order);
+                    }
+                }
+                pos = i + 1;
+            }
+        }
+        
+        item = content.substr(pos);
+        // only process final item if it's not empty
+        if (!item.empty()) {
+            // get rid of whitespace
+            item = std::string(detail::trim_value(item));
+            if (!item.empty()) {
+                size_t equals = detail::find_unquoted(item, '=');
+                if (equals == std::string::npos) 
+                    throw std::runtime_error("Invalid table format: missing '='");
+                std::string key = item.substr(0, equals);
+                std::string value = item.substr(equals + 1);
+
+                // get rid of whitespace
+                key = std::string(detail::trim_value(key));
+                value = std::string(detail::trim_value(value));
+                if (!key.empty() && !value.empty())
+                    map[Value::deserialize(key, order)] = Value::deserialize(value, order);
+            }
+        }
+        
+        return map;
+    }
+    throw std::runtime_error("Unknown type");
+}
+
+// Implementation of comparison operators
+inline bool operator<(const Value& lhs, const Value& rhs) {
+    if (lhs.data.index() != rhs.data.index())
+        return lhs.data.index() < rhs.data.index();
+        
+    if (lhs.is_int())
+        return lhs.as_int() < rhs.as_int();
+    if (lhs.is_float())
+        return lhs.as_float() < rhs.as_float();
+    if (lhs.is_bool())
+        return lhs.as_bool() < rhs.as_bool();
+    if (lhs.is_string())
+        return lhs.as_string() < rhs.as_string();
+    if (lhs.is_table())
+        return lhs.as_table() < rhs.as_table();
+    if (lhs.is_blob())
+        return lhs.as_blob() < rhs.as_blob();
+    if (lhs.is_rope())
+        return lhs.as_rope() < rhs.as_rope();
+        
+    return false;
+}
+
+inline bool operator==(const Value& lhs, const Value& rhs) {
+    if (lhs.data.index() != rhs.data.index())
+        return false;
+        
+    if (lhs.is_int())
+        return lhs.as_int() == rhs.as_int();
+    if (lhs.is_float())
+        return lhs.as_float() == rhs.as_float();
+    if (lhs.is_bool())
+        return lhs.as_bool() == rhs.as_bool();
+    if (lhs.is_string())
+        return lhs.as_string() == rhs.as_string();
+    if (lhs.is_table())
+        return lhs.as_table() == rhs.as_table();
+    if (lhs.is_blob())
+        return lhs.as_blob() == rhs.as_blob();
+    if (lhs.is_rope())
+        return lhs.as_rope() == rhs.as_rope();
+        
+    return true;
+}
+
+inline bool operator==(const Table& lhs, const Table& rhs) {
+    if (&lhs == &rhs) return true;
+    if (lhs.is_array != rhs.is_array || lhs.count() != rhs.count()) return false;
+    if (!lhs.ordered && !rhs.ordered) return lhs.data == rhs.data;
+    const auto a = lhs.sorted_entries(), b = rhs.sorted_entries();
+    for (size_t i = 0; i < a.size(); i++)
+        if (!(*a[i].first == *b[i].first) || !(*a[i].second == *b[i].second)) return false;
+    return true;
+}
+
+inline bool operator<(const Table& lhs, const Table& rhs) {
+    if (&lhs == &rhs) return false;
+    if (lhs.is_array != rhs.is_array) return lhs.is_array;
+    // sorted maps and arrays already are in key order, nothing to build
+    if (!lhs.ordered && !rhs.ordered) return std::lexicographical_compare(lhs.data.begin(), lhs.data.end(), rhs.data.begin(), rhs.data.end());
+    const auto a = lhs.sorted_entries(), b = rhs.sorted_entries();
+    for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+        if (*a[i].first < *b[i].first) return true;
+        if (*b[i].first < *a[i].first) return false;
+        if (*a[i].second < *b[i].second) return true;
+        if (*b[i].second < *a[i].second) return false;
+    }
+    return a.size() < b.size();
+}
+
+inline size_t detail::ValueHash::operator()(const Value& v) const {
+    size_t h = 0;
+    if (v.is_int()) {
+        h = std::hash<int>{}(v.as_int());
+    } else if (v.is_float()) {
+        const float f = v.as_float() == 0 ? 0.0f : v.as_float(); // -0 == 0
+        h = std::hash<float>{}(f);
+    } else if (v.is_bool()) {
+        h = v.as_bool();
+    } else if (v.is_string()) {
+        h = std::hash<std::string_view>{}(v.as_string_view());
+    } else if (v.is_table()) {
+        // summed, so insertion-ordered maps hash like sorted ones
+        const Table& t = v.as_table();
+        h = t.size();
+        t.each([&h, this](const Value& key, const Value& value) { h += (*this)(key) * 31 + (*this)(value); });
+    } else if (v.is_blob()) {
+        h = std::hash<std::string_view>{}(v.as_blob().view());
+    } else if (v.is_rope()) {
+        // equal ropes can be split differently, so hash what they spell
+        const auto& chunks = v.as_rope().chunks();
+        h = chunks.size() == 1 ? std::hash<std::string_view>{}(chunks[0].view()) : std::hash<std::string>{}(v.as_rope().str());
+    }
+    // the kind goes in too, then a final mix since std::hash of ints is often the int itself
+    uint64_t x = static_cast<uint64_t>(h) ^ (static_cast<uint64_t>(v.data.index()) << 56);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    return static_cast<size_t>(x);
+}
+
+// ---- canonical text and content hashes ----
+// canonical text spells each value one way: map keys in key order (insertion-ordered maps too),
+// -0 as 0, every nan the same, blobs raw and ropes as plain strings. the content hash comes out
+// of the same pass, merkle style: a table hashes its entries' hashes, so every sub-table's hash
+// is known on the way and identical sub-tables can be spotted without comparing them. it's a
+// 64 bit mixing hash, good for caches, not against someone picking collisions
+
+namespace detail {
+
+constexpr uint64_t hash_prime1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t hash_prime2 = 0xC2B2AE3D27D4EB4Full;
+
+constexpr uint64_t hash_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    return x ^ (x >> 33);
+}
+
+constexpr uint64_t hash_round(uint64_t acc, uint64_t w) {
+    acc += w * hash_prime2;
+    acc = (acc << 31) | (acc >> 33);
+    return acc * hash_prime1;
+}
+
+inline uint64_t load_u64(const char* p) {
+    uint64_t w;
+    std::memcpy(&w, p, 8);
+    return w;
+}
+
+// 32 bytes a step in four independent lanes, like xxhash
+inline uint64_t hash_bytes(const char* p, size_t n, uint64_t seed) {
+    uint64_t h = seed + n * hash_prime1;
+    size_t i = 0;
+    if (n >= 32) {
+        uint64_t lanes[4] = {seed + hash_prime1 + hash_prime2, seed + hash_prime2, seed, seed - hash_prime1};
+        for (; i + 32 <= n; i += 32)
+            for (int j = 0; j < 4; j++) lanes[j] = hash_round(lanes[j], load_u64(p + i + j * 8));
+        for (uint64_t lane : lanes) h = hash_round(h ^ hash_round(0, lane), lane);
+    }
+    for (; i + 8 <= n; i += 8) h = hash_round(h, load_u64(p + i));
+    uint64_t tail = 0;
+    std::memcpy(&tail, p + i, n - i);
+    return hash_mix(hash_round(h, tail));
+}
+
+// a seed per kind, so 1, 1.0, true and "1" all hash apart
+enum class HashKind : uint64_t { Int = 1, Float, Bool, String, Blob, Array, Map };
+
+constexpr uint64_t kind_seed(HashKind kind) { return hash_mix(static_cast<uint64_t>(kind) * hash_prime2); }
+
+// the one float a value stands for: -0 is 0 and every nan is the same nan
+inline float canonical_float(float f) {
+    if (f == 0) return 0.0f;
+    if (f != f) return std::numeric_limits<float>::quiet_NaN();
+    return f;
+}
+
+using TableHashes = std::function<void(const Table&, uint64_t)>;
+
+inline uint64_t canonical_table(const Table& t, std::string* out, const TableHashes& tables);
+
+// appends v's canonical text to out (when there is one) and returns its hash
+inline uint64_t canonical_value(const Value& v, std::string* out, const TableHashes& tables) {
+    if (v.is_int()) {
+        if (out) append_int(*out, v.as_int());
+        return hash_mix(kind_seed(HashKind::Int) ^ static_cast<uint32_t>(v.as_int()));
+    }
+    if (v.is_float()) {
+        const float f = canonical_float(v.as_float());
+        if (out) append_float(*out, f);
+        uint32_t bits;
+        std::memcpy(&bits, &f, 4);
+        return hash_mix(kind_seed(HashKind::Float) ^ bits);
+    }
+    if (v.is_bool()) {
+        if (out) append_bool(*out, v.as_bool());
+        return hash_mix(kind_seed(HashKind::Bool) ^ static_cast<uint64_t>(v.as_bool()));
+    }
+    if (v.is_string()) {
+        const std::string_view text = v.as_string_view();
+        if (out) append_string(*out, text);
+        return hash_bytes(text.data(), text.size(), kind_seed(HashKind::String));
+    }
+    if (v.is_rope()) {
+        // the same text and hash as the string it spells
+        const Rope& rope = v.as_rope();
+        if (out) {
+            *out += '"';
+            for (const Blob& chunk : rope.chunks()) append_escaped(*out, chunk.view());
+            *out += '"';
+        }
+        if (rope.chunks().size() == 1) return hash_bytes(rope.chunks()[0].data(), rope.size(), kind_seed(HashKind::String));
+        const std::string text = rope.str();
+        return hash_bytes(text.data(), text.size(), kind_seed(HashKind::String));
+    }
+    if (v.is_blob()) {
+        const Blob& blob = v.as_blob();
+        if (out) append_blob(*out, blob.view());
+        return hash_bytes(blob.data(), blob.size(), kind_seed(HashKind::Blob));
+    }
+    return canonical_table(v.as_table(), out, tables);
+}
+
+inline uint64_t canonical_table(const Table& t, std::string* out, const TableHashes& tables) {
+    const bool array = t.get_is_array();
+    if (out) *out += array ? '[' : '{';
+    uint64_t h = kind_seed(array ? HashKind::Array : HashKind::Map);
+    bool first = true;
+    for (const auto& [key, value] : t.sorted_entries()) {
+        if (out && !first) *out += ',';
+        first = false;
+        // an array's keys are its indexes, which the order already says
+        if (!array) {
+            h = hash_round(h, canonical_value(*key, out, tables));
+            if (out) *out += '=';
+        }
+        h = hash_round(h, canonical_value(*value, out, tables));
+    }
+    if (out) *out += array ? ']' : '}';
+    h = hash_mix(h ^ t.size());
+    if (tables) tables(t, h);
+    return h;
+}
+
+} // namespace detail
+
+// v in canonical text, with its content hash in *hash when asked for
+inline std::string serialize_canonical(const Value& v, uint64_t* hash = nullptr) {
+    std::string out;
+    const uint64_t h = detail::canonical_value(v, &out, nullptr);
+    if (hash) *hash = h;
+    return out;
+}
+
+inline std::string serialize_canonical(const Table& t, uint64_t* hash = nullptr) {
+    std::string out;
+    const uint64_t h = detail::canonical_table(t, &out, nullptr);
+    if (hash) *hash = h;
+    return out;
+}
+
+// the hash alone, nothing is written. equal values (by operator==) hash the same, ropes the
+// same as the strings they spell
+inline uint64_t content_hash(const Value& v) {
+    return detail::canonical_value(v, nullptr, nullptr);
+}
+
+inline uint64_t content_hash(const Table& t) {
+    return detail::canonical_table(t, nullptr, nullptr);
+}
+
+// t's hash, calling each_table with every table in it and its hash as they're finished: the
+// innermost first and t itself last. what a content-addressed cache needs to skip sub-tables
+// it already holds
+inline uint64_t content_hashes(const Table& t, const std::function<void(const Table&, uint64_t)>& each_table) {
+    return detail::canonical_table(t, nullptr, each_table);
+}
+
+// ---- deduplicating table store ----
+// hash-conses tables: interning a table that's already in the store hands back the stored
+// instance, and nested tables are interned first, so repeated structures (tile definitions,
+// item templates) live in memory once however many tables hold them. text read through the
+// store is remembered too, the same text again is a lookup instead of a parse.
+// stored tables are shared by everyone who interned them, so they must not be changed
+
+class TableStore {
+    private:
+        std::unordered_map<uint64_t, std::vector<std::shared_ptr<Table>>> tables;
+        std::unordered_map<uint64_t, std::vector<std::pair<std::string, std::weak_ptr<Table>>>> texts;
+
+        // equal, and written the same way: an insertion-ordered table doesn't stand in for a
+        // sorted one, or for one that added its keys in another order
+        static bool same(const Table& a, const Table& b) {
+            if (a.get_is_ordered() != b.get_is_ordered() || !(a == b)) return false;
+            if (!a.get_is_ordered()) return true;
+            const auto x = a.get_entries(), y = b.get_entries();
+            for (size_t i = 0; i < x.size(); i++)
+                if (!(x[i].first == y[i].first)) return false;
+            return true;
+        }
+
+        std::shared_ptr<Table> intern_hashed(const Table& t, const std::unordered_map<const Table*, uint64_t>& hashes) {
+            const uint64_t hash = hashes.at(&t);
+            for (const auto& stored : tables[hash])
+                if (same(*stored, t)) return stored;
+            auto copy = std::make_shared<Table>(t);
+            for (const auto& [key, value] : t.sorted_entries())
+                if (value->is_table()) (*copy)[*key] = Value(intern_hashed(value->as_table(), hashes));
+            tables[hash].push_back(copy);
+            return copy;
+        }
+
+    public:
+        // the stored table equal to t, stored now if there's none yet
+        std::shared_ptr<Table> intern(const Table& t) {
+            std::unordered_map<const Table*, uint64_t> hashes;
+            content_hashes(t, [&hashes](const Table& sub, uint64_t h) { hashes.emplace(&sub, h); });
+            return intern_hashed(t, hashes);
+        }
+
+        // tables interned, anything else as it is
+        Value intern(const Value& v) {
+            return v.is_table() ? Value(intern(v.as_table())) : v;
+        }
+
+        // text parsed once, the same text again gets the same table back without parsing it
+        std::shared_ptr<Table> deserialize(const std::string& text, TableOrder order = TableOrder::Sorted) {
+            const uint64_t hash = detail::hash_bytes(text.data(), text.size(), static_cast<uint64_t>(order));
+            auto& seen = texts[hash];
+            for (const auto& [known, table] : seen) {
+                if (known != text) continue;
+                if (auto stored = table.lock()) {
+                    if (stored->get_is_ordered() == (order == TableOrder::Insertion)) return stored;
+                }
+            }
+            auto stored = intern(Table::deserialize(text, order));
+            seen.emplace_back(text, stored);
+            return stored;
+        }
+
+        // distinct tables held
+        size_t size() const {
+            size_t n = 0;
+            for (const auto& bucket : tables) n += bucket.second.size();
+            return n;
+        }
+
+        // drops the tables only the store still holds, and what they alone held. returns how many
+        size_t prune() {
+            size_t dropped = 0;
+            for (bool again = true; again;) {
+                again = false;
+                for (auto it = tables.begin(); it != tables.end();) {
+                    auto& bucket = it->second;
+                    const size_t before = bucket.size();
+                    bucket.erase(std::remove_if(bucket.begin(), bucket.end(), [](const auto& t) { return t.use_count() == 1; }), bucket.end());
+                    if (bucket.size() != before) again = true;
+                    dropped += before - bucket.size();
+                    it = bucket.empty() ? tables.erase(it) : std::next(it);
+                }
+            }
+            for (auto it = texts.begin(); it != texts.end();) {
+                auto& seen = it->second;
+                seen.erase(std::remove_if(seen.begin(), seen.end(), [](const auto& entry) { return entry.second.expired(); }), seen.end());
+                it = seen.empty() ? texts.erase(it) : std::next(it);
+            }
+            return dropped;
+        }
+
+        void clear() {
+            tables.clear();
+            texts.clear();
+        }
+};
+
+inline std::string serialize_to_netvent(const Value& event_name, const std::map<std::string, Value>& data, BlobText binary = BlobText::Raw) {
+    std::stringstream ss;
+    ss << event_name.serialize() << "\n";
+
+    for (const auto& pair : data) {
+        ss << pair.first << " " << pair.second.serialize(binary) << "\n";
+    }
+
+    return ss.str();
+}
+
+// the same text into out, big rope chunks and blob bytes aren't copied on the way
+inline void serialize_to_netvent(const Value& event_name, const std::map<std::string, Value>& data, GatherOutput& out, BlobText binary = BlobText::Raw) {
+    event_name.serialize(out);
+    out.append('\n');
+    for (const auto& pair : data) {
+        out.append(pair.first);
+        out.append(' ');
+        pair.second.serialize(out, binary);
+        out.append('\n');
+    }
+}
+
+namespace detail {
+
+// one value of an event's text. a blob's bytes are copied once, or not at all when owner holds
+// the text
+inline Value value_from_text(std::string_view text, const std::shared_ptr<const std::string>& owner) {
+    size_t bytes_at = 0, length = 0;
+    if (blob_header(text, 0, bytes_at, length) && bytes_at + length == text.size()) {
+        if (owner) return Value(Blob(owner, static_cast<size_t>(text.data() - owner->data()) + bytes_at, length));
+        return Value(Blob(text.data() + bytes_at, length));
+    }
+    return Value::deserialize(std::string(text));
+}
+
+inline std::pair<Value, std::map<std::string, Value>> deserialize_event(std::string_view data, const std::shared_ptr<const std::string>& owner) {
+    std::map<std::string, Value> result;
+    Value event_name;
+    LineTokenizer lines(data);
+    std::string_view name, key, value;
+    if (lines.event(name)) event_name = Value::deserialize(std::string(name));
+    while (lines.next(key, value)) result[std::string(key)] = value_from_text(value, owner);
+    return std::make_pair(event_name, result);
+}
+
+} // namespace detail
+
+inline std::pair<Value, std::map<std::string, Value>> deserialize_from_netvent(std::string_view data) {
+    return detail::deserialize_event(data, nullptr);
+}
+
+// blobs in the event come back pointing into *data instead of holding a copy of their bytes
+inline std::pair<Value, std::map<std::string, Value>> deserialize_from_netvent(const std::shared_ptr<const std::string>& data) {
+    if (!data) throw std::runtime_error("No event text");
+    return detail::deserialize_event(*data, data);
+}
+
+inline std::pair<Value, std::map<std::string, Value>> deserialize_from_netvent(const std::string& data) {
+    return deserialize_from_netvent(std::string_view(data));
+}
+
+inline std::pair<Value, std::map<std::string, Value>> deserialize_from_netvent(const char* data) {
+    return deserialize_from_netvent(std::string_view(data));
+}
+
+inline std::string to_string(const Value& value) {
+    return value.serialize();
+}
+
+inline std::string to_string(const Table& table) {
+    return table.serialize();
+}
+
+inline Value from_string(const std::string& str) {
+    return Value::deserialize(str);
+}
+
+template<typename T>
+inline Value val(T&& v) {
+    return Value(std::forward<T>(v));
+}
+
+// Shorthand for creating tables
+inline Table arr_table(std::initializer_list<Value> init) {
+    return Table(init);
+}
+
+inline Table map_table(std::initializer_list<std::pair<const char*, Value>> init) {
+    return Table(init);
+}
+
+// ---- columnar event batches ----
+// a batch keeps every field of many events in its own flat vector, so reports can run
+// over one column at a time instead of decoding every event into a map
+
+enum class ColumnType { Int, Float, Bool, String, Mixed };
+
+// min/max of a numeric column, used to skip data that can't match a filter
+struct ColumnStats {
+    bool has_range = false;
+    double min = 0;
+    double max = 0;
+};
+
+struct Column {
+    ColumnType type = ColumnType::Int;
+    bool typed = false;                 // false until the first value shows up
+    std::vector<int> ints;
+    std::vector<float> floats;
+    std::vector<uint8_t> bools;
+    std::vector<uint32_t> codes;        // strings are dictionary encoded
+    std::vector<std::string> dict;
+    std::vector<Value> values;          // columns with more than one type keep plain values
+    std::vector<uint8_t> present;       // 1 if the row has this field
+
+    size_t size() const { return present.size(); }
+
+    ColumnStats stats() const {
+        ColumnStats s;
+        if (type != ColumnType::Int && type != ColumnType::Float) return s;
+        for (size_t i = 0; i < size(); i++) {
+            if (!present[i]) continue;
+            double v = type == ColumnType::Int ? ints[i] : floats[i];
+            // a NaN is outside every range, so the column gets none
+            if (std::isnan(v)) return ColumnStats{};
+            if (!s.has_range) { s.min = s.max = v; s.has_range = true; }
+            s.min = std::min(s.min, v);
+            s.max = std::max(s.max, v);
+        }
+        return s;
+    }
+
+    Value get(size_t row) const {
+        switch (type) {
+            case ColumnType::Int: return Value(ints[row]);
+            case ColumnType::Float: return Value(floats[row]);
+            case ColumnType::Bool: return Value(bools[row] != 0);
+            case ColumnType::String: return Value(dict[codes[row]]);
+            case ColumnType::Mixed: return values[row];
+        }
+        return Value();
+    }
+
+    void push_missing() {
+        push_placeholder();
+        present.push_back(0);
+    }
+
+    void push(const Value& v) {
+        if (!typed) {
+            // rows before the first value were placeholders for the default (int) type
+            ColumnType t = v.is_int() ? ColumnType::Int : v.is_float() ? ColumnType::Float :
+                           v.is_bool() ? ColumnType::Bool : v.is_string() ? ColumnType::String : ColumnType::Mixed;
+            size_t n = size();
+            ints.clear();
+            type = t;
+            typed = true;
+            for (size_t i = 0; i < n; i++) push_placeholder();
+        }
+        if (!matches(v)) to_mixed();
+
+        switch (type) {
+            case ColumnType::Int: ints.push_back(v.as_int()); break;
+            case ColumnType::Float: floats.push_back(v.as_float()); break;
+            case ColumnType::Bool: bools.push_back(v.as_bool() ? 1 : 0); break;
+            case ColumnType::String: {
+                const std::string s = v.as_string();
+                auto it = lookup.find(s);
+                if (it == lookup.end()) {
+                    it = lookup.emplace(s, static_cast<uint32_t>(dict.size())).first;
+                    dict.push_back(s);
+                }
+                codes.push_back(it->second);
+                break;
+            }
+            case ColumnType::Mixed: values.push_back(v); break;
+        }
+        present.push_back(1);
+    }
+
+    private:
+        std::unordered_map<std::string, uint32_t> lookup;
+
+        bool matches(const Value& v) const {
+            switch (type) {
+                case ColumnType::Int: return v.is_int();
+                case ColumnType::Float: return v.is_float();
+                case ColumnType::Bool: return v.is_bool();
+                case ColumnType::String: return v.is_string();
+                case ColumnType::Mixed: return true;
+            }
+            return false;
+        }
+
+        void push_placeholder() {
+            switch (type) {
+                case ColumnType::Int: ints.push_back(0); break;
+                case ColumnType::Float: floats.push_back(0.0f); break;
+                case ColumnType::Bool: bools.push_back(0); break;
+                case ColumnType::String: codes.push_back(0); if (dict.empty()) { dict.push_back(""); lookup[""] = 0; } break;
+                case ColumnType::Mixed: values.emplace_back(); break;
+            }
+        }
+
+        void to_mixed() {
+            std::vector<Value> converted;
+            converted.reserve(size() + 1);
+            for (size_t i = 0; i < size(); i++) {
+                converted.push_back(present[i] ? get(i) : Value());
+            }
+            ints.clear(); floats.clear(); bools.clear(); codes.clear(); dict.clear(); lookup.clear();
+            values = std::move(converted);
+            type = ColumnType::Mixed;
+        }
+};
+
+class EventBatch {
+    private:
+        Column names;
+        std::map<std::string, Column> columns;
+        size_t rows = 0;
+
+    public:
+        EventBatch() = default;
+        EventBatch(Column event_names, std::map<std::string, Column> fields, size_t row_count)
+            : names(std::move(event_names)), columns(std::move(fields)), rows(row_count) {}
+
+        void append(const Value& event_name, const std::map<std::string, Value>& data) {
+            names.push(event_name);
+
+            // both maps are sorted, so walk them side by side
+            auto col = columns.begin();
+            auto field = data.begin();
+            while (col != columns.end() || field != data.end()) {
+                if (field == data.end() || (col != columns.end() && col->first < field->first)) {
+                    (col++)->second.push_missing();
+                } else if (col == columns.end() || field->first < col->first) {
+                    Column& fresh = columns[field->first];
+                    for (size_t i = 0; i < rows; i++) fresh.push_missing();
+                    fresh.push(field->second);
+                    ++field;
+                } else {
+                    (col++)->second.push((field++)->second);
+                }
+            }
+            rows++;
+        }
+
+        void append(const std::string& netvent) {
+            auto [name, data] = deserialize_from_netvent(netvent);
+            append(name, data);
+        }
+
+        size_t size() const { return rows; }
+        const Column& event_names() const { return names; }
+        const std::map<std::string, Column>& get_columns() const { return columns; }
+
+        const Column* column(const std::string& field) const {
+            auto it = columns.find(field);
+            return it == columns.end() ? nullptr : &it->second;
+        }
+
+        // turn a row back into the usual event pair
+        std::pair<Value, std::map<std::string, Value>> row(size_t i) const {
+            if (i >= rows) throw std::runtime_error("Row out of range");
+            std::map<std::string, Value> data;
+            for (const auto& [key, col] : columns) {
+                if (col.present[i]) data[key] = col.get(i);
+            }
+            return std::make_pair(names.get(i), data);
+        }
+};
+
+// ---- vectorized filter/aggregate queries ----
+
+enum class CompareOp { Eq, Ne, Lt, Le, Gt, Ge };
+enum class AggregateOp { Count, Sum, Min, Max, Avg };
+
+// group key -> one value per aggregate, in the order they were added
+// (ungrouped queries put everything under Value())
+using QueryResult = std::map<Value, std::vector<Value>>;
+
+namespace detail {
+
+template<typename T>
+inline bool compare_scalar(T lhs, CompareOp op, T rhs) {
+    switch (op) {
+        case CompareOp::Eq: return lhs == rhs;
+        case CompareOp::Ne: return lhs != rhs;
+        case CompareOp::Lt: return lhs < rhs;
+        case CompareOp::Le: return lhs <= rhs;
+        case CompareOp::Gt: return lhs > rhs;
+        case CompareOp::Ge: return lhs >= rhs;
+    }
+    return false;
+}
+
+inline bool is_number(const Value& v) { return v.is_int() || v.is_float(); }
+inline double number_of(const Value& v) { return v.is_int() ? v.as_int() : v.as_float(); }
+
+inline bool compare_values(const Value& lhs, CompareOp op, const Value& rhs) {
+    if (is_number(lhs) && is_number(rhs)) return compare_scalar(number_of(lhs), op, number_of(rhs));
+    if (lhs.is_string() && rhs.is_string()) return compare_scalar(lhs.as_string(), op, rhs.as_string());
+    if (op == CompareOp::Eq) return lhs == rhs;
+    if (op == CompareOp::Ne) return !(lhs == rhs);
+    return false; // ordering between unrelated types means nothing
+}
+
+// ---- query kernels, one set per simd level ----
+// sel is a 0/1 byte per row
+
+inline void filter_int_scalar(const int* v, size_t n, CompareOp op, int rhs, uint8_t* sel) {
+    for (size_t i = 0; i < n; i++) sel[i] &= compare_scalar(v[i], op, rhs) ? 1 : 0;
+}
+
+inline void filter_float_scalar(const float* v, size_t n, CompareOp op, float rhs, uint8_t* sel) {
+    for (size_t i = 0; i < n; i++) sel[i] &= compare_scalar(v[i], op, rhs) ? 1 : 0;
+}
+
+inline void and_mask_scalar(uint8_t* sel, const uint8_t* other, size_t n) {
+    for (size_t i = 0; i < n; i++) sel[i] &= other[i];
+}
+
+inline size_t count_mask_scalar(const uint8_t* sel, size_t n) {
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) total += sel[i];
+    return total;
+}
+
+inline int64_t sum_int_scalar(const int* v, const uint8_t* sel, size_t n) {
+    int64_t total = 0;
+    for (size_t i = 0; i < n; i++) if (sel[i]) total += v[i];
+    return total;
+}
+
+inline double sum_float_scalar(const float* v, const uint8_t* sel, size_t n) {
+    double total = 0;
+    for (size_t i = 0; i < n; i++) if (sel[i]) total += v[i];
+    return total;
+}
+
+// min (want_max = false) or max of the selected ints, INT_MAX/INT_MIN if nothing is selected
+inline int extreme_int_scalar(const int* v, const uint8_t* sel, size_t n, bool want_max) {
+    int best = want_max ? std::numeric_limits<int>::min() : std::numeric_limits<int>::max();
+    for (size_t i = 0; i < n; i++) if (sel[i]) best = want_max ? std::max(best, v[i]) : std::min(best, v[i]);
+    return best;
+}
+
+inline float extreme_float_scalar(const float* v, const uint8_t* sel, size_t n, bool want_max) {
+    float best = want_max ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < n; i++) if (sel[i]) best = want_max ? std::max(best, v[i]) : std::min(best, v[i]);
+    return best;
+}
+
+#if defined(NETVENT_X86)
+
+// -- sse4.2 --
+
+NETVENT_TARGET("sse4.2") inline __m128i cmp_epi32(__m128i a, __m128i b, CompareOp op) {
+    const __m128i ones = _mm_set1_epi32(-1);
+    switch (op) {
+        case CompareOp::Eq: return _mm_cmpeq_epi32(a, b);
+        case CompareOp::Ne: return _mm_xor_si128(_mm_cmpeq_epi32(a, b), ones);
+        case CompareOp::Lt: return _mm_cmplt_epi32(a, b);
+        case CompareOp::Le: return _mm_xor_si128(_mm_cmpgt_epi32(a, b), ones);
+        case CompareOp::Gt: return _mm_cmpgt_epi32(a, b);
+        case CompareOp::Ge: return _mm_xor_si128(_mm_cmplt_epi32(a, b), ones);
+    }
+    return _mm_setzero_si128();
+}
+
+NETVENT_TARGET("sse4.2") inline __m128i cmp_ps(__m128 a, __m128 b, CompareOp op) {
+    switch (op) {
+        case CompareOp::Eq: return _mm_castps_si128(_mm_cmpeq_ps(a, b));
+        case CompareOp::Ne: return _mm_castps_si128(_mm_cmpneq_ps(a, b));
+        case CompareOp::Lt: return _mm_castps_si128(_mm_cmplt_ps(a, b));
+        case CompareOp::Le: return _mm_castps_si128(_mm_cmple_ps(a, b));
+        case CompareOp::Gt: return _mm_castps_si128(_mm_cmpgt_ps(a, b));
+        case CompareOp::Ge: return _mm_castps_si128(_mm_cmpge_ps(a, b));
+    }
+    return _mm_setzero_si128();
+}
+
+// four 0/1 selection bytes -> four all-ones/all-zeros 32 bit lanes
+NETVENT_TARGET("sse4.2") inline __m128i expand_sel4(const uint8_t* sel) {
+    uint32_t bits;
+    std::memcpy(&bits, sel, 4);
+    return _mm_cmpgt_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(static_cast<int>(bits))), _mm_setzero_si128());
+}
+
+// sixteen 32 bit lane masks -> sixteen 0/1 bytes and'ed into sel
+NETVENT_TARGET("sse4.2") inline void narrow_and_store(__m128i m0, __m128i m1, __m128i m2, __m128i m3, uint8_t* sel) {
+    __m128i bytes = _mm_packs_epi16(_mm_packs_epi32(m0, m1), _mm_packs_epi32(m2, m3));
+    bytes = _mm_and_si128(bytes, _mm_set1_epi8(1));
+    __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sel));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sel), _mm_and_si128(cur, bytes));
+}
+
+NETVENT_TARGET("sse4.2") inline void filter_int_sse(const int* v, size_t n, CompareOp op, int rhs, uint8_t* sel) {
+    size_t i = 0;
+    const __m128i r = _mm_set1_epi32(rhs);
+    for (; i + 16 <= n; i += 16) {
+        const __m128i* p = reinterpret_cast<const __m128i*>(v + i);
+        narrow_and_store(cmp_epi32(_mm_loadu_si128(p), r, op), cmp_epi32(_mm_loadu_si128(p + 1), r, op),
+                         cmp_epi32(_mm_loadu_si128(p + 2), r, op), cmp_epi32(_mm_loadu_si128(p + 3), r, op), sel + i);
+    }
+    filter_int_scalar(v + i, n - i, op, rhs, sel + i);
+}
+
+NETVENT_TARGET("sse4.2") inline void filter_float_sse(const float* v, size_t n, CompareOp op, float rhs, uint8_t* sel) {
+    size_t i = 0;
+    const __m128 r = _mm_set1_ps(rhs);
+    for (; i + 16 <= n; i += 16) {
+        narrow_and_store(cmp_ps(_mm_loadu_ps(v + i), r, op), cmp_ps(_mm_loadu_ps(v + i + 4), r, op),
+                         cmp_ps(_mm_loadu_ps(v + i + 8), r, op), cmp_ps(_mm_loadu_ps(v + i + 12), r, op), sel + i);
+    }
+    filter_float_scalar(v + i, n - i, op, rhs, sel + i);
+}
+
+NETVENT_TARGET("sse4.2") inline void and_mask_sse(uint8_t* sel, const uint8_t* other, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sel + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(other + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sel + i), _mm_and_si128(a, b));
+    }
+    and_mask_scalar(sel + i, other + i, n - i);
+}
+
+NETVENT_TARGET("sse4.2") inline size_t count_mask_sse(const uint8_t* sel, size_t n) {
+    size_t i = 0;
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sel + i)), _mm_setzero_si128()));
+    }
+    return static_cast<size_t>(_mm_cvtsi128_si64(acc) + _mm_extract_epi64(acc, 1)) + count_mask_scalar(sel + i, n - i);
+}
+
+NETVENT_TARGET("sse4.2") inline int64_t sum_int_sse(const int* v, const uint8_t* sel, size_t n) {
+    size_t i = 0;
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i)), expand_sel4(sel + i));
+        acc = _mm_add_epi64(acc, _mm_cvtepi32_epi64(x));
+        acc = _mm_add_epi64(acc, _mm_cvtepi32_epi64(_mm_unpackhi_epi64(x, x)));
+    }
+    return _mm_cvtsi128_si64(acc) + _mm_extract_epi64(acc, 1) + sum_int_scalar(v + i, sel + i, n - i);
+}
+
+NETVENT_TARGET("sse4.2") inline double sum_float_sse(const float* v, const uint8_t* sel, size_t n) {
+    size_t i = 0;
+    __m128d acc = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_and_ps(_mm_loadu_ps(v + i), _mm_castsi128_ps(expand_sel4(sel + i)));
+        acc = _mm_add_pd(acc, _mm_cvtps_pd(x));
+        acc = _mm_add_pd(acc, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + sum_float_scalar(v + i, sel + i, n - i);
+}
+
+NETVENT_TARGET("sse4.2") inline int extreme_int_sse(const int* v, const uint8_t* sel, size_t n, bool want_max) {
+    const int fill = want_max ? std::numeric_limits<int>::min() : std::numeric_limits<int>::max();
+    size_t i = 0;
+    const __m128i fillv = _mm_set1_epi32(fill);
+    __m128i acc = fillv;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_blendv_epi8(fillv, _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i)), expand_sel4(sel + i));
+        acc = want_max ? _mm_max_epi32(acc, x) : _mm_min_epi32(acc, x);
+    }
+    int lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    int best = extreme_int_scalar(v + i, sel + i, n - i, want_max);
+    for (int lane : lanes) best = want_max ? std::max(best, lane) : std::min(best, lane);
+    return best;
+}
+
+NETVENT_TARGET("sse4.2") inline float extreme_float_sse(const float* v, const uint8_t* sel, size_t n, bool want_max) {
+    const float fill = want_max ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity();
+    size_t i = 0;
+    const __m128 fillv = _mm_set1_ps(fill);
+    __m128 acc = fillv;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_blendv_ps(fillv, _mm_loadu_ps(v + i), _mm_castsi128_ps(expand_sel4(sel + i)));
+        acc = want_max ? _mm_max_ps(acc, x) : _mm_min_ps(acc, x);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    float best = extreme_float_scalar(v + i, sel + i, n - i, want_max);
+    for (float lane : lanes) best = want_max ? std::max(best, lane) : std::min(best, lane);
+    return best;
+}
+
+// -- avx2 --
+
+NETVENT_TARGET("avx2") inline __m256i cmp_epi32_avx2(__m256i a, __m256i b, CompareOp op) {
+    const __m256i ones = _mm256_set1_epi32(-1);
+    switch (op) {
+        case CompareOp::Eq: return _mm256_cmpeq_epi32(a, b);
+        case CompareOp::Ne: return _mm256_xor_si256(_mm256_cmpeq_epi32(a, b), ones);
+        case CompareOp::Lt: return _mm256_cmpgt_epi32(b, a);
+        case CompareOp::Le: return _mm256_xor_si256(_mm256_cmpgt_epi32(a, b), ones);
+        case CompareOp::Gt: return _mm256_cmpgt_epi32(a, b);
+        case CompareOp::Ge: return _mm256_xor_si256(_mm256_cmpgt_epi32(b, a), ones);
+    }
+    return _mm256_setzero_si256();
+}
+
+NETVENT_TARGET("avx2") inline __m256i cmp_ps_avx2(__m256 a, __m256 b, CompareOp op) {
+    switch (op) {
+        case CompareOp::Eq: return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_EQ_OQ));
+        case CompareOp::Ne: return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_NEQ_UQ));
+        case CompareOp::Lt: return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OS));
+        case CompareOp::Le: return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LE_OS));
+        case CompareOp::Gt: return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GT_OS));
+        case CompareOp::Ge: return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GE_OS));
+    }
+    return _mm256_setzero_si256();
+}
+
+NETVENT_TARGET("avx2") inline __m256i expand_sel8(const uint8_t* sel) {
+    __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(sel));
+    return _mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(bytes), _mm256_setzero_si256());
+}
+
+// thirty-two 32 bit lane masks -> 0/1 bytes and'ed into sel. the packs work within 128 bit
+// halves, the permute puts the four byte groups back in order
+NETVENT_TARGET("avx2") inline void narrow_and_store_avx2(__m256i m0, __m256i m1, __m256i m2, __m256i m3, uint8_t* sel) {
+    __m256i bytes = _mm256_packs_epi16(_mm256_packs_epi32(m0, m1), _mm256_packs_epi32(m2, m3));
+    bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    bytes = _mm256_and_si256(bytes, _mm256_set1_epi8(1));
+    __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sel));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(sel), _mm256_and_si256(cur, bytes));
+}
+
+NETVENT_TARGET("avx2") inline void filter_int_avx2(const int* v, size_t n, CompareOp op, int rhs, uint8_t* sel) {
+    size_t i = 0;
+    const __m256i r = _mm256_set1_epi32(rhs);
+    for (; i + 32 <= n; i += 32) {
+        const __m256i* p = reinterpret_cast<const __m256i*>(v + i);
+        narrow_and_store_avx2(cmp_epi32_avx2(_mm256_loadu_si256(p), r, op), cmp_epi32_avx2(_mm256_loadu_si256(p + 1), r, op),
+                              cmp_epi32_avx2(_mm256_loadu_si256(p + 2), r, op), cmp_epi32_avx2(_mm256_loadu_si256(p + 3), r, op), sel + i);
+    }
+    filter_int_scalar(v + i, n - i, op, rhs, sel + i);
+}
+
+NETVENT_TARGET("avx2") inline void filter_float_avx2(const float* v, size_t n, CompareOp op, float rhs, uint8_t* sel) {
+    size_t i = 0;
+    const __m256 r = _mm256_set1_ps(rhs);
+    for (; i + 32 <= n; i += 32) {
+        narrow_and_store_avx2(cmp_ps_avx2(_mm256_loadu_ps(v + i), r, op), cmp_ps_avx2(_mm256_loadu_ps(v + i + 8), r, op),
+                              cmp_ps_avx2(_mm256_loadu_ps(v + i + 16), r, op), cmp_ps_avx2(_mm256_loadu_ps(v + i + 24), r, op), sel + i);
+    }
+    filter_float_scalar(v + i, n - i, op, rhs, sel + i);
+}
+
+NETVENT_TARGET("avx2") inline void and_mask_avx2(uint8_t* sel, const uint8_t* other, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sel + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(other + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sel + i), _mm256_and_si256(a, b));
+    }
+    and_mask_scalar(sel + i, other + i, n - i);
+}
+
+NETVENT_TARGET("avx2") inline size_t count_mask_avx2(const uint8_t* sel, size_t n) {
+    size_t i = 0;
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 32 <= n; i += 32) {
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(sel + i)), _mm256_setzero_si256()));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    return static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + count_mask_scalar(sel + i, n - i);
+}
+
+NETVENT_TARGET("avx2") inline int64_t sum_int_avx2(const int* v, const uint8_t* sel, size_t n) {
+    size_t i = 0;
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i)), expand_sel8(sel + i));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_int_scalar(v + i, sel + i, n - i);
+}
+
+NETVENT_TARGET("avx2") inline double sum_float_avx2(const float* v, const uint8_t* sel, size_t n) {
+    size_t i = 0;
+    __m256d acc = _mm256_setzero_pd();
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_and_ps(_mm256_loadu_ps(v + i), _mm256_castsi256_ps(expand_sel8(sel + i)));
+        acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+        acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_float_scalar(v + i, sel + i, n - i);
+}
+
+NETVENT_TARGET("avx2") inline int extreme_int_avx2(const int* v, const uint8_t* sel, size_t n, bool want_max) {
+    const int fill = want_max ? std::numeric_limits<int>::min() : std::numeric_limits<int>::max();
+    size_t i = 0;
+    const __m256i fillv = _mm256_set1_epi32(fill);
+    __m256i acc = fillv;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_blendv_epi8(fillv, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i)), expand_sel8(sel + i));
+        acc = want_max ? _mm256_max_epi32(acc, x) : _mm256_min_epi32(acc, x);
+    }
+    int lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    int best = extreme_int_scalar(v + i, sel + i, n - i, want_max);
+    for (int lane : lanes) best = want_max ? std::max(best, lane) : std::min(best, lane);
+    return best;
+}
+
+NETVENT_TARGET("avx2") inline float extreme_float_avx2(const float* v, const uint8_t* sel, size_t n, bool want_max) {
+    const float fill = want_max ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity();
+    size_t i = 0;
+    const __m256 fillv = _mm256_set1_ps(fill);
+    __m256 acc = fillv;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_blendv_ps(fillv, _mm256_loadu_ps(v + i), _mm256_castsi256_ps(expand_sel8(sel + i)));
+        acc = want_max ? _mm256_max_ps(acc, x) : _mm256_min_ps(acc, x);
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, acc);
+    float best = extreme_float_scalar(v + i, sel + i, n - i, want_max);
+    for (float lane : lanes) best = want_max ? std::max(best, lane) : std::min(best, lane);
+    return best;
+}
+
+// -- avx-512 (f + bw) --
+
+NETVENT_TARGET("avx512f,avx512bw") inline __mmask16 cmp_epi32_avx512(__m512i a, __m512i b, CompareOp op) {
+    switch (op) {
+        case CompareOp::Eq: return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_EQ);
+        case CompareOp::Ne: return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_NE);
+        case CompareOp::Lt: return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_LT);
+        case CompareOp::Le: return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_LE);
+        case CompareOp::Gt: return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_NLE);
+        case CompareOp::Ge: return _mm512_cmp_epi32_mask(a, b, _MM_CMPINT_NLT);
+    }
+    return 0;
+}
+
+NETVENT_TARGET("avx512f,avx512bw") inline __mmask16 cmp_ps_avx512(__m512 a, __m512 b, CompareOp op) {
+    switch (op) {
+        case CompareOp::Eq: return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ);
+        case CompareOp::Ne: return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ);
+        case CompareOp::Lt: return _mm512_cmp_ps_mask(a, b, _CMP_LT_OS);
+        case CompareOp::Le: return _mm512_cmp_ps_mask(a, b, _CMP_LE_OS);
+        case CompareOp::Gt: return _mm512_cmp_ps_mask(a, b, _CMP_GT_OS);
+        case CompareOp::Ge: return _mm512_cmp_ps_mask(a, b, _CMP_GE_OS);
+    }
+    return 0;
+}
+
+// four 16 lane masks -> 64 0/1 bytes and'ed into sel
+NETVENT_TARGET("avx512f,avx512bw") inline void store_mask64(__mmask16 m0, __mmask16 m1, __mmask16 m2, __mmask16 m3, uint8_t* sel) {
+    __mmask64 m = static_cast<__mmask64>(m0) | (static_cast<__mmask64>(m1) << 16) |
+                  (static_cast<__mmask64>(m2) << 32) | (static_cast<__mmask64>(m3) << 48);
+    __m512i cur = _mm512_loadu_si512(sel);
+    _mm512_storeu_si512(sel, _mm512_and_si512(cur, _mm512_maskz_set1_epi8(m, 1)));
+}
+
+// sixteen selection bytes -> a lane mask
+NETVENT_TARGET("avx512f,avx512bw") inline __mmask16 sel_mask16(const uint8_t* sel) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sel));
+    return static_cast<__mmask16>(_mm_movemask_epi8(_mm_cmpgt_epi8(bytes, _mm_setzero_si128())));
+}
+
+NETVENT_TARGET("avx512f,avx512bw") inline void filter_int_avx512(const int* v, size_t n, CompareOp op, int rhs, uint8_t* sel) {
+    size_t i = 0;
+    const __m512i r = _mm512_set1_epi32(rhs);
+    for (; i + 64 <= n; i += 64) {
+        store_mask64(cmp_epi32_avx512(_mm512_loadu_si512(v + i), r, op), cmp_epi32_avx512(_mm512_loadu_si512(v + i + 16), r, op),
+                     cmp_epi32_avx512(_mm512_loadu_si512(v + i + 32), r, op), cmp_epi32_avx512(_mm512_loadu_si512(v + i + 48), r, op), sel + i);
+    }
+    filter_int_avx2(v + i, n - i, op, rhs, sel + i);
+}
+
+NETVENT_TARGET("avx512f,avx512bw") inline void filter_float_avx512(const float* v, size_t n, CompareOp op, float rhs, uint8_t* sel) {
+    size_t i = 0;
+    const __m512 r = _mm512_set1_ps(rhs);
+    for (; i + 64 <= n; i += 64) {
+        store_mask64(cmp_ps_avx512(_mm512_loadu_ps(v + i), r, op), cmp_ps_avx512(_mm512_loadu_ps(v + i + 16), r, op),
+                     cmp_ps_avx512(_mm512_loadu_ps(v + i + 32), r, op), cmp_ps_avx512(_mm512_loadu_ps(v + i + 48), r, op), sel + i);
+    }
+    filter_float_avx2(v + i, n - i, op, rhs, sel + i);
+}
+
+NETVENT_TARGET("avx512f,avx512bw") inline void and_mask_avx512(uint8_t* sel, const uint8_t* other, size_t n) {
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        _mm512_storeu_si512(sel + i, _mm512_and_si512(_mm512_loadu_si512(sel + i), _mm512_loadu_si512(other + i)));
+    }
+    and_mask_scalar(sel + i, other + i, n - i);
+}
+
+NETVENT_TARGET("avx512f,avx512bw") inline size_t count_mask_avx512(const uint8_t* sel, size_t n) {
+    size_t i = 0;
+    __m512i acc = _mm512_setzero_si512();
+    for (; i + 64 <= n; i += 64) {
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(_mm512_loadu_si512(sel + i), _mm512_setzero_si512()));
+    }
+    int64_t lanes[8];
+    _mm512_storeu_si512(lanes, acc);
+    size_t total = 0;
+    for (int64_t lane : lanes) total += static_cast<size_t>(lane);
+    return total + count_mask_scalar(sel + i, n - i);
+}
+
+// the sums widen every lane to 64 bits, which avx-512 doesn't speed up over avx2, so that set
+// reuses the avx2 sums
+
+NETVENT_TARGET("avx512f,avx512bw") inline int extreme_int_avx512(const int* v, const uint8_t* sel, size_t n, bool want_max) {
+    size_t i = 0;
+    __m512i acc = _mm512_set1_epi32(want_max ? std::numeric_limits<int>::min() : std::numeric_limits<int>::max());
+    for (; i + 16 <= n; i += 16) {
+        __mmask16 m = sel_mask16(sel + i);
+        __m512i x = _mm512_maskz_loadu_epi32(m, v + i);
+        acc = want_max ? _mm512_mask_max_epi32(acc, m, acc, x) : _mm512_mask_min_epi32(acc, m, acc, x);
+    }
+    int lanes[16];
+    _mm512_storeu_si512(lanes, acc);
+    int best = extreme_int_scalar(v + i, sel + i, n - i, want_max);
+    for (int lane : lanes) best = want_max ? std::max(best, lane) : std::min(best, lane);
+    return best;
+}
+
+NETVENT_TARGET("avx512f,avx512bw") inline float extreme_float_avx512(const float* v, const uint8_t* sel, size_t n, bool want_max) {
+    size_t i = 0;
+    __m512 acc = _mm512_set1_ps(want_max ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity());
+    for (; i + 16 <= n; i += 16) {
+        __mmask16 m = sel_mask16(sel + i);
+        __m512 x = _mm512_maskz_loadu_ps(m, v + i);
+        acc = want_max ? _mm512_mask_max_ps(acc, m, acc, x) : _mm512_mask_min_ps(acc, m, acc, x);
+    }
+    float lanes[16];
+    _mm512_storeu_ps(lanes, acc);
+    float best = extreme_float_scalar(v + i, sel + i, n - i, want_max);
+    for (float lane : lanes) best = want_max ? std::max(best, lane) : std::min(best, lane);
+    return best;
+}
+
+#endif
+
+struct QueryKernels {
+    void (*filter_int)(const int*, size_t, CompareOp, int, uint8_t*);
+    void (*filter_float)(const float*, size_t, CompareOp, float, uint8_t*);
+    void (*and_mask)(uint8_t*, const uint8_t*, size_t);
+    size_t (*count_mask)(const uint8_t*, size_t);
+    int64_t (*sum_int)(const int*, const uint8_t*, size_t);
+    double (*sum_float)(const float*, const uint8_t*, size_t);
+    int (*extreme_int)(const int*, const uint8_t*, size_t, bool);
+    float (*extreme_float)(const float*, const uint8_t*, size_t, bool);
+};
+
+inline const QueryKernels query_kernels[] = {
+    {filter_int_scalar, filter_float_scalar, and_mask_scalar, count_mask_scalar, sum_int_scalar, sum_float_scalar, extreme_int_scalar, extreme_float_scalar},
+#if defined(NETVENT_X86)
+    {filter_int_sse, filter_float_sse, and_mask_sse, count_mask_sse, sum_int_sse, sum_float_sse, extreme_int_sse, extreme_float_sse},
+    {filter_int_avx2, filter_float_avx2, and_mask_avx2, count_mask_avx2, sum_int_avx2, sum_float_avx2, extreme_int_avx2, extreme_float_avx2},
+    {filter_int_avx512, filter_float_avx512, and_mask_avx512, count_mask_avx512, sum_int_avx2, sum_float_avx2, extreme_int_avx512, extreme_float_avx512},
+#endif
+};
+
+// sel[i] &= (v[i] op rhs)
+inline void filter_int(const int* v, size_t n, CompareOp op, int rhs, uint8_t* sel) {
+    pick_kernels(query_kernels).filter_int(v, n, op, rhs, sel);
+}
+
+inline void filter_float(const float* v, size_t n, CompareOp op, float rhs, uint8_t* sel) {
+    pick_kernels(query_kernels).filter_float(v, n, op, rhs, sel);
+}
+
+inline void and_mask(uint8_t* sel, const uint8_t* other, size_t n) {
+    pick_kernels(query_kernels).and_mask(sel, other, n);
+}
+
+inline size_t count_mask(const uint8_t* sel, size_t n) {
+    return pick_kernels(query_kernels).count_mask(sel, n);
+}
+
+inline int64_t sum_int(const int* v, const uint8_t* sel, size_t n) {
+    return pick_kernels(query_kernels).sum_int(v, sel, n);
+}
+
+inline double sum_float(const float* v, const uint8_t* sel, size_t n) {
+    return pick_kernels(query_kernels).sum_float(v, sel, n);
+}
+
+inline int extreme_int(const int* v, const uint8_t* sel, size_t n, bool want_max) {
+    return pick_kernels(query_kernels).extreme_int(v, sel, n, want_max);
+}
+
+inline float extreme_float(const float* v, const uint8_t* sel, size_t n, bool want_max) {
+    return pick_kernels(query_kernels).extreme_float(v, sel, n, want_max);
+}
+
+// running state of one aggregate for one group
+struct AggregateState {
+    size_t count = 0;       // rows with the field, for Count
+    size_t numbers = 0;     // the ones holding a number, for the rest
+    int64_t int_sum = 0;
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    bool all_ints = true;
+
+    void add(double v, bool is_int) {
+        count++;
+        numbers++;
+        if (is_int) int_sum += static_cast<int64_t>(v); else { sum += v; all_ints = false; }
+        min = std::min(min, v);
+        max = std::max(max, v);
+    }
+
+    void merge(const AggregateState& other) {
+        count += other.count;
+        numbers += other.numbers;
+        int_sum += other.int_sum;
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        all_ints = all_ints && other.all_ints;
+    }
+
+    Value result(AggregateOp op) const {
+        auto number = [this](double v) {
+            if (all_ints && v >= std::numeric_limits<int>::min() && v <= std::numeric_limits<int>::max())
+                return Value(static_cast<int>(v));
+            return Value(static_cast<float>(v));
+        };
+        switch (op) {
+            case AggregateOp::Count: return Value(static_cast<int>(count));
+            case AggregateOp::Sum: return numbers ? number(static_cast<double>(int_sum) + sum) : Value();
+            case AggregateOp::Min: return numbers ? number(min) : Value();
+            case AggregateOp::Max: return numbers ? number(max) : Value();
+            case AggregateOp::Avg: return numbers ? Value(static_cast<float>((static_cast<double>(int_sum) + sum) / numbers)) : Value();
+        }
+        return Value();
+    }
+};
+
+} // namespace detail
+
+class Query {
+    private:
+        struct Predicate {
+            std::string field;
+            CompareOp op;
+            Value rhs;
+            bool on_event;
+        };
+        struct Aggregate {
+            AggregateOp op;
+            std::string field; // empty = every selected row (count only)
+        };
+
+        std::vector<Predicate> predicates;
+        std::vector<Aggregate> aggregates;
+        std::string group_field;
+        bool group_event = false;
+
+        using Partial = std::map<Value, std::vector<detail::AggregateState>>;
+
+        void apply_predicate(const Predicate& p, const EventBatch& batch, std::vector<uint8_t>& sel) const {
+            const size_t n = batch.size();
+            const Column* col = p.on_event ? &batch.event_names() : batch.column(p.field);
+            if (!col) {
+                std::fill(sel.begin(), sel.end(), 0);
+                return;
+            }
+            detail::and_mask(sel.data(), col->present.data(), n);
+
+            if (col->type == ColumnType::Int && p.rhs.is_int()) {
+                detail::filter_int(col->ints.data(), n, p.op, p.rhs.as_int(), sel.data());
+            } else if (col->type == ColumnType::Float && detail::is_number(p.rhs)) {
+                detail::filter_float(col->floats.data(), n, p.op, static_cast<float>(detail::number_of(p.rhs)), sel.data());
+            } else if (col->type == ColumnType::String && p.rhs.is_string() && (p.op == CompareOp::Eq || p.op == CompareOp::Ne)) {
+                // equality on a dictionary column is an int compare against the code
+                const std::string rhs = p.rhs.as_string();
+                auto it = std::find(col->dict.begin(), col->dict.end(), rhs);
+                if (it == col->dict.end()) {
+                    if (p.op == CompareOp::Eq) std::fill(sel.begin(), sel.end(), 0);
+                    return;
+                }
+                detail::filter_int(reinterpret_cast<const int*>(col->codes.data()), n, p.op,
+                                   static_cast<int>(it - col->dict.begin()), sel.data());
+            } else if (col->type == ColumnType::String) {
+                // evaluate once per dictionary entry, then gather
+                std::vector<uint8_t> lut(col->dict.size());
+                for (size_t d = 0; d < lut.size(); d++) lut[d] = detail::compare_values(Value(col->dict[d]), p.op, p.rhs);
+                for (size_t i = 0; i < n; i++) sel[i] &= lut[col->codes[i]];
+            } else {
+                for (size_t i = 0; i < n; i++) {
+                    if (sel[i]) sel[i] = detail::compare_values(col->get(i), p.op, p.rhs) ? 1 : 0;
+                }
+            }
+        }
+
+        // feed one selected row of a column into an aggregate
+        static void add_row(const Column& col, size_t i, detail::AggregateState& state) {
+            switch (col.type) {
+                case ColumnType::Int: state.add(col.ints[i], true); break;
+                case ColumnType::Float: state.add(col.floats[i], false); break;
+                case ColumnType::Bool: state.add(col.bools[i], true); break;
+                case ColumnType::Mixed: {
+                    const Value& v = col.values[i];
+                    if (v.is_int() || v.is_bool()) state.add(v.is_int() ? v.as_int() : v.as_bool(), true);
+                    else if (v.is_float()) state.add(v.as_float(), false);
+                    else state.count++;
+                    break;
+                }
+                case ColumnType::String: state.count++; break;
+            }
+        }
+
+        // whole-batch aggregate over a selection, using the column kernels
+        static detail::AggregateState aggregate_column(const Column& col, const std::vector<uint8_t>& sel) {
+            const size_t n = sel.size();
+            detail::AggregateState state;
+            if (col.type == ColumnType::Int) {
+                state.count = state.numbers = detail::count_mask(sel.data(), n);
+                if (!state.count) return state;
+                state.int_sum = detail::sum_int(col.ints.data(), sel.data(), n);
+                state.min = detail::extreme_int(col.ints.data(), sel.data(), n, false);
+                state.max = detail::extreme_int(col.ints.data(), sel.data(), n, true);
+            } else if (col.type == ColumnType::Float) {
+                state.count = state.numbers = detail::count_mask(sel.data(), n);
+                state.all_ints = false;
+                if (!state.count) return state;
+                state.sum = detail::sum_float(col.floats.data(), sel.data(), n);
+                state.min = detail::extreme_float(col.floats.data(), sel.data(), n, false);
+                state.max = detail::extreme_float(col.floats.data(), sel.data(), n, true);
+            } else {
+                for (size_t i = 0; i < n; i++) if (sel[i]) add_row(col, i, state);
+            }
+            return state;
+        }
+
+        Partial run_batch(const EventBatch& batch) const {
+            const size_t n = batch.size();
+            std::vector<uint8_t> sel(n, 1);
+            for (const auto& p : predicates) apply_predicate(p, batch, sel);
+
+            // per-aggregate selections (a row only counts if it has the field)
+            std::vector<const Column*> cols(aggregates.size(), nullptr);
+            std::vector<std::vector<uint8_t>> agg_sel(aggregates.size());
+            for (size_t a = 0; a < aggregates.size(); a++) {
+                agg_sel[a] = sel;
+                if (aggregates[a].field.empty()) continue;
+                cols[a] = batch.column(aggregates[a].field);
+                if (!cols[a]) std::fill(agg_sel[a].begin(), agg_sel[a].end(), 0);
+                else detail::and_mask(agg_sel[a].data(), cols[a]->present.data(), n);
+            }
+
+            Partial partial;
+            if (!group_event && group_field.empty()) {
+                auto& states = partial[Value()];
+                states.resize(aggregates.size());
+                for (size_t a = 0; a < aggregates.size(); a++) {
+                    if (cols[a]) states[a] = aggregate_column(*cols[a], agg_sel[a]);
+                    else if (aggregates[a].field.empty()) states[a].count = detail::count_mask(agg_sel[a].data(), n);
+                }
+                return partial;
+            }
+
+            const Column* key_col = group_event ? &batch.event_names() : batch.column(group_field);
+            if (!key_col) return partial;
+
+            // map rows to dense group ids, strings reuse their dictionary codes
+            std::vector<uint32_t> gid(n, 0);
+            std::vector<Value> keys;
+            if (key_col->type == ColumnType::String) {
+                for (const auto& s : key_col->dict) keys.emplace_back(s);
+                std::copy(key_col->codes.begin(), key_col->codes.end(), gid.begin());
+            } else {
+                std::map<Value, uint32_t> ids;
+                for (size_t i = 0; i < n; i++) {
+                    if (!sel[i] || !key_col->present[i]) continue;
+                    auto it = ids.emplace(key_col->get(i), static_cast<uint32_t>(keys.size())).first;
+                    if (it->second == keys.size()) keys.push_back(it->first);
+                    gid[i] = it->second;
+                }
+            }
+
+            std::vector<std::vector<detail::AggregateState>> states(keys.size(), std::vector<detail::AggregateState>(aggregates.size()));
+            std::vector<uint8_t> seen(keys.size(), 0);
+            for (size_t i = 0; i < n; i++) {
+                if (!sel[i] || !key_col->present[i]) continue;
+                auto& group = states[gid[i]];
+                seen[gid[i]] = 1;
+                for (size_t a = 0; a < aggregates.size(); a++) {
+                    if (!agg_sel[a][i]) continue;
+                    if (cols[a]) add_row(*cols[a], i, group[a]);
+                    else group[a].count++;
+                }
+            }
+            for (size_t g = 0; g < keys.size(); g++) {
+                if (seen[g]) partial.emplace(keys[g], std::move(states[g]));
+            }
+            return partial;
+        }
+
+        void merge_partial(Partial& into, Partial&& from) const {
+            for (auto& [key, states] : from) {
+                auto it = into.find(key);
+                if (it == into.end()) {
+                    into.emplace(key, std::move(states));
+                    continue;
+                }
+                for (size_t a = 0; a < states.size(); a++) it->second[a].merge(states[a]);
+            }
+        }
+
+        QueryResult finish(const Partial& partial) const {
+            QueryResult result;
+            for (const auto& [key, states] : partial) {
+                std::vector<Value> row;
+                for (size_t a = 0; a < aggregates.size(); a++) row.push_back(states[a].result(aggregates[a].op));
+                result.emplace(key, std::move(row));
+            }
+            return result;
+        }
+
+    public:
+        // fields the query touches, "" stands for the event name
+        std::vector<std::string> get_fields() const {
+            std::vector<std::string> fields;
+            auto add = [&fields](const std::string& f) {
+                if (std::find(fields.begin(), fields.end(), f) == fields.end()) fields.push_back(f);
+            };
+            for (const auto& p : predicates) add(p.on_event ? "" : p.field);
+            for (const auto& a : aggregates) if (!a.field.empty()) add(a.field);
+            if (group_event) add("");
+            else if (!group_field.empty()) add(group_field);
+            return fields;
+        }
+
+        // false when the predicates can't hold anywhere in data described by these stats
+        // (a field missing from the map means it isn't stored there at all)
+        bool may_match(const std::map<std::string, ColumnStats>& stats) const {
+            for (const auto& p : predicates) {
+                if (p.on_event) continue;
+                auto it = stats.find(p.field);
+                if (it == stats.end()) return false;
+                if (!it->second.has_range || !detail::is_number(p.rhs)) continue;
+                double r = detail::number_of(p.rhs), lo = it->second.min, hi = it->second.max;
+                if (!std::isfinite(lo) || !std::isfinite(hi)) continue;  // nothing to go on
+                switch (p.op) {
+                    case CompareOp::Eq: if (r < lo || r > hi) return false; break;
+                    case CompareOp::Ne: if (lo == hi && lo == r) return false; break;
+                    case CompareOp::Lt: if (!(lo < r)) return false; break;
+                    case CompareOp::Le: if (!(lo <= r)) return false; break;
+                    case CompareOp::Gt: if (!(hi > r)) return false; break;
+                    case CompareOp::Ge: if (!(hi >= r)) return false; break;
+                }
+            }
+            return true;
+        }
+
+        Query& where(const std::string& field, CompareOp op, const Value& rhs) {
+            predicates.push_back({field, op, rhs, false});
+            return *this;
+        }
+
+        Query& where_event(const Value& name) {
+            predicates.push_back({"", CompareOp::Eq, name, true});
+            return *this;
+        }
+
+        Query& group_by_event() {
+            group_event = true;
+            group_field.clear();
+            return *this;
+        }
+
+        Query& group_by(const std::string& field) {
+            group_event = false;
+            group_field = field;
+            return *this;
+        }
+
+        Query& aggregate(AggregateOp op, const std::string& field = "") {
+            if (field.empty() && op != AggregateOp::Count)
+                throw std::runtime_error("Only count can run without a field");
+            aggregates.push_back({op, field});
+            return *this;
+        }
+
+        QueryResult run(const EventBatch& batch) const {
+            return finish(run_batch(batch));
+        }
+
+        // batches are independent, so each worker takes the next one and partials get merged at the end
+        QueryResult run(const std::vector<EventBatch>& batches, size_t threads = 0) const {
+            if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+            threads = std::min(threads, batches.size());
+
+            std::vector<Partial> partials(batches.size());
+            std::atomic<size_t> next{0};
+            std::exception_ptr error;
+            std::mutex error_mutex;
+            auto worker = [&]() {
+                for (size_t i = next++; i < batches.size(); i = next++) {
+                    try {
+                        partials[i] = run_batch(batches[i]);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (!error) error = std::current_exception();
+                    }
+                }
+            };
+
+            if (threads <= 1) {
+                worker();
+            } else {
+                std::vector<std::thread> pool;
+                for (size_t t = 0; t < threads; t++) pool.emplace_back(worker);
+                for (auto& t : pool) t.join();
+            }
+            if (error) std::rethrow_exception(error);
+
+            Partial merged;
+            for (auto& p : partials) merge_partial(merged, std::move(p));
+            return finish(merged);
+        }
+};
+
+// ---- columnar archives ----
+// file layout: "NVAR" + version byte, then row groups, then a footer with the row group offsets
+// each row group starts with a header (row count, and per column: name, type, min/max, chunk size)
+// followed by the column chunks, so a reader can seek straight to the columns it needs
+
+namespace detail {
+
+// bumped whenever the layout changes, readers turn down versions they don't know
+constexpr char archive_version = 1;
+
+inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+inline void put_fixed(std::string& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+inline void put_double(std::string& out, double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, 8);
+    put_fixed(out, bits, 8);
+}
+
+inline void put_bytes(std::string& out, std::string_view bytes) {
+    put_varint(out, bytes.size());
+    out.append(bytes.data(), bytes.size());
+}
+
+struct ByteReader {
+    const char* p;
+    const char* end;
+
+    ByteReader(const char* data, size_t size) : p(data), end(data + size) {}
+    explicit ByteReader(std::string_view data) : p(data.data()), end(data.data() + data.size()) {}
+
+    size_t remaining() const { return static_cast<size_t>(end - p); }
+
+    uint8_t byte() {
+        if (p == end) throw std::runtime_error("Truncated data");
+        return static_cast<uint8_t>(*p++);
+    }
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = byte();
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        throw std::runtime_error("Malformed varint");
+    }
+
+    uint64_t fixed(int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++) v |= static_cast<uint64_t>(byte()) << (8 * i);
+        return v;
+    }
+
+    double f64() {
+        uint64_t bits = fixed(8);
+        double d;
+        std::memcpy(&d, &bits, 8);
+        return d;
+    }
+
+    std::string_view view(size_t n) {
+        if (n > remaining()) throw std::runtime_error("Truncated data");
+        std::string_view v(p, n);
+        p += n;
+        return v;
+    }
+
+    std::string_view bytes() { return view(static_cast<size_t>(varint())); }
+};
+
+// lsb-first bit packing
+struct BitWriter {
+    std::string& out;
+    uint64_t acc = 0;
+    int bits = 0;
+
+    explicit BitWriter(std::string& o) : out(o) {}
+
+    void put(uint64_t v, int n) {
+        if (n > 32) {
+            put(v & 0xFFFFFFFFu, 32);
+            put(v >> 32, n - 32);
+            return;
+        }
+        if (n < 64) v &= (uint64_t(1) << n) - 1;
+        acc |= v << bits;
+        bits += n;
+        while (bits >= 8) {
+            out.push_back(static_cast<char>(acc & 0xFF));
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+
+    void flush() {
+        if (bits > 0) out.push_back(static_cast<char>(acc & 0xFF));
+        acc = 0;
+        bits = 0;
+    }
+};
+
+struct BitReader {
+    ByteReader& in;
+    uint64_t acc = 0;
+    int bits = 0;
+
+    explicit BitReader(ByteReader& r) : in(r) {}
+
+    uint64_t get(int n) {
+        if (n > 32) {
+            uint64_t lo = get(32);
+            return lo | (get(n - 32) << 32);
+        }
+        while (bits < n) {
+            acc |= static_cast<uint64_t>(in.byte()) << bits;
+            bits += 8;
+        }
+        uint64_t v = n < 64 ? acc & ((uint64_t(1) << n) - 1) : acc;
+        acc >>= n;
+        bits -= n;
+        return v;
+    }
+};
+
+// bools as alternating run lengths, starting with a run of zeros
+inline void put_bool_runs(std::string& out, const std::vector<uint8_t>& flags) {
+    uint8_t current = 0;
+    size_t run = 0;
+    for (uint8_t f : flags) {
+        if ((f != 0) == (current != 0)) { run++; continue; }
+        put_varint(out, run);
+        current ^= 1;
+        run = 1;
+    }
+    put_varint(out, run);
+}
+
+inline std::vector<uint8_t> get_bool_runs(ByteReader& in, size_t n) {
+    std::vector<uint8_t> flags;
+    flags.reserve(n);
+    uint8_t current = 0;
+    while (flags.size() < n) {
+        uint64_t run = in.varint();
+        if (run > n - flags.size()) throw std::runtime_error("Malformed run length");
+        flags.insert(flags.end(), static_cast<size_t>(run), current);
+        current ^= 1;
+    }
+    return flags;
+}
+
+// floats xor'ed with the previous one, keeping only the meaningful bits (gorilla style)
+inline void put_xor_floats(std::string& out, const std::vector<float>& values) {
+    BitWriter bw(out);
+    uint32_t prev = 0;
+    int prev_lead = -1, prev_trail = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        uint32_t bits;
+        std::memcpy(&bits, &values[i], 4);
+        if (i == 0) {
+            bw.put(bits, 32);
+            prev = bits;
+            continue;
+        }
+        uint32_t x = bits ^ prev;
+        prev = bits;
+        if (x == 0) {
+            bw.put(0, 1);
+            continue;
+        }
+        bw.put(1, 1);
+        int lead = __builtin_clz(x), trail = __builtin_ctz(x);
+        if (prev_lead >= 0 && lead >= prev_lead && trail >= prev_trail) {
+            bw.put(0, 1);
+            bw.put(x >> prev_trail, 32 - prev_lead - prev_trail);
+            continue;
+        }
+        int len = 32 - lead - trail;
+        bw.put(1, 1);
+        bw.put(static_cast<uint64_t>(lead), 5);
+        bw.put(static_cast<uint64_t>(len - 1), 5);
+        bw.put(x >> trail, len);
+        prev_lead = lead;
+        prev_trail = trail;
+    }
+    bw.flush();
+}
+
+inline std::vector<float> get_xor_floats(ByteReader& in, size_t n) {
+    std::vector<float> values;
+    values.reserve(n);
+    BitReader br(in);
+    uint32_t prev = 0;
+    int prev_lead = -1, prev_trail = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t bits;
+        if (i == 0) {
+            bits = static_cast<uint32_t>(br.get(32));
+        } else if (!br.get(1)) {
+            bits = prev;
+        } else if (!br.get(1)) {
+            if (prev_lead < 0) throw std::runtime_error("Malformed float column");
+            bits = prev ^ static_cast<uint32_t>(br.get(32 - prev_lead - prev_trail) << prev_trail);
+        } else {
+            int lead = static_cast<int>(br.get(5));
+            int len = static_cast<int>(br.get(5)) + 1;
+            if (lead + len > 32) throw std::runtime_error("Malformed float column");
+            prev_lead = lead;
+            prev_trail = 32 - lead - len;
+            bits = prev ^ static_cast<uint32_t>(br.get(len) << prev_trail);
+        }
+        prev = bits;
+        float f;
+        std::memcpy(&f, &bits, 4);
+        values.push_back(f);
+    }
+    return values;
+}
+
+// presence runs, then only the present values in the column's own encoding
+inline void encode_column(std::string& out, const Column& col) {
+    put_bool_runs(out, col.present);
+    std::vector<size_t> rows;
+    for (size_t i = 0; i < col.size(); i++) if (col.present[i]) rows.push_back(i);
+
+    switch (col.type) {
+        case ColumnType::Int: {
+            int64_t prev = 0;
+            for (size_t i : rows) {
+                put_varint(out, zigzag(col.ints[i] - prev));
+                prev = col.ints[i];
+            }
+            break;
+        }
+        case ColumnType::Float: {
+            std::vector<float> values;
+            for (size_t i : rows) values.push_back(col.floats[i]);
+            put_xor_floats(out, values);
+            break;
+        }
+        case ColumnType::Bool: {
+            std::vector<uint8_t> values;
+            for (size_t i : rows) values.push_back(col.bools[i]);
+            put_bool_runs(out, values);
+            break;
+        }
+        case ColumnType::String:
+            put_varint(out, col.dict.size());
+            for (const auto& s : col.dict) put_bytes(out, s);
+            for (size_t i : rows) put_varint(out, col.codes[i]);
+            break;
+        case ColumnType::Mixed:
+            for (size_t i : rows) put_bytes(out, col.values[i].serialize());
+            break;
+    }
+}
+
+inline Column decode_column(ByteReader& in, ColumnType type, size_t rows) {
+    std::vector<uint8_t> present = get_bool_runs(in, rows);
+    size_t count = 0;
+    for (uint8_t p : present) count += p;
+
+    std::vector<Value> values;
+    values.reserve(count);
+    switch (type) {
+        case ColumnType::Int: {
+            int64_t prev = 0;
+            for (size_t i = 0; i < count; i++) {
+                prev += unzigzag(in.varint());
+                values.emplace_back(static_cast<int>(prev));
+            }
+            break;
+        }
+        case ColumnType::Float:
+            for (float f : get_xor_floats(in, count)) values.emplace_back(f);
+            break;
+        case ColumnType::Bool:
+            for (uint8_t b : get_bool_runs(in, count)) values.emplace_back(b != 0);
+            break;
+        case ColumnType::String: {
+            // every entry takes at least its length byte
+            const uint64_t entries = in.varint();
+            if (entries > in.remaining()) throw std::runtime_error("Malformed string column");
+            std::vector<std::string> dict(static_cast<size_t>(entries));
+            for (auto& s : dict) s = std::string(in.bytes());
+            for (size_t i = 0; i < count; i++) {
+                uint64_t code = in.varint();
+                if (code >= dict.size()) throw std::runtime_error("Malformed string column");
+                values.emplace_back(dict[code]);
+            }
+            break;
+        }
+        case ColumnType::Mixed:
+            for (size_t i = 0; i < count; i++) values.push_back(Value::deserialize(std::string(in.bytes())));
+            break;
+    }
+
+    Column col;
+    size_t next = 0;
+    for (uint8_t p : present) {
+        if (p) col.push(values[next++]);
+        else col.push_missing();
+    }
+    return col;
+}
+
+} // namespace detail
+
+class ArchiveWriter {
+    private:
+        std::ofstream file;
+        size_t group_size;
+        EventBatch pending;
+        std::vector<uint64_t> group_offsets;
+        uint64_t offset = 0;
+        bool closed = false;
+
+        void write_raw(const std::string& bytes) {
+            file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            if (!file) throw std::runtime_error("Failed to write archive");
+            offset += bytes.size();
+        }
+
+        void write_group(const EventBatch& batch) {
+            if (batch.size() == 0) return;
+            std::string header, chunks;
+            detail::put_varint(header, batch.size());
+            detail::put_varint(header, batch.get_columns().size() + 1);
+
+            auto add = [&](const std::string& name, const Column& col) {
+                size_t start = chunks.size();
+                detail::encode_column(chunks, col);
+                ColumnStats stats = col.stats();
+                detail::put_bytes(header, name);
+                header.push_back(static_cast<char>(col.type));
+                header.push_back(stats.has_range ? 1 : 0);
+                if (stats.has_range) {
+                    detail::put_double(header, stats.min);
+                    detail::put_double(header, stats.max);
+                }
+                detail::put_varint(header, chunks.size() - start);
+            };
+            add("", batch.event_names()); // event names go first under an empty name
+            for (const auto& [name, col] : batch.get_columns()) add(name, col);
+
+            group_offsets.push_back(offset);
+            std::string prefix;
+            detail::put_varint(prefix, header.size());
+            write_raw(prefix + header);
+            write_raw(chunks);
+        }
+
+    public:
+        explicit ArchiveWriter(const std::string& path, size_t row_group_size = 65536)
+            : file(path, std::ios::binary | std::ios::trunc), group_size(row_group_size ? row_group_size : 1) {
+            if (!file) throw std::runtime_error("Could not open archive: " + path);
+            write_raw(std::string("NVAR") + detail::archive_version);
+        }
+
+        ~ArchiveWriter() {
+            try { close(); } catch (...) {}
+        }
+
+        void append(const Value& event_name, const std::map<std::string, Value>& data) {
+            pending.append(event_name, data);
+            if (pending.size() >= group_size) flush();
+        }
+
+        // writes the batch as its own row group
+        void write_batch(const EventBatch& batch) {
+            flush();
+            write_group(batch);
+        }
+
+        void flush() {
+            write_group(pending);
+            pending = EventBatch();
+        }
+
+        void close() {
+            if (closed) return;
+            flush();
+            std::string footer;
+            uint64_t footer_offset = offset;
+            detail::put_varint(footer, group_offsets.size());
+            for (uint64_t o : group_offsets) detail::put_fixed(footer, o, 8);
+            detail::put_fixed(footer, footer_offset, 8);
+            footer += "NVAR";
+            write_raw(footer);
+            file.close();
+            closed = true;
+        }
+};
+
+class ArchiveReader {
+    private:
+        struct Chunk {
+            std::string name;
+            ColumnType type;
+            uint64_t offset;
+            uint64_t length;
+        };
+        struct Group {
+            size_t rows;
+            std::vector<Chunk> chunks;
+            std::map<std::string, ColumnStats> stats;
+        };
+
+        mutable std::ifstream file;
+        uint64_t file_size = 0;
+        std::vector<Group> groups;
+
+        // lengths come from the file, so they're checked against it before anything is allocated
+        std::string read_at(uint64_t at, uint64_t length) const {
+            if (at > file_size || length > file_size - at) throw std::runtime_error("Truncated archive");
+            std::string bytes(static_cast<size_t>(length), '\0');
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(at));
+            file.read(&bytes[0], static_cast<std::streamsize>(length));
+            if (!file) throw std::runtime_error("Truncated archive");
+            return bytes;
+        }
+
+        Column load(const Group& group, const Chunk& chunk) const {
+            std::string bytes = read_at(chunk.offset, chunk.length);
+            detail::ByteReader in(bytes);
+            return detail::decode_column(in, chunk.type, group.rows);
+        }
+
+    public:
+        explicit ArchiveReader(const std::string& path) : file(path, std::ios::binary) {
+            if (!file) throw std::runtime_error("Could not open archive: " + path);
+            file.seekg(0, std::ios::end);
+            const uint64_t size = file_size = static_cast<uint64_t>(file.tellg());
+            std::string magic = size < 17 ? std::string() : read_at(0, 5);
+            if (magic.substr(0, 4) != "NVAR") throw std::runtime_error("Not a netvent archive");
+            if (magic[4] != detail::archive_version)
+                throw std::runtime_error("Unsupported archive version: " + std::to_string(static_cast<unsigned char>(magic[4])));
+
+            std::string tail = read_at(size - 12, 12);
+            if (tail.substr(8) != "NVAR") throw std::runtime_error("Missing archive footer");
+            detail::ByteReader tail_in(tail);
+            uint64_t footer_offset = tail_in.fixed(8);
+            if (footer_offset > size - 12) throw std::runtime_error("Malformed archive footer");
+
+            std::string footer = read_at(footer_offset, size - 12 - footer_offset);
+            detail::ByteReader in(footer);
+            size_t count = static_cast<size_t>(in.varint());
+            if (count > in.remaining() / 8) throw std::runtime_error("Malformed archive footer");
+            for (size_t g = 0; g < count; g++) {
+                uint64_t at = in.fixed(8);
+                if (at < 5 || at >= footer_offset) throw std::runtime_error("Malformed archive footer");
+                // header length varint is at most 10 bytes
+                std::string head = read_at(at, std::min<uint64_t>(10, footer_offset - at));
+                detail::ByteReader len_in(head);
+                uint64_t header_len = len_in.varint();
+                uint64_t header_at = at + (head.size() - len_in.remaining());
+                if (header_len > footer_offset - header_at) throw std::runtime_error("Malformed archive: header runs past its row group");
+                std::string header = read_at(header_at, header_len);
+                detail::ByteReader h(header);
+
+                Group group;
+                group.rows = static_cast<size_t>(h.varint());
+                size_t columns = static_cast<size_t>(h.varint());
+                uint64_t chunk_at = header_at + header_len;
+                for (size_t c = 0; c < columns; c++) {
+                    Chunk chunk;
+                    chunk.name = std::string(h.bytes());
+                    uint8_t type = h.byte();
+                    if (type > static_cast<uint8_t>(ColumnType::Mixed)) throw std::runtime_error("Unknown column type");
+                    chunk.type = static_cast<ColumnType>(type);
+                    ColumnStats stats;
+                    stats.has_range = h.byte() != 0;
+                    if (stats.has_range) {
+                        stats.min = h.f64();
+                        stats.max = h.f64();
+                    }
+                    chunk.length = h.varint();
+                    if (chunk.length > footer_offset - chunk_at) throw std::runtime_error("Malformed archive: column chunk runs past its row group");
+                    chunk.offset = chunk_at;
+                    chunk_at += chunk.length;
+                    group.stats[chunk.name] = stats;
+                    group.chunks.push_back(std::move(chunk));
+                }
+                // every row has an event name, which takes at least a byte (a bit for floats)
+                // unless the names are bools
+                const Chunk* names = group.chunks.empty() ? nullptr : &group.chunks.front();
+                if (!names || !names->name.empty()) throw std::runtime_error("Malformed archive: row group without event names");
+                if (names->type != ColumnType::Bool && group.rows > names->length * 8)
+                    throw std::runtime_error("Malformed archive: more rows than its event names hold");
+                groups.push_back(std::move(group));
+            }
+        }
+
+        size_t row_group_count() const { return groups.size(); }
+        size_t rows(size_t group) const { return groups.at(group).rows; }
+
+        // stats per stored field of a row group ("" is the event name)
+        const std::map<std::string, ColumnStats>& stats(size_t group) const { return groups.at(group).stats; }
+
+        EventBatch read_row_group(size_t group) const {
+            std::vector<std::string> fields;
+            for (const auto& chunk : groups.at(group).chunks) fields.push_back(chunk.name);
+            return read_columns(group, fields);
+        }
+
+        // only reads the chunks of the given fields, the rest of the row group is never touched
+        EventBatch read_columns(size_t group, const std::vector<std::string>& fields) const {
+            const Group& g = groups.at(group);
+            Column names;
+            std::map<std::string, Column> columns;
+            bool have_names = false;
+            for (const auto& chunk : g.chunks) {
+                if (std::find(fields.begin(), fields.end(), chunk.name) == fields.end()) continue;
+                if (chunk.name.empty()) {
+                    names = load(g, chunk);
+                    have_names = true;
+                } else {
+                    columns.emplace(chunk.name, load(g, chunk));
+                }
+            }
+            if (!have_names) {
+                for (size_t i = 0; i < g.rows; i++) names.push_missing();
+            }
+            return EventBatch(std::move(names), std::move(columns), g.rows);
+        }
+
+        // skips row groups the query's filters rule out, and loads only the columns it reads
+        QueryResult scan(const Query& query, size_t threads = 0) const {
+            std::vector<std::string> fields = query.get_fields();
+            std::vector<EventBatch> batches;
+            for (size_t g = 0; g < groups.size(); g++) {
+                if (!query.may_match(groups[g].stats)) continue;
+                batches.push_back(read_columns(g, fields));
+            }
+            return query.run(batches, threads);
+        }
+};
+
+// ---- event logs and bitmap indexes ----
+// a log is a plain sequence of frames: varint length + netvent text of one event
+// the optional index sits next to it (<log>.idx) and maps names and field values to event ordinals
+
+// compressed set of uint32s, split by the high 16 bits into sorted arrays or 65536 bit bitmaps (roaring style)
+class RoaringBitmap {
+    private:
+        static constexpr size_t array_limit = 4096;
+
+        struct Container {
+            uint16_t key = 0;
+            std::vector<uint16_t> array;  // sorted, used while small
+            std::vector<uint64_t> bits;   // 1024 words once the array would grow past array_limit
+            size_t cardinality = 0;
+
+            bool is_bitmap() const { return !bits.empty(); }
+
+            bool contains(uint16_t low) const {
+                if (is_bitmap()) return (bits[low >> 6] >> (low & 63)) & 1;
+                return std::binary_search(array.begin(), array.end(), low);
+            }
+
+            void add(uint16_t low) {
+                if (is_bitmap()) {
+                    uint64_t& word = bits[low >> 6];
+                    uint64_t mask = uint64_t(1) << (low & 63);
+                    if (!(word & mask)) { word |= mask; cardinality++; }
+                    return;
+                }
+                if (array.empty() || array.back() < low) {
+                    array.push_back(low);
+                } else {
+                    auto it = std::lower_bound(array.begin(), array.end(), low);
+                    if (*it == low) return;
+                    array.insert(it, low);
+                }
+                cardinality++;
+                if (array.size() > array_limit) to_bitmap();
+            }
+
+            void to_bitmap() {
+                bits.assign(1024, 0);
+                for (uint16_t v : array) bits[v >> 6] |= uint64_t(1) << (v & 63);
+                array.clear();
+                array.shrink_to_fit();
+            }
+
+            // bitmaps that got small again go back to arrays
+            void normalize() {
+                if (!is_bitmap()) return;
+                cardinality = 0;
+                for (uint64_t w : bits) cardinality += static_cast<size_t>(__builtin_popcountll(w));
+                if (cardinality > array_limit) return;
+                array.clear();
+                for_each([this](uint16_t v) { array.push_back(v); });
+                bits.clear();
+            }
+
+            template<typename F>
+            void for_each(F&& f) const {
+                if (!is_bitmap()) {
+                    for (uint16_t v : array) f(v);
+                    return;
+                }
+                for (size_t w = 0; w < bits.size(); w++) {
+                    uint64_t word = bits[w];
+                    while (word) {
+                        f(static_cast<uint16_t>(w * 64 + static_cast<size_t>(__builtin_ctzll(word))));
+                        word &= word - 1;
+                    }
+                }
+            }
+        };
+
+        std::vector<Container> containers; // sorted by key
+
+        Container* find(uint16_t key) {
+            auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                                       [](const Container& c, uint16_t k) { return c.key < k; });
+            return it != containers.end() && it->key == key ? &*it : nullptr;
+        }
+
+        const Container* find(uint16_t key) const {
+            return const_cast<RoaringBitmap*>(this)->find(key);
+        }
+
+        static Container intersect(const Container& a, const Container& b) {
+            Container out;
+            out.key = a.key;
+            if (a.is_bitmap() && b.is_bitmap()) {
+                out.bits.resize(1024);
+                for (size_t w = 0; w < 1024; w++) out.bits[w] = a.bits[w] & b.bits[w];
+                out.normalize();
+                return out;
+            }
+            if (a.is_bitmap() || b.is_bitmap()) {
+                const Container& arr = a.is_bitmap() ? b : a;
+                const Container& bmp = a.is_bitmap() ? a : b;
+                for (uint16_t v : arr.array) if (bmp.contains(v)) out.array.push_back(v);
+            } else {
+                std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(out.array));
+            }
+            out.cardinality = out.array.size();
+            return out;
+        }
+
+        static Container unite(const Container& a, const Container& b) {
+            Container out;
+            out.key = a.key;
+            if (!a.is_bitmap() && !b.is_bitmap() && a.cardinality + b.cardinality <= array_limit) {
+                std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(out.array));
+                out.cardinality = out.array.size();
+                return out;
+            }
+            out.bits.assign(1024, 0);
+            for (const Container* c : {&a, &b}) {
+                if (c->is_bitmap()) for (size_t w = 0; w < 1024; w++) out.bits[w] |= c->bits[w];
+                else for (uint16_t v : c->array) out.bits[v >> 6] |= uint64_t(1) << (v & 63);
+            }
+            out.normalize();
+            return out;
+        }
+
+    public:
+        void add(uint32_t v) {
+            uint16_t key = static_cast<uint16_t>(v >> 16);
+            Container* c = !containers.empty() && containers.back().key == key ? &containers.back() : find(key);
+            if (!c) {
+                Container fresh;
+                fresh.key = key;
+                auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                                           [](const Container& x, uint16_t k) { return x.key < k; });
+                c = &*containers.insert(it, std::move(fresh));
+            }
+            c->add(static_cast<uint16_t>(v & 0xFFFF));
+        }
+
+        // adds every value in [lo, hi)
+        void add_range(uint32_t lo, uint32_t hi) {
+            for (uint64_t v = lo; v < hi; v++) add(static_cast<uint32_t>(v));
+        }
+
+        bool contains(uint32_t v) const {
+            const Container* c = find(static_cast<uint16_t>(v >> 16));
+            return c && c->contains(static_cast<uint16_t>(v & 0xFFFF));
+        }
+
+        size_t cardinality() const {
+            size_t total = 0;
+            for (const auto& c : containers) total += c.cardinality;
+            return total;
+        }
+
+        bool empty() const { return containers.empty(); }
+
+        RoaringBitmap operator&(const RoaringBitmap& other) const {
+            RoaringBitmap out;
+            size_t i = 0, j = 0;
+            while (i < containers.size() && j < other.containers.size()) {
+                if (containers[i].key < other.containers[j].key) i++;
+                else if (other.containers[j].key < containers[i].key) j++;
+                else {
+                    Container c = intersect(containers[i++], other.containers[j++]);
+                    if (c.cardinality) out.containers.push_back(std::move(c));
+                }
+            }
+            return out;
+        }
+
+        RoaringBitmap operator|(const RoaringBitmap& other) const {
+            RoaringBitmap out;
+            size_t i = 0, j = 0;
+            while (i < containers.size() || j < other.containers.size()) {
+                if (j == other.containers.size() || (i < containers.size() && containers[i].key < other.containers[j].key))
+                    out.containers.push_back(containers[i++]);
+                else if (i == containers.size() || other.containers[j].key < containers[i].key)
+                    out.containers.push_back(other.containers[j++]);
+                else
+                    out.containers.push_back(unite(containers[i++], other.containers[j++]));
+            }
+            return out;
+        }
+
+        template<typename F>
+        void for_each(F&& f) const {
+            for (const auto& c : containers) {
+                uint32_t high = static_cast<uint32_t>(c.key) << 16;
+                c.for_each([&](uint16_t low) { f(high | low); });
+            }
+        }
+
+        std::vector<uint32_t> to_vector() const {
+            std::vector<uint32_t> out;
+            out.reserve(cardinality());
+            for_each([&out](uint32_t v) { out.push_back(v); });
+            return out;
+        }
+
+        void serialize(std::string& out) const {
+            detail::put_varint(out, containers.size());
+            for (const auto& c : containers) {
+                detail::put_varint(out, c.key);
+                detail::put_varint(out, c.cardinality);
+                if (c.is_bitmap()) {
+                    for (uint64_t w : c.bits) detail::put_fixed(out, w, 8);
+                } else {
+                    uint16_t prev = 0;
+                    for (uint16_t v : c.array) { detail::put_varint(out, static_cast<uint16_t>(v - prev)); prev = v; }
+                }
+            }
+        }
+
+        static RoaringBitmap deserialize(detail::ByteReader& in) {
+            RoaringBitmap out;
+            size_t count = static_cast<size_t>(in.varint());
+            for (size_t i = 0; i < count; i++) {
+                Container c;
+                c.key = static_cast<uint16_t>(in.varint());
+                c.cardinality = static_cast<size_t>(in.varint());
+                if (c.cardinality > 65536) throw std::runtime_error("Malformed bitmap");
+                if (c.cardinality > array_limit) {
+                    c.bits.resize(1024);
+                    for (auto& w : c.bits) w = in.fixed(8);
+                } else {
+                    uint16_t prev = 0;
+                    for (size_t k = 0; k < c.cardinality; k++) {
+                        prev = static_cast<uint16_t>(prev + in.varint());
+                        c.array.push_back(prev);
+                    }
+                }
+                out.containers.push_back(std::move(c));
+            }
+            return out;
+        }
+};
+
+struct IndexOptions {
+    std::vector<std::string> fields;        // low-cardinality fields that get a bitmap per value
+    std::vector<std::string> range_fields;  // numeric fields that get min/max per block of events
+    size_t max_values = 4096;               // a field with more distinct values than this stops being indexed
+    uint32_t block_size = 1024;             // events per range block
+};
+
+class EventLogIndex {
+    private:
+        struct RangeField {
+            std::vector<ColumnStats> blocks;
+        };
+
+        IndexOptions options;
+        std::vector<uint64_t> offsets;
+        std::map<Value, RoaringBitmap> names;
+        std::map<std::string, std::map<Value, RoaringBitmap>> fields;
+        std::map<std::string, RangeField> ranges;
+
+    public:
+        EventLogIndex() = default;
+        explicit EventLogIndex(const IndexOptions& opts) : options(opts) {
+            for (const auto& f : options.fields) fields[f];
+            for (const auto& f : options.range_fields) ranges[f];
+            if (options.block_size == 0) options.block_size = 1;
+        }
+
+        // called by the writer for every event it frames
+        void add(uint64_t offset, const Value& event_name, const std::map<std::string, Value>& data) {
+            uint32_t ordinal = static_cast<uint32_t>(offsets.size());
+            offsets.push_back(offset);
+            names[event_name].add(ordinal);
+
+            for (auto it = fields.begin(); it != fields.end();) {
+                auto value = data.find(it->first);
+                if (value != data.end() && !value->second.is_table()) {
+                    it->second[value->second].add(ordinal);
+                    if (it->second.size() > options.max_values) {
+                        it = fields.erase(it); // too many values for bitmaps to pay off
+                        continue;
+                    }
+                }
+                ++it;
+            }
+
+            for (auto& [name, range] : ranges) {
+                auto value = data.find(name);
+                if (value == data.end() || !detail::is_number(value->second)) continue;
+                size_t block = ordinal / options.block_size;
+                if (range.blocks.size() <= block) range.blocks.resize(block + 1);
+                ColumnStats& s = range.blocks[block];
+                double v = detail::number_of(value->second);
+                if (!s.has_range) { s.min = s.max = v; s.has_range = true; }
+                s.min = std::min(s.min, v);
+                s.max = std::max(s.max, v);
+            }
+        }
+
+        size_t size() const { return offsets.size(); }
+        uint64_t offset(uint32_t ordinal) const { return offsets.at(ordinal); }
+        bool has_field(const std::string& field) const { return fields.count(field) != 0; }
+        bool has_range(const std::string& field) const { return ranges.count(field) != 0; }
+
+        RoaringBitmap all() const {
+            RoaringBitmap out;
+            out.add_range(0, static_cast<uint32_t>(offsets.size()));
+            return out;
+        }
+
+        RoaringBitmap events(const Value& event_name) const {
+            auto it = names.find(event_name);
+            return it == names.end() ? RoaringBitmap() : it->second;
+        }
+
+        RoaringBitmap equals(const std::string& field, const Value& value) const {
+            auto f = fields.find(field);
+            if (f == fields.end()) throw std::runtime_error("Field is not indexed: " + field);
+            auto it = f->second.find(value);
+            return it == f->second.end() ? RoaringBitmap() : it->second;
+        }
+
+        // events in blocks that may hold values in [lo, hi]; the events themselves still need checking
+        RoaringBitmap range(const std::string& field, double lo, double hi) const {
+            auto f = ranges.find(field);
+            if (f == ranges.end()) throw std::runtime_error("Field has no range index: " + field);
+            RoaringBitmap out;
+            const auto& blocks = f->second.blocks;
+            for (size_t b = 0; b < blocks.size(); b++) {
+                if (!blocks[b].has_range || blocks[b].max < lo || blocks[b].min > hi) continue;
+                uint32_t first = static_cast<uint32_t>(b * options.block_size);
+                uint32_t last = static_cast<uint32_t>(std::min<size_t>(offsets.size(), first + static_cast<size_t>(options.block_size)));
+                out.add_range(first, last);
+            }
+            return out;
+        }
+
+        void save(const std::string& path) const {
+            std::string out("NVIX\x01", 5);
+            detail::put_varint(out, options.block_size);
+            detail::put_varint(out, offsets.size());
+            uint64_t prev = 0;
+            for (uint64_t o : offsets) { detail::put_varint(out, o - prev); prev = o; }
+
+            auto put_values = [&out](const std::map<Value, RoaringBitmap>& values) {
+                detail::put_varint(out, values.size());
+                for (const auto& [value, bitmap] : values) {
+                    detail::put_bytes(out, value.serialize());
+                    bitmap.serialize(out);
+                }
+            };
+            put_values(names);
+            detail::put_varint(out, fields.size());
+            for (const auto& [name, values] : fields) {
+                detail::put_bytes(out, name);
+                put_values(values);
+            }
+            detail::put_varint(out, ranges.size());
+            for (const auto& [name, range] : ranges) {
+                detail::put_bytes(out, name);
+                detail::put_varint(out, range.blocks.size());
+                for (const auto& s : range.blocks) {
+                    out.push_back(s.has_range ? 1 : 0);
+                    detail::put_double(out, s.min);
+                    detail::put_double(out, s.max);
+                }
+            }
+
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(out.data(), static_cast<std::streamsize>(out.size()));
+            if (!file) throw std::runtime_error("Failed to write index: " + path);
+        }
+
+        static EventLogIndex load(const std::string& path) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) throw std::runtime_error("Could not open index: " + path);
+            std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            detail::ByteReader in(bytes);
+            if (in.view(5) != std::string_view("NVIX\x01", 5)) throw std::runtime_error("Not a netvent index");
+
+            EventLogIndex index;
+            index.options.block_size = static_cast<uint32_t>(in.varint());
+            if (index.options.block_size == 0) throw std::runtime_error("Malformed index");
+            size_t count = static_cast<size_t>(in.varint());
+            uint64_t prev = 0;
+            for (size_t i = 0; i < count; i++) {
+                prev += in.varint();
+                index.offsets.push_back(prev);
+            }
+
+            auto get_values = [&in](std::map<Value, RoaringBitmap>& values) {
+                size_t n = static_cast<size_t>(in.varint());
+                for (size_t i = 0; i < n; i++) {
+                    Value key = Value::deserialize(std::string(in.bytes()));
+                    values[key] = RoaringBitmap::deserialize(in);
+                }
+            };
+            get_values(index.names);
+            size_t field_count = static_cast<size_t>(in.varint());
+            for (size_t i = 0; i < field_count; i++) {
+                std::string name(in.bytes());
+                get_values(index.fields[name]);
+            }
+            size_t range_count = static_cast<size_t>(in.varint());
+            for (size_t i = 0; i < range_count; i++) {
+                RangeField& range = index.ranges[std::string(in.bytes())];
+                range.blocks.resize(static_cast<size_t>(in.varint()));
+                for (auto& s : range.blocks) {
+                    s.has_range = in.byte() != 0;
+                    s.min = in.f64();
+                    s.max = in.f64();
+                }
+            }
+            return index;
+        }
+};
+
+class EventLogWriter {
+    private:
+        std::ofstream file;
+        std::string path;
+        std::unique_ptr<EventLogIndex> index;
+        uint64_t offset = 0;
+        bool closed = false;
+
+        void write_raw_frame(const std::string& text) {
+            std::string frame;
+            detail::put_varint(frame, text.size());
+            frame += text;
+            file.write(frame.data(), static_cast<std::streamsize>(frame.size()));
+            if (!file) throw std::runtime_error("Failed to write log: " + path);
+            offset += frame.size();
+        }
+
+    public:
+        // plain log, no index
+        explicit EventLogWriter(const std::string& log_path)
+            : file(log_path, std::ios::binary | std::ios::trunc), path(log_path) {
+            if (!file) throw std::runtime_error("Could not open log: " + log_path);
+        }
+
+        // log plus an index written to <log_path>.idx on close
+        EventLogWriter(const std::string& log_path, const IndexOptions& options) : EventLogWriter(log_path) {
+            index = std::make_unique<EventLogIndex>(options);
+        }
+
+        ~EventLogWriter() {
+            try { close(); } catch (...) {}
+        }
+
+        void write(const Value& event_name, const std::map<std::string, Value>& data) {
+            if (index) index->add(offset, event_name, data);
+            // gathered, so big ropes and blobs go to the file without being copied first
+            GatherOutput text;
+            serialize_to_netvent(event_name, data, text);
+            std::string length;
+            detail::put_varint(length, text.size());
+            file.write(length.data(), static_cast<std::streamsize>(length.size()));
+            text.write(file);
+            if (!file) throw std::runtime_error("Failed to write log: " + path);
+            offset += length.size() + text.size();
+        }
+
+        // frames already serialized text, parsing it only when an index needs the fields
+        void write_frame(const std::string& text) {
+            if (index) {
+                auto [name, data] = deserialize_from_netvent(text);
+                index->add(offset, name, data);
+            }
+            write_raw_frame(text);
+        }
+
+        void close() {
+            if (closed) return;
+            closed = true;
+            file.close();
+            if (index) index->save(path + ".idx");
+        }
+};
+
+class EventLogReader {
+    private:
+        std::ifstream file;
+
+    public:
+        explicit EventLogReader(const std::string& path) : file(path, std::ios::binary) {
+            if (!file) throw std::runtime_error("Could not open log: " + path);
+        }
+
+        // next frame's text, false at the end of the log
+        bool next_frame(std::string& text) {
+            uint64_t length = 0;
+            int shift = 0;
+            for (;;) {
+                int c = file.get();
+                if (c == EOF) {
+                    if (shift == 0) return false;
+                    throw std::runtime_error("Truncated log frame");
+                }
+                length |= static_cast<uint64_t>(c & 0x7F) << shift;
+                if (!(c & 0x80)) break;
+                shift += 7;
+                if (shift >= 64) throw std::runtime_error("Malformed log frame");
+            }
+            text.resize(static_cast<size_t>(length));
+            if (length && !file.read(&text[0], static_cast<std::streamsize>(length)))
+                throw std::runtime_error("Truncated log frame");
+            return true;
+        }
+
+        bool next(std::pair<Value, std::map<std::string, Value>>& event) {
+            std::string text;
+            if (!next_frame(text)) return false;
+            event = deserialize_from_netvent(text);
+            return true;
+        }
+
+        std::pair<Value, std::map<std::string, Value>> read_at(uint64_t offset) {
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(offset));
+            std::pair<Value, std::map<std::string, Value>> event;
+            if (!next(event)) throw std::runtime_error("No event at offset");
+            return event;
+        }
+
+        // seeks to just the events in the bitmap, in ordinal order
+        std::vector<std::pair<Value, std::map<std::string, Value>>> read(const EventLogIndex& index, const RoaringBitmap& ordinals) {
+            std::vector<std::pair<Value, std::map<std::string, Value>>> events;
+            events.reserve(ordinals.cardinality());
+            ordinals.for_each([&](uint32_t ordinal) { events.push_back(read_at(index.offset(ordinal))); });
+            return events;
+        }
+};
+
+// ---- sorting and merging event logs ----
+// logs bigger than memory get cut into sorted runs on disk, then a k-way heap merge streams them back together
+
+struct SortOptions {
+    std::string key = "t";              // numeric field to order by, events without it sort first
+    size_t memory_limit = 64 << 20;     // bytes of frames held in memory per run
+    size_t max_fan_in = 64;             // runs merged at once, more than that takes extra passes
+    std::string temp_prefix;            // run files are <temp_prefix>.run<N>, defaults to the output path
+};
+
+namespace detail {
+
+// events without a number under key, NaN included, all sort first so the order stays strict
+inline double sort_key(const std::string& frame, const std::string& key) {
+    auto [name, data] = deserialize_from_netvent(frame);
+    auto it = data.find(key);
+    if (it == data.end() || !is_number(it->second)) return -std::numeric_limits<double>::infinity();
+    const double v = number_of(it->second);
+    return std::isnan(v) ? -std::numeric_limits<double>::infinity() : v;
+}
+
+// streams already sorted logs into one, ties go to the earlier input so the merge stays stable
+inline void merge_sorted_logs(const std::vector<std::string>& inputs, const std::string& output, const std::string& key) {
+    struct Head {
+        double key;
+        size_t source;
+        std::string frame;
+    };
+    auto later = [](const Head& a, const Head& b) {
+        return a.key != b.key ? a.key > b.key : a.source > b.source;
+    };
+
+    std::vector<std::unique_ptr<EventLogReader>> readers;
+    std::vector<Head> heap;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        readers.push_back(std::make_unique<EventLogReader>(inputs[i]));
+        Head head{0, i, {}};
+        if (readers[i]->next_frame(head.frame)) {
+            head.key = sort_key(head.frame, key);
+            heap.push_back(std::move(head));
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    EventLogWriter writer(output);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Head& head = heap.back();
+        writer.write_frame(head.frame);
+        if (readers[head.source]->next_frame(head.frame)) {
+            head.key = sort_key(head.frame, key);
+            std::push_heap(heap.begin(), heap.end(), later);
+        } else {
+            heap.pop_back();
+        }
+    }
+    writer.close();
+}
+
+} // namespace detail
+
+// k-way merge of logs that are each sorted by options.key
+inline void merge_event_logs(const std::vector<std::string>& inputs, const std::string& output, const SortOptions& options = {}) {
+    detail::merge_sorted_logs(inputs, output, options.key);
+}
+
+// sorts any number of unsorted logs into one log ordered by options.key, never holding more
+// than about options.memory_limit bytes of events at a time
+inline void sort_event_logs(const std::vector<std::string>& inputs, const std::string& output, const SortOptions& options = {}) {
+    const std::string prefix = options.temp_prefix.empty() ? output : options.temp_prefix;
+    const size_t fan_in = std::max<size_t>(2, options.max_fan_in);
+    std::vector<std::string> runs, next;   // both are cleaned up if anything throws
+    size_t run_id = 0;
+
+    struct Entry {
+        double key;
+        std::string frame;
+    };
+    std::vector<Entry> run;
+    size_t run_bytes = 0;
+
+    auto spill = [&]() {
+        if (run.empty()) return;
+        std::stable_sort(run.begin(), run.end(), [](const Entry& a, const Entry& b) { return a.key < b.key; });
+        runs.push_back(prefix + ".run" + std::to_string(run_id++));
+        EventLogWriter writer(runs.back());
+        for (const auto& e : run) writer.write_frame(e.frame);
+        writer.close();
+        run.clear();
+        run_bytes = 0;
+    };
+
+    try {
+        for (const auto& input : inputs) {
+            EventLogReader reader(input);
+            std::string frame;
+            while (reader.next_frame(frame)) {
+                run_bytes += frame.size() + sizeof(Entry);
+                double key = detail::sort_key(frame, options.key);
+                run.push_back({key, std::move(frame)});
+                if (run_bytes >= options.memory_limit) spill();
+            }
+        }
+
+        // a single run never touches the disk twice
+        if (runs.empty()) {
+            std::stable_sort(run.begin(), run.end(), [](const Entry& a, const Entry& b) { return a.key < b.key; });
+            EventLogWriter writer(output);
+            for (const auto& e : run) writer.write_frame(e.frame);
+            writer.close();
+            return;
+        }
+        spill();
+
+        while (runs.size() > fan_in) {
+            next.clear();
+            for (size_t i = 0; i < runs.size(); i += fan_in) {
+                std::vector<std::string> group(runs.begin() + i, runs.begin() + std::min(runs.size(), i + fan_in));
+                next.push_back(prefix + ".run" + std::to_string(run_id++));
+                detail::merge_sorted_logs(group, next.back(), options.key);
+                for (const auto& r : group) std::remove(r.c_str());
+            }
+            runs.swap(next);
+        }
+        detail::merge_sorted_logs(runs, output, options.key);
+    } catch (...) {
+        for (const auto& r : runs) std::remove(r.c_str());
+        for (const auto& r : next) std::remove(r.c_str());
+        throw;
+    }
+    for (const auto& r : runs) std::remove(r.c_str());
+}
+
+// ---- dispatching and windowed stream aggregation ----
+
+using EventHandler = std::function<void(const Value&, const std::map<std::string, Value>&)>;
+
+// routes decoded events to the handlers registered for their name
+class Dispatcher {
+    private:
+        std::map<Value, std::vector<EventHandler>> handlers;
+        std::vector<EventHandler> any_handlers;
+
+    public:
+        void on(const Value& event_name, EventHandler handler) {
+            handlers[event_name].push_back(std::move(handler));
+        }
+
+        // called for every event, after the name specific handlers
+        void on_any(EventHandler handler) {
+            any_handlers.push_back(std::move(handler));
+        }
+
+        void dispatch(const Value& event_name, const std::map<std::string, Value>& data) const {
+            auto it = handlers.find(event_name);
+            if (it != handlers.end()) {
+                for (const auto& h : it->second) h(event_name, data);
+            }
+            for (const auto& h : any_handlers) h(event_name, data);
+        }
+
+        void dispatch(const std::string& netvent) const {
+            auto [name, data] = deserialize_from_netvent(netvent);
+            dispatch(name, data);
+        }
+};
+
+struct WindowOptions {
+    int64_t size = 1000;                    // window length, in the units of time_field
+    int64_t slide = 0;                      // distance between window starts, 0 = tumbling (size must be a multiple of it)
+    std::string time_field = "t";           // events without it count at the latest time seen
+    std::string key_field;                  // group by this field instead of the event name
+    std::string value_field;                // field summed and used for percentiles, empty = counts only
+    std::vector<double> percentiles = {50, 90, 99};
+    Value summary_name = Value("window");   // name of the emitted summary events
+};
+
+// keeps per-pane counts, sums and samples (a pane is one slide long) as events arrive,
+// and when a window closes combines its panes into a summary event:
+// summary_name, key, start, end, count, sum, p50, p90, ...
+class WindowAggregator {
+    private:
+        struct PaneState {
+            size_t count = 0;
+            double sum = 0;
+            std::vector<double> values;
+        };
+        using Pane = std::map<Value, PaneState>;
+
+        WindowOptions options;
+        EventHandler emit;
+        std::map<int64_t, Pane> panes;      // pane index -> group -> state
+        bool started = false;
+        int64_t next_end = 0;               // end of the next window to close
+        int64_t watermark = 0;              // latest event time seen
+        size_t late = 0;
+
+        static int64_t floor_div(int64_t a, int64_t b) {
+            return a / b - ((a % b != 0) && ((a < 0) != (b < 0)) ? 1 : 0);
+        }
+
+        // whole numbers that fit come out as ints, the range is checked before the cast
+        static Value number(double v) {
+            if (v >= std::numeric_limits<int>::min() && v <= std::numeric_limits<int>::max() && v == std::floor(v))
+                return Value(static_cast<int>(v));
+            return Value(static_cast<float>(v));
+        }
+
+        static std::string percentile_name(double p) {
+            std::string s = (p == static_cast<int>(p)) ? std::to_string(static_cast<int>(p)) : Value(static_cast<float>(p)).serialize();
+            return "p" + s;
+        }
+
+        void close_window() {
+            int64_t start = next_end - options.size;
+            int64_t first = floor_div(start, options.slide), last = floor_div(next_end, options.slide);
+
+            std::map<Value, PaneState> window;
+            for (auto it = panes.lower_bound(first); it != panes.end() && it->first < last; ++it) {
+                for (const auto& [key, state] : it->second) {
+                    PaneState& w = window[key];
+                    w.count += state.count;
+                    w.sum += state.sum;
+                    w.values.insert(w.values.end(), state.values.begin(), state.values.end());
+                }
+            }
+
+            for (auto& [key, w] : window) {
+                std::map<std::string, Value> data;
+                data["key"] = key;
+                data["start"] = number(static_cast<double>(start));
+                data["end"] = number(static_cast<double>(next_end));
+                data["count"] = Value(static_cast<int>(w.count));
+                if (!options.value_field.empty()) {
+                    data["sum"] = number(w.sum);
+                    for (double p : options.percentiles) {
+                        if (w.values.empty()) break;
+                        size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * w.values.size()));
+                        rank = std::min(std::max<size_t>(rank, 1), w.values.size()) - 1;
+                        std::nth_element(w.values.begin(), w.values.begin() + static_cast<std::ptrdiff_t>(rank), w.values.end());
+                        data[percentile_name(p)] = number(w.values[rank]);
+                    }
+                }
+                if (emit) emit(options.summary_name, data);
+            }
+
+            next_end += options.slide;
+            // the pane that just slid out of every remaining window
+            panes.erase(panes.begin(), panes.lower_bound(floor_div(next_end - options.size, options.slide)));
+        }
+
+    public:
+        WindowAggregator(const WindowOptions& opts, EventHandler on_summary)
+            : options(opts), emit(std::move(on_summary)) {
+            if (options.slide == 0) options.slide = options.size;
+            if (options.size <= 0 || options.slide <= 0 || options.size % options.slide != 0)
+                throw std::runtime_error("Window size must be a positive multiple of the slide");
+        }
+
+        // feeds this aggregator with every event of that name (the aggregator must outlive the dispatcher's use)
+        void attach(Dispatcher& dispatcher, const Value& event_name) {
+            dispatcher.on(event_name, [this](const Value& name, const std::map<std::string, Value>& data) { add(name, data); });
+        }
+
+        void attach_all(Dispatcher& dispatcher) {
+            dispatcher.on_any([this](const Value& name, const std::map<std::string, Value>& data) { add(name, data); });
+        }
+
+        void add(const Value& event_name, const std::map<std::string, Value>& data) {
+            int64_t t = watermark;
+            auto time = data.find(options.time_field);
+            if (time != data.end() && detail::is_number(time->second)) {
+                t = static_cast<int64_t>(std::floor(detail::number_of(time->second)));
+            }
+
+            if (!started) {
+                started = true;
+                watermark = t;
+                next_end = (floor_div(t, options.slide) + 1) * options.slide;
+            }
+            watermark = std::max(watermark, t);
+            advance(t);
+            if (t < next_end - options.size) {
+                late++; // every window holding it already closed
+                return;
+            }
+
+            Value key = event_name;
+            if (!options.key_field.empty()) {
+                auto k = data.find(options.key_field);
+                if (k == data.end()) return;
+                key = k->second;
+            }
+
+            PaneState& state = panes[floor_div(t, options.slide)][key];
+            state.count++;
+            if (options.value_field.empty()) return;
+            auto v = data.find(options.value_field);
+            if (v != data.end() && detail::is_number(v->second)) {
+                state.sum += detail::number_of(v->second);
+                if (!options.percentiles.empty()) state.values.push_back(detail::number_of(v->second));
+            }
+        }
+
+        // closes every window that ends at or before now
+        void advance(int64_t now) {
+            if (!started) return;
+            while (next_end <= now) {
+                if (panes.empty()) {
+                    // nothing buffered, jump straight to the window holding now
+                    next_end = std::max(next_end, (floor_div(now, options.slide) + 1) * options.slide);
+                    return;
+                }
+                close_window();
+            }
+        }
+
+        // closes every window that still holds events
+        void flush() {
+            while (!panes.empty()) close_window();
+        }
+
+        size_t late_events() const { return late; }
+};
+
+// ---- schemas and generated codecs ----
+// a .nvs file declares the shape of events up front:
+//
+//   struct Vector2 {
+//       x float
+//       y float
+//   }
+//
+//   event Player "new_player" {
+//       x int
+//       velocity Vector2
+//       name string?        // ? marks optional fields
+//   }
+//
+// parse_schema reads that at runtime, and generate_cpp (used by netvent_gen.cpp) turns it into
+// plain structs whose encode/decode functions read and write the fields directly, without Value
+//
+// structs that have to change while old and new builds talk to each other give every field an id,
+// and optionally a default:
+//
+//   event Player "new_player" {
+//       x int @1
+//       hp int = 100 @2
+//   }
+
+enum class FieldType { Int, Float, Bool, String, Table, Struct, Blob };
+
+struct SchemaField {
+    std::string name;
+    FieldType type = FieldType::Int;
+    std::string struct_name;    // the nested type for FieldType::Struct
+    bool optional = false;
+    bool has_range = false;     // range(min, max) on ints and floats
+    double min = 0;
+    double max = 0;
+    double step = 0;            // step(s) quantizes a ranged float to multiples of s
+    bool has_length = false;    // length(max) or length(min, max) on strings and blobs, in bytes
+    size_t min_length = 0;
+    size_t max_length = 0;
+    uint32_t id = 0;            // @N, the field's stable number in tagged structs
+    bool has_default = false;   // = v, filled in when the field is missing
+    Value default_value;
+};
+
+struct SchemaStruct {
+    std::string name;           // c++ type name
+    std::string event;          // event name, for event declarations
+    bool is_event = false;
+    bool tagged = false;        // fields carry @N ids, so the binary form can evolve
+    std::vector<SchemaField> fields;
+
+    const SchemaField* field(const std::string& field_name) const {
+        for (const auto& f : fields) if (f.name == field_name) return &f;
+        return nullptr;
+    }
+};
+
+struct Schema {
+    std::vector<SchemaStruct> structs;
+
+    const SchemaStruct* find(const std::string& name) const {
+        for (const auto& s : structs) if (s.name == name) return &s;
+        return nullptr;
+    }
+
+    const SchemaStruct* find_event(const std::string& event_name) const {
+        for (const auto& s : structs) if (s.is_event && s.event == event_name) return &s;
+        return nullptr;
+    }
+};
+
+namespace detail {
+
+constexpr std::string_view trim_view(std::string_view v) {
+    size_t start = v.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos) return {};
+    size_t end = v.find_last_not_of(" \t\r");
+    return v.substr(start, end - start + 1);
+}
+
+constexpr std::string_view unquote(std::string_view v) {
+    if (v.size() >= 2 && v.front() == '"' && v.back() == '"') return v.substr(1, v.size() - 2);
+    return v;
+}
+
+// strict scalar parsers for the generated decoders, the whole token has to be the value
+inline int parse_int_text(std::string_view v) {
+    v = number_text(trim_view(v));
+    int out = 0;
+    if (!parse_int(v, out)) throw std::runtime_error("Expected int, got: " + std::string(v));
+    return out;
+}
+
+inline float parse_float_text(std::string_view v) {
+    v = number_text(trim_view(v));
+    float out = 0;
+    if (!parse_float(v, out)) throw std::runtime_error("Expected float, got: " + std::string(v));
+    return out;
+}
+
+inline bool parse_bool_text(std::string_view v) {
+    v = trim_view(v);
+    if (v == "true") return true;
+    if (v == "false") return false;
+    throw std::runtime_error("Expected bool, got: " + std::string(v));
+}
+
+inline std::string parse_string_text(std::string_view v) {
+    v = trim_view(v);
+    if (!is_quoted(v)) return std::string(v);
+    return unescape(v.substr(1, v.size() - 2));
+}
+
+inline Blob parse_blob_text(std::string_view v) {
+    v = trim_value(v);
+    size_t bytes_at = 0, length = 0;
+    if (!blob_header(v, 0, bytes_at, length) || bytes_at + length != v.size()) {
+        std::string bytes;
+        if (decode_encoded_blob(v, bytes)) return Blob(std::move(bytes));
+        throw std::runtime_error("Expected blob, got: " + std::string(v.substr(0, 32)));
+    }
+    return Blob(v.data() + bytes_at, length);
+}
+
+inline void put_float(std::string& out, float v) {
+    uint32_t bits;
+    std::memcpy(&bits, &v, 4);
+    put_fixed(out, bits, 4);
+}
+
+inline float get_float(ByteReader& in) {
+    uint32_t bits = static_cast<uint32_t>(in.fixed(4));
+    float v;
+    std::memcpy(&v, &bits, 4);
+    return v;
+}
+
+// walks the lines of netvent event text the same way deserialize_from_netvent does, handing
+// out views instead of copies. at runtime this is the LineTokenizer, the byte loop is here so
+// the _nv literals can run it at compile time
+class LineReader {
+    private:
+        std::string_view text;
+        size_t pos = 0;
+        LineTokenizer fast;
+
+        // a key followed by a value with blobs in it on the line starting at pos. the line then
+        // runs from the key to where the value stops, which may be past the newline at end
+        constexpr bool blob_line(size_t end, std::string_view& line) {
+            size_t key = text.find_first_not_of(" \t\r", pos);
+            if (key >= end || text[key] == '#') return false;
+            size_t gap = text.find_first_of(" \t\r", key);
+            if (gap >= end || text.substr(key, gap - key).find("//") != std::string_view::npos) return false;
+            size_t value = text.find_first_not_of(" \t\r", gap);
+            if (value >= end || text.substr(value, end - value).find('#') == std::string_view::npos) return false;
+            const size_t stop = value_end(text, key);
+            line = text.substr(key, trim_value(text.substr(key, stop - key)).size());
+            pos = std::min(text.find('\n', stop), text.size()) + 1;
+            return true;
+        }
+
+        constexpr bool next_line(std::string_view& line) {
+            while (pos < text.size()) {
+                size_t end = text.find('\n', pos);
+                if (end == std::string_view::npos) end = text.size();
+                if (blob_line(end, line)) return true;
+                line = text.substr(pos, end - pos);
+                pos = end + 1;
+
+                size_t comment = comment_start(line);
+                if (comment != std::string_view::npos) line = line.substr(0, comment);
+                line = trim_view(line);
+                if (line.empty() || line[0] == '#') continue;
+                return true;
+            }
+            return false;
+        }
+
+    public:
+        constexpr explicit LineReader(std::string_view t) : text(t), fast(t) {}
+
+        // the event name line, call once before next()
+        constexpr bool event(std::string_view& name) {
+            if (!__builtin_is_constant_evaluated()) return fast.event(name);
+            return next_line(name);
+        }
+
+        constexpr bool next(std::string_view& key, std::string_view& value) {
+            if (!__builtin_is_constant_evaluated()) return fast.next(key, value);
+            std::string_view line;
+            while (next_line(line)) {
+                size_t space = line.find_first_of(" \t\r");
+                if (space == std::string_view::npos) continue;
+                key = line.substr(0, space);
+                value = trim_value(line.substr(space));
+                if (!value.empty()) return true;
+            }
+            return false;
+        }
+};
+
+// calls f(key, value) for every entry of "{k=v,...}" text, nested tables come through as one value
+template<typename F>
+inline void for_each_table_entry(std::string_view text, F&& f) {
+    text = trim_view(text);
+    if (text.size() < 2 || text.front() != '{' || text.back() != '}')
+        throw std::runtime_error("Malformed table");
+    std::string_view content = text.substr(1, text.size() - 2);
+
+    auto emit = [&f](std::string_view item) {
+        item = trim_value(item);
+        if (item.empty()) return; // trailing comma
+        size_t equals = find_unquoted(item, '=');
+        if (equals == std::string_view::npos) throw std::runtime_error("Invalid table format: missing '='");
+        f(trim_value(item.substr(0, equals)), trim_value(item.substr(equals + 1)));
+    };
+
+    int depth = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < content.size(); i++) {
+        char c = content[i];
+        if (c == '"' || c == '#') i = std::min(literal_end(content, i), content.size() - 1);
+        else if (c == '[' || c == '{') depth++;
+        else if (c == ']' || c == '}') depth--;
+        else if (c == ',' && depth == 0) {
+            emit(content.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    emit(content.substr(start));
+}
+
+inline bool is_identifier(const std::string& s) {
+    static const char* keywords[] = {
+        "alignas", "auto", "bool", "break", "case", "catch", "char", "class", "const", "continue",
+        "default", "delete", "do", "double", "else", "enum", "explicit", "extern", "false", "float",
+        "for", "friend", "goto", "if", "inline", "int", "long", "namespace", "new", "operator",
+        "private", "protected", "public", "return", "short", "signed", "sizeof", "static", "struct",
+        "switch", "template", "this", "throw", "true", "try", "typedef", "typename", "union",
+        "unsigned", "using", "virtual", "void", "volatile", "while", "event_name"
+    };
+    if (s.empty() || !(std::isalpha(static_cast<unsigned char>(s[0])) || s[0] == '_')) return false;
+    for (char c : s) if (!(std::isalnum(static_cast<unsigned char>(c)) || c == '_')) return false;
+    for (const char* k : keywords) if (s == k) return false;
+    return true;
+}
+
+struct SchemaToken {
+    std::string text;
+    size_t line;
+};
+
+inline std::vector<SchemaToken> tokenize_schema(const std::string& text) {
+    std::vector<SchemaToken> tokens;
+    size_t line = 1;
+    for (size_t i = 0; i < text.size();) {
+        char c = text[i];
+        if (c == '\n') { line++; i++; continue; }
+        if (std::isspace(static_cast<unsigned char>(c))) { i++; continue; }
+        if (c == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+            while (i < text.size() && text[i] != '\n') i++;
+            continue;
+        }
+        if (c == '{' || c == '}') {
+            tokens.push_back({std::string(1, c), line});
+            i++;
+            continue;
+        }
+        size_t start = i;
+        if (c == '"') {
+            i = text.find('"', i + 1);
+            if (i == std::string::npos) throw std::runtime_error("Schema line " + std::to_string(line) + ": unterminated string");
+            i++;
+        } else {
+            // "range(0, 10)" stays one token
+            int parens = 0;
+            while (i < text.size() && text[i] != '\n' && (parens > 0 || (!std::isspace(static_cast<unsigned char>(text[i])) &&
+                   text[i] != '{' && text[i] != '}' && !(text[i] == '/' && i + 1 < text.size() && text[i + 1] == '/')))) {
+                if (text[i] == '(') parens++;
+                else if (text[i] == ')') parens--;
+                i++;
+            }
+        }
+        tokens.push_back({text.substr(start, i - start), line});
+    }
+    return tokens;
+}
+
+// a number, or a fraction like 1/16
+inline double parse_schema_number(std::string_view v) {
+    v = trim_view(v);
+    size_t slash = v.find('/');
+    if (slash != std::string_view::npos) {
+        double den = parse_schema_number(v.substr(slash + 1));
+        if (den == 0) throw std::runtime_error("division by zero");
+        return parse_schema_number(v.substr(0, slash)) / den;
+    }
+    if (!v.empty() && v[0] == '+') v.remove_prefix(1);
+    double out = 0;
+    auto res = std::from_chars(v.data(), v.data() + v.size(), out);
+    if (v.empty() || res.ec != std::errc() || res.ptr != v.data() + v.size())
+        throw std::runtime_error("bad number '" + std::string(v) + "'");
+    return out;
+}
+
+// name(arg, arg...) -> name and args
+inline std::string split_schema_attribute(const std::string& token, std::vector<std::string>& args) {
+    size_t open = token.find('(');
+    if (open == std::string::npos || token.back() != ')') return token;
+    std::string inner = token.substr(open + 1, token.size() - open - 2);
+    size_t start = 0;
+    for (size_t comma = inner.find(','); ; comma = inner.find(',', start)) {
+        args.push_back(std::string(trim_view(std::string_view(inner).substr(start, comma == std::string::npos ? std::string::npos : comma - start))));
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return token.substr(0, open);
+}
+
+inline Value parse_schema_default(const SchemaField& field, const std::string& text) {
+    switch (field.type) {
+        case FieldType::Int: return Value(parse_int_text(text));
+        case FieldType::Float: return Value(static_cast<float>(parse_schema_number(text)));
+        case FieldType::Bool: return Value(parse_bool_text(text));
+        case FieldType::String:
+            if (text.size() < 2 || text.front() != '"' || text.back() != '"' || text.find_first_of("\\\n", 1) != std::string::npos)
+                throw std::runtime_error("string defaults are quoted and can't hold backslashes or newlines");
+            return Value(text.substr(1, text.size() - 2));
+        default: throw std::runtime_error("defaults only apply to int, float, bool and string");
+    }
+}
+
+// <name> <type>[?] [@id] [= default] [range(min, max)] [step(s)] [length(max)] on one line
+inline SchemaField parse_schema_field(const std::vector<SchemaToken>& tokens, const Schema& schema) {
+    auto fail = [&](const std::string& msg) -> void {
+        throw std::runtime_error("Schema line " + std::to_string(tokens[0].line) + ": " + msg);
+    };
+    if (tokens.size() < 2) fail("expected '<name> <type>'");
+
+    SchemaField field;
+    field.name = tokens[0].text;
+    if (!is_identifier(field.name)) fail("bad field name '" + field.name + "'");
+
+    std::string type = tokens[1].text;
+    if (!type.empty() && type.back() == '?') {
+        field.optional = true;
+        type.pop_back();
+    }
+    if (type == "int") field.type = FieldType::Int;
+    else if (type == "float") field.type = FieldType::Float;
+    else if (type == "bool") field.type = FieldType::Bool;
+    else if (type == "string") field.type = FieldType::String;
+    else if (type == "table") field.type = FieldType::Table;
+    else if (type == "blob") field.type = FieldType::Blob;
+    else if (schema.find(type)) {
+        field.type = FieldType::Struct;
+        field.struct_name = type;
+    } else fail("unknown type '" + type + "' (structs have to be declared before use)");
+
+    for (size_t t = 2; t < tokens.size(); t++) {
+        std::vector<std::string> args;
+        std::string attr = split_schema_attribute(tokens[t].text, args);
+        try {
+            if (attr[0] == '@') {
+                if (field.id) fail("the id is given twice");
+                int id = parse_int_text(std::string_view(attr).substr(1));
+                if (id <= 0) fail("field ids start at 1");
+                field.id = static_cast<uint32_t>(id);
+            } else if (attr[0] == '=') {
+                // "= 5" or "=5"
+                std::string text = attr.size() > 1 ? attr.substr(1) : (t + 1 < tokens.size() ? tokens[++t].text : "");
+                if (text.empty()) fail("expected a value after '='");
+                if (field.optional) fail("optional fields can't have a default");
+                field.default_value = parse_schema_default(field, text);
+                field.has_default = true;
+            } else if (attr == "range" && args.size() == 2) {
+                if (field.type != FieldType::Int && field.type != FieldType::Float) fail("range only applies to int and float");
+                field.has_range = true;
+                field.min = parse_schema_number(args[0]);
+                field.max = parse_schema_number(args[1]);
+            } else if (attr == "step" && args.size() == 1) {
+                field.step = parse_schema_number(args[0]);
+            } else if (attr == "length" && (args.size() == 1 || args.size() == 2)) {
+                if (field.type != FieldType::String && field.type != FieldType::Blob) fail("length only applies to strings and blobs");
+                int lo = args.size() == 2 ? parse_int_text(args[0]) : 0;
+                int hi = parse_int_text(args.back());
+                if (lo < 0 || lo > hi) fail("bad length bounds");
+                field.has_length = true;
+                field.min_length = static_cast<size_t>(lo);
+                field.max_length = static_cast<size_t>(hi);
+            } else {
+                fail("unexpected '" + tokens[t].text + "'");
+            }
+        } catch (const std::runtime_error& e) {
+            if (std::string(e.what()).rfind("Schema line", 0) == 0) throw;
+            fail(e.what());
+        }
+    }
+
+    if (field.has_range) {
+        if (!(field.min <= field.max)) fail("range minimum is above the maximum");
+        if (field.type == FieldType::Int && (field.min != std::floor(field.min) || field.max != std::floor(field.max) ||
+            field.min < std::numeric_limits<int>::min() || field.max > std::numeric_limits<int>::max()))
+            fail("int ranges need int bounds");
+        if (field.step > 0 && (field.max - field.min) / field.step > 4294967295.0) fail("step is too fine for the range");
+    }
+    if (field.step < 0) fail("step has to be positive");
+    if (field.step != 0 && (field.type != FieldType::Float || !field.has_range)) fail("step only applies to float fields with a range");
+    if (field.has_default && field.has_range && field.type == FieldType::Int &&
+        (field.default_value.as_int() < field.min || field.default_value.as_int() > field.max))
+        fail("the default is outside the range");
+    return field;
+}
+
+} // namespace detail
+
+inline Schema parse_schema(const std::string& text) {
+    std::vector<detail::SchemaToken> tokens = detail::tokenize_schema(text);
+    Schema schema;
+    size_t i = 0;
+    auto fail = [&](const std::string& msg) -> void {
+        size_t line = i < tokens.size() ? tokens[i].line : (tokens.empty() ? 1 : tokens.back().line);
+        throw std::runtime_error("Schema line " + std::to_string(line) + ": " + msg);
+    };
+    auto take = [&]() -> const std::string& {
+        if (i >= tokens.size()) fail("unexpected end of schema");
+        return tokens[i++].text;
+    };
+
+    while (i < tokens.size()) {
+        SchemaStruct s;
+        const std::string kind = take();
+        if (kind != "struct" && kind != "event") fail("expected 'struct' or 'event', got '" + kind + "'");
+        s.is_event = kind == "event";
+        s.name = take();
+        if (!detail::is_identifier(s.name)) fail("bad type name '" + s.name + "'");
+        if (schema.find(s.name)) fail("'" + s.name + "' is declared twice");
+        if (s.is_event) {
+            const std::string name = take();
+            if (name.size() < 2 || name.front() != '"') fail("expected the quoted event name");
+            s.event = name.substr(1, name.size() - 2);
+            if (s.event.find_first_of("\"\\\n") != std::string::npos) fail("event names can't hold quotes, backslashes or newlines");
+        }
+        if (take() != "{") fail("expected '{'");
+
+        while (i < tokens.size() && tokens[i].text != "}") {
+            std::vector<detail::SchemaToken> line;
+            size_t line_no = tokens[i].line;
+            while (i < tokens.size() && tokens[i].line == line_no && tokens[i].text != "}") line.push_back(tokens[i++]);
+            SchemaField field = detail::parse_schema_field(line, schema);
+            if (s.field(field.name)) fail("field '" + field.name + "' is declared twice");
+            s.fields.push_back(std::move(field));
+        }
+        if (i >= tokens.size()) fail("missing '}'");
+        i++;
+        if (s.fields.size() > 64) fail("more than 64 fields in '" + s.name + "'");
+
+        // ids are all or nothing, and never shared
+        for (const auto& f : s.fields) s.tagged = s.tagged || f.id;
+        for (size_t a = 0; a < s.fields.size() && s.tagged; a++) {
+            if (!s.fields[a].id) fail("field '" + s.fields[a].name + "' in '" + s.name + "' needs an @id like the others");
+            for (size_t b = 0; b < a; b++)
+                if (s.fields[a].id == s.fields[b].id) fail("fields '" + s.fields[b].name + "' and '" + s.fields[a].name + "' share @" + std::to_string(s.fields[a].id));
+        }
+        schema.structs.push_back(std::move(s));
+    }
+    return schema;
+}
+
+// ---- schema binary encoding ----
+// fields go out in declaration order with no names or tags, packed at the bit level:
+// bools take one bit, ranged ints the bits their range needs, floats with a step are quantized to
+// their step, optional fields get one presence bit, and nested structs are inlined
+
+namespace detail {
+
+inline int bits_for(uint64_t span) {
+    return span == 0 ? 0 : 64 - __builtin_clzll(span);
+}
+
+// 6 bit length, then the significant bits (a length of 63 is followed by the top bit)
+inline void put_bit_varint(BitWriter& bits, uint64_t v) {
+    int n = std::min(bits_for(v), 63);
+    bits.put(static_cast<uint64_t>(n), 6);
+    bits.put(v, n);
+    if (n == 63) bits.put(v >> 63, 1);
+}
+
+inline uint64_t get_bit_varint(BitReader& bits) {
+    int n = static_cast<int>(bits.get(6));
+    uint64_t v = bits.get(n);
+    if (n == 63) v |= bits.get(1) << 63;
+    return v;
+}
+
+inline void put_ranged(BitWriter& bits, int v, int64_t min, int64_t max) {
+    if (v < min || v > max) throw std::runtime_error("Value " + std::to_string(v) + " outside its schema range");
+    bits.put(static_cast<uint64_t>(v - min), bits_for(static_cast<uint64_t>(max - min)));
+}
+
+inline int get_ranged(BitReader& bits, int64_t min, int64_t max) {
+    uint64_t raw = bits.get(bits_for(static_cast<uint64_t>(max - min)));
+    if (raw > static_cast<uint64_t>(max - min)) throw std::runtime_error("Ranged int out of range");
+    return static_cast<int>(min + static_cast<int64_t>(raw));
+}
+
+// clamps into [min, max] and rounds to the nearest step
+inline uint64_t quantize(float v, double min, double max, double step) {
+    uint64_t steps = static_cast<uint64_t>(std::llround((max - min) / step));
+    double clamped = std::isnan(v) ? min : std::min(std::max(static_cast<double>(v), min), max);
+    return std::min(static_cast<uint64_t>(std::llround((clamped - min) / step)), steps);
+}
+
+inline float dequantize(uint64_t q, double min, double max, double step) {
+    if (q > static_cast<uint64_t>(std::llround((max - min) / step))) throw std::runtime_error("Quantized float out of range");
+    return static_cast<float>(std::min(min + static_cast<double>(q) * step, max));
+}
+
+inline void put_quantized(BitWriter& bits, float v, double min, double max, double step) {
+    bits.put(quantize(v, min, max, step), bits_for(static_cast<uint64_t>(std::llround((max - min) / step))));
+}
+
+inline float get_quantized(BitReader& bits, double min, double max, double step) {
+    return dequantize(bits.get(bits_for(static_cast<uint64_t>(std::llround((max - min) / step)))), min, max, step);
+}
+
+inline void put_float_bits(BitWriter& bits, float v) {
+    uint32_t raw;
+    std::memcpy(&raw, &v, 4);
+    bits.put(raw, 32);
+}
+
+inline float get_float_bits(BitReader& bits) {
+    uint32_t raw = static_cast<uint32_t>(bits.get(32));
+    float v;
+    std::memcpy(&v, &raw, 4);
+    return v;
+}
+
+inline void put_bit_bytes(BitWriter& bits, std::string_view bytes) {
+    put_bit_varint(bits, bytes.size());
+    for (char c : bytes) bits.put(static_cast<uint8_t>(c), 8);
+}
+
+inline std::string get_bit_bytes(BitReader& bits) {
+    uint64_t n = get_bit_varint(bits);
+    if (n > bits.in.remaining() + 8) throw std::runtime_error("Truncated data");
+    std::string out(static_cast<size_t>(n), '\0');
+    for (auto& c : out) c = static_cast<char>(bits.get(8));
+    return out;
+}
+
+// ---- tagged structs ----
+// structs with @ids write (id delta, wire type) before every field they send, in id order, and
+// end with a zero tag. the wire type says how to step over a field without knowing it, so a
+// decoder skips ids it has never heard of and falls back to defaults for the ones that are missing
+
+enum WireType { WireVarint = 0, WireBit = 1, WireFixed32 = 2, WireBytes = 3 };
+
+// 3 bits at a time with a continuation bit, tags are almost always one group
+inline void put_small_varint(BitWriter& bits, uint64_t v) {
+    while (v >= 8) {
+        bits.put((v & 7) | 8, 4);
+        v >>= 3;
+    }
+    bits.put(v, 4);
+}
+
+inline uint64_t get_small_varint(BitReader& bits) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 3) {
+        uint64_t group = bits.get(4);
+        v |= (group & 7) << shift;
+        if (!(group & 8)) return v;
+    }
+    throw std::runtime_error("Malformed field tag");
+}
+
+struct FieldTag {
+    uint64_t id = 0;
+    int wire = 0;
+};
+
+inline void put_field_tag(BitWriter& bits, FieldTag& tag, uint64_t id, int wire) {
+    put_small_varint(bits, ((id - tag.id) << 2) | static_cast<uint64_t>(wire));
+    tag.id = id;
+    tag.wire = wire;
+}
+
+inline void put_end_tag(BitWriter& bits) {
+    put_small_varint(bits, 0);
+}
+
+// false at the end of the struct
+inline bool get_field_tag(BitReader& bits, FieldTag& tag) {
+    uint64_t v = get_small_varint(bits);
+    if (v == 0) return false;
+    if (v >> 2 == 0) throw std::runtime_error("Field ids out of order");
+    tag.id += v >> 2;
+    tag.wire = static_cast<int>(v & 3);
+    return true;
+}
+
+inline void expect_wire(const FieldTag& tag, int wire) {
+    if (tag.wire != wire) throw std::runtime_error("Field @" + std::to_string(tag.id) + " has the wrong wire type");
+}
+
+inline void skip_field(BitReader& bits, int wire) {
+    switch (wire) {
+        case WireVarint: get_bit_varint(bits); break;
+        case WireBit: bits.get(1); break;
+        case WireFixed32: bits.get(32); break;
+        default: {
+            uint64_t n = get_bit_varint(bits);
+            if (n > bits.in.remaining() + 8) throw std::runtime_error("Truncated data");
+            for (uint64_t i = 0; i < n; i++) bits.get(8);
+        }
+    }
+}
+
+// ranged ints and quantized floats go out as varints of their offset from the minimum. the varint
+// is only so a decoder that doesn't know the id can skip the field, the offset still depends on
+// the range, so a field whose range changes needs a new id
+inline void put_ranged_varint(BitWriter& bits, int v, int64_t min, int64_t max) {
+    if (v < min || v > max) throw std::runtime_error("Value " + std::to_string(v) + " outside its schema range");
+    put_bit_varint(bits, static_cast<uint64_t>(v - min));
+}
+
+inline int get_ranged_varint(BitReader& bits, int64_t min, int64_t max) {
+    uint64_t raw = get_bit_varint(bits);
+    if (raw > static_cast<uint64_t>(max - min)) throw std::runtime_error("Ranged int out of range");
+    return static_cast<int>(min + static_cast<int64_t>(raw));
+}
+
+inline int wire_type(const SchemaField& f) {
+    switch (f.type) {
+        case FieldType::Int: return WireVarint;
+        case FieldType::Float: return f.step > 0 ? WireVarint : WireFixed32;
+        case FieldType::Bool: return WireBit;
+        default: return WireBytes;
+    }
+}
+
+// what a missing field decodes to
+inline Value schema_default(const Schema& schema, const SchemaField& f);
+
+inline Table schema_defaults(const Schema& schema, const SchemaStruct& s) {
+    Table t;
+    for (const auto& f : s.fields)
+        if (!f.optional) t[Value(f.name)] = schema_default(schema, f);
+    return t;
+}
+
+inline Value schema_default(const Schema& schema, const SchemaField& f) {
+    if (f.has_default) return f.default_value;
+    switch (f.type) {
+        case FieldType::Int: return Value(0);
+        case FieldType::Float: return Value(0.0f);
+        case FieldType::Bool: return Value(false);
+        case FieldType::String: return Value(std::string());
+        case FieldType::Table: return Value(Table());
+        case FieldType::Struct: return Value(schema_defaults(schema, *schema.find(f.struct_name)));
+        case FieldType::Blob: return Value(Blob());
+    }
+    return Value();
+}
+
+// tagged structs in id order
+inline std::vector<const SchemaField*> fields_by_id(const SchemaStruct& s) {
+    std::vector<const SchemaField*> out;
+    for (const auto& f : s.fields) out.push_back(&f);
+    std::sort(out.begin(), out.end(), [](const SchemaField* a, const SchemaField* b) { return a->id < b->id; });
+    return out;
+}
+
+inline void put_schema_struct(BitWriter& bits, const Schema& schema, const SchemaStruct& s,
+                              const std::function<const Value*(const std::string&)>& lookup);
+
+inline std::map<std::string, Value> get_schema_struct(BitReader& bits, const Schema& schema, const SchemaStruct& s);
+
+inline void put_tagged_value(BitWriter& bits, const Schema& schema, const SchemaField& f, const Value& v) {
+    auto expect = [&f](bool ok, const char* what) {
+        if (!ok) throw std::runtime_error("Field " + f.name + " expects " + what);
+    };
+    switch (f.type) {
+        case FieldType::Int:
+            expect(v.is_int(), "an int");
+            if (f.has_range) put_ranged_varint(bits, v.as_int(), static_cast<int64_t>(f.min), static_cast<int64_t>(f.max));
+            else put_bit_varint(bits, zigzag(v.as_int()));
+            break;
+        case FieldType::Float: {
+            expect(is_number(v), "a float");
+            float x = static_cast<float>(number_of(v));
+            if (f.step > 0) put_bit_varint(bits, quantize(x, f.min, f.max, f.step));
+            else put_float_bits(bits, x);
+            break;
+        }
+        case FieldType::Bool:
+            expect(v.is_bool(), "a bool");
+            bits.put(v.as_bool() ? 1 : 0, 1);
+            break;
+        case FieldType::String:
+            expect(v.is_string(), "a string");
+            put_bit_bytes(bits, v.as_string());
+            break;
+        case FieldType::Blob:
+            expect(v.is_blob(), "a blob");
+            put_bit_bytes(bits, v.as_blob().view());
+            break;
+        case FieldType::Table:
+            expect(v.is_table(), "a table");
+            put_bit_bytes(bits, v.as_table().serialize());
+            break;
+        case FieldType::Struct: {
+            // nested structs travel as bytes so they can be skipped
+            expect(v.is_table(), "a table");
+            const Table& t = v.as_table();
+            std::string nested;
+            BitWriter inner(nested);
+            put_schema_struct(inner, schema, *schema.find(f.struct_name), [&t](const std::string& name) { return t.find(Value(name)); });
+            inner.flush();
+            put_bit_bytes(bits, nested);
+            break;
+        }
+    }
+}
+
+inline void put_tagged_struct(BitWriter& bits, const Schema& schema, const SchemaStruct& s,
+                              const std::function<const Value*(const std::string&)>& lookup) {
+    FieldTag tag;
+    for (const SchemaField* f : fields_by_id(s)) {
+        const Value* v = lookup(f->name);
+        if (!v) {
+            if (!f->optional && !f->has_default) throw std::runtime_error("Missing field " + f->name + " in " + s.name);
+            continue;
+        }
+        if (f->has_default && *v == f->default_value) continue; // the decoder fills it back in
+        put_field_tag(bits, tag, f->id, wire_type(*f));
+        put_tagged_value(bits, schema, *f, *v);
+    }
+    put_end_tag(bits);
+}
+
+inline std::map<std::string, Value> get_tagged_struct(BitReader& bits, const Schema& schema, const SchemaStruct& s) {
+    std::map<std::string, Value> out;
+    FieldTag tag;
+    while (get_field_tag(bits, tag)) {
+        const SchemaField* f = nullptr;
+        for (const auto& candidate : s.fields) if (candidate.id == tag.id) f = &candidate;
+        if (!f) {
+            skip_field(bits, tag.wire);
+            continue;
+        }
+        expect_wire(tag, wire_type(*f));
+        switch (f->type) {
+            case FieldType::Int:
+                out[f->name] = f->has_range ? get_ranged_varint(bits, static_cast<int64_t>(f->min), static_cast<int64_t>(f->max))
+                                            : static_cast<int>(unzigzag(get_bit_varint(bits)));
+                break;
+            case FieldType::Float:
+                out[f->name] = f->step > 0 ? dequantize(get_bit_varint(bits), f->min, f->max, f->step) : get_float_bits(bits);
+                break;
+            case FieldType::Bool: out[f->name] = bits.get(1) != 0; break;
+            case FieldType::String: out[f->name] = get_bit_bytes(bits); break;
+            case FieldType::Blob: out[f->name] = Value(Blob(get_bit_bytes(bits))); break;
+            case FieldType::Table: out[f->name] = Value(Table::deserialize(get_bit_bytes(bits))); break;
+            case FieldType::Struct: {
+                std::string bytes = get_bit_bytes(bits);
+                ByteReader nested_in(bytes);
+                BitReader nested_bits(nested_in);
+                Table nested;
+                for (auto& [key, value] : get_schema_struct(nested_bits, schema, *schema.find(f->struct_name))) nested[Value(key)] = value;
+                out[f->name] = Value(nested);
+                break;
+            }
+        }
+    }
+    for (const auto& f : s.fields)
+        if (!f.optional && !out.count(f.name)) out[f.name] = schema_default(schema, f);
+    return out;
+}
+
+inline void put_schema_value(BitWriter& bits, const Schema& schema, const SchemaField& f, const Value& v) {
+    auto expect = [&f](bool ok, const char* what) {
+        if (!ok) throw std::runtime_error("Field " + f.name + " expects " + what);
+    };
+    switch (f.type) {
+        case FieldType::Int:
+            expect(v.is_int(), "an int");
+            if (f.has_range) put_ranged(bits, v.as_int(), static_cast<int64_t>(f.min), static_cast<int64_t>(f.max));
+            else put_bit_varint(bits, zigzag(v.as_int()));
+            break;
+        case FieldType::Float: {
+            expect(is_number(v), "a float");
+            float x = static_cast<float>(number_of(v));
+            if (f.step > 0) put_quantized(bits, x, f.min, f.max, f.step);
+            else put_float_bits(bits, x);
+            break;
+        }
+        case FieldType::Bool:
+            expect(v.is_bool(), "a bool");
+            bits.put(v.as_bool() ? 1 : 0, 1);
+            break;
+        case FieldType::String:
+            expect(v.is_string(), "a string");
+            put_bit_bytes(bits, v.as_string());
+            break;
+        case FieldType::Blob:
+            expect(v.is_blob(), "a blob");
+            put_bit_bytes(bits, v.as_blob().view());
+            break;
+        case FieldType::Table:
+            expect(v.is_table(), "a table");
+            put_bit_bytes(bits, v.as_table().serialize());
+            break;
+        case FieldType::Struct: {
+            expect(v.is_table(), "a table");
+            const Table& t = v.as_table();
+            put_schema_struct(bits, schema, *schema.find(f.struct_name), [&t](const std::string& name) { return t.find(Value(name)); });
+            break;
+        }
+    }
+}
 
-// comparison operators
-bool operator<(const Value& lhs, const Value& rhs);
-bool operator==(const Value& lhs, const Value& rhs);
+inline void put_schema_struct(BitWriter& bits, const Schema& schema, const SchemaStruct& s,
+                              const std::function<const Value*(const std::string&)>& lookup) {
+    if (s.tagged) return put_tagged_struct(bits, schema, s, lookup);
+    for (const auto& f : s.fields) {
+        const Value* v = lookup(f.name);
+        if (!v && f.has_default) v = &f.default_value;
+        if (f.optional) bits.put(v ? 1 : 0, 1);
+        else if (!v) throw std::runtime_error("Missing field " + f.name + " in " + s.name);
+        if (v) put_schema_value(bits, schema, f, *v);
+    }
+}
 
-class Value {
+inline std::map<std::string, Value> get_schema_struct(BitReader& bits, const Schema& schema, const SchemaStruct& s) {
+    if (s.tagged) return get_tagged_struct(bits, schema, s);
+    std::map<std::string, Value> out;
+    for (const auto& f : s.fields) {
+        if (f.optional && !bits.get(1)) continue;
+        switch (f.type) {
+            case FieldType::Int:
+                out[f.name] = f.has_range ? get_ranged(bits, static_cast<int64_t>(f.min), static_cast<int64_t>(f.max))
+                                          : static_cast<int>(unzigzag(get_bit_varint(bits)));
+                break;
+            case FieldType::Float:
+                out[f.name] = f.step > 0 ? get_quantized(bits, f.min, f.max, f.step) : get_float_bits(bits);
+                break;
+            case FieldType::Bool: out[f.name] = bits.get(1) != 0; break;
+            case FieldType::String: out[f.name] = get_bit_bytes(bits); break;
+            case FieldType::Blob: out[f.name] = Value(Blob(get_bit_bytes(bits))); break;
+            case FieldType::Table: out[f.name] = Value(Table::deserialize(get_bit_bytes(bits))); break;
+            case FieldType::Struct: {
+                Table nested;
+                for (auto& [key, value] : get_schema_struct(bits, schema, *schema.find(f.struct_name))) nested[Value(key)] = value;
+                out[f.name] = Value(nested);
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+inline const SchemaStruct& schema_type(const Schema& schema, const std::string& type) {
+    const SchemaStruct* s = schema.find(type);
+    if (!s) throw std::runtime_error("Unknown schema type: " + type);
+    return *s;
+}
+
+} // namespace detail
+
+// the same bit-packed form the generated encode_binary writes, for data held in plain maps
+// (nested structs are map tables with string keys)
+inline std::string encode_with_schema(const Schema& schema, const std::string& type, const std::map<std::string, Value>& data) {
+    std::string out;
+    detail::BitWriter bits(out);
+    detail::put_schema_struct(bits, schema, detail::schema_type(schema, type), [&data](const std::string& name) -> const Value* {
+        auto it = data.find(name);
+        return it == data.end() ? nullptr : &it->second;
+    });
+    bits.flush();
+    return out;
+}
+
+inline std::map<std::string, Value> decode_with_schema(const Schema& schema, const std::string& type, std::string_view bytes) {
+    detail::ByteReader in(bytes);
+    detail::BitReader bits(in);
+    return detail::get_schema_struct(bits, schema, detail::schema_type(schema, type));
+}
+
+// ---- validating untrusted events ----
+// a Validator is compiled once from a schema struct and checks event text while it's being read:
+// types, ranges, string lengths, unknown and duplicate keys, and required fields. everything is
+// checked on views of the input, so a bad event is rejected before a single Value is built
+
+class Validator {
     private:
-        std::variant<int, float, bool, std::string, std::shared_ptr<Table>> data;
+        struct Rule {
+            SchemaField field;
+            std::shared_ptr<const Validator> nested;    // for struct fields
+        };
 
-    public:
-        // creates a null value (0)
-        Value() : data(0) {}
-        
-        // constructors for different types
-        Value(int v) : data(v) {}
-        Value(float v) : data(v) {}
-        Value(bool v) : data(v) {}
-        Value(const char* v) : data(std::string(v)) {}
-        Value(const std::string& v) : data(v) {}
-        Value(const Table& v) : data(std::make_shared<Table>(v)) {}
-        Value(const std::shared_ptr<Table>& v) : data(v) {}
+        std::string event;
+        std::string type_name;
+        std::vector<Rule> rules;
+        std::map<std::string, size_t, std::less<>> by_name;
+        bool allow_unknown = false;
 
-        // type checkers
-        bool is_int() const { return std::holds_alternative<int>(data); }
-        bool is_float() const { return std::holds_alternative<float>(data); }
-        bool is_bool() const { return std::holds_alternative<bool>(data); }
-        bool is_string() const { return std::holds_alternative<std::string>(data); }
-        bool is_table() const { return std::holds_alternative<std::shared_ptr<Table>>(data); }
+        [[noreturn]] void reject(const std::string& msg) const {
+            throw std::runtime_error("Invalid " + type_name + ": " + msg);
+        }
 
-        // getters
-        int as_int() const { return std::get<int>(data); }
-        float as_float() const { return std::get<float>(data); }
-        bool as_bool() const { return std::get<bool>(data); }
-        std::string as_string() const { return std::get<std::string>(data); }
-        const Table& as_table() const { return *std::get<std::shared_ptr<Table>>(data); }
-        Table& as_table() { return *std::get<std::shared_ptr<Table>>(data); }
+        const Rule* rule(std::string_view key) const {
+            auto it = by_name.find(key);
+            return it == by_name.end() ? nullptr : &rules[it->second];
+        }
 
+        // marks key as seen, rejecting unknown and repeated keys
+        const Rule* take(std::string_view key, uint64_t& seen) const {
+            const Rule* r = rule(key);
+            if (!r) {
+                if (!allow_unknown) reject("unknown field '" + std::string(key) + "'");
+                return nullptr;
+            }
+            uint64_t bit = uint64_t(1) << (r - rules.data());
+            if (seen & bit) reject("field '" + r->field.name + "' appears twice");
+            seen |= bit;
+            return r;
+        }
 
-        // comparison operators
-        friend bool operator<(const Value& lhs, const Value& rhs);
-        friend bool operator==(const Value& lhs, const Value& rhs);
+        void check_required(uint64_t seen) const {
+            for (size_t i = 0; i < rules.size(); i++) {
+                const SchemaField& f = rules[i].field;
+                if (!(seen & (uint64_t(1) << i)) && !f.optional && !f.has_default) reject("missing field '" + f.name + "'");
+            }
+        }
 
-        // serialize and deserialize
-        std::string serialize() const;
-        static Value deserialize(const std::string& data);
-    };
+        void check_value(const Rule& r, std::string_view text) const {
+            const SchemaField& f = r.field;
+            auto expect = [&](bool ok, const std::string& what) {
+                if (!ok) reject("field '" + f.name + "' " + what + ", got: " + std::string(text));
+            };
+            switch (f.type) {
+                case FieldType::Int: {
+                    int v = 0;
+                    expect(detail::parse_int(detail::number_text(text), v), "expects an int");
+                    expect(!f.has_range || (v >= f.min && v <= f.max), "is outside its range");
+                    break;
+                }
+                case FieldType::Float: {
+                    float v = 0;
+                    expect(detail::parse_float(detail::number_text(text), v), "expects a float");
+                    expect(!f.has_range || (v >= f.min && v <= f.max), "is outside its range");
+                    break;
+                }
+                case FieldType::Bool:
+                    expect(text == "true" || text == "false", "expects a bool");
+                    break;
+                case FieldType::String:
+                    expect(detail::is_quoted(text), "expects a quoted string");
+                    if (f.has_length) {
+                        size_t length = text.size() - 2;
+                        if (text.find('\\') != std::string_view::npos) length = detail::unescape(text.substr(1, length)).size();
+                        expect(length >= f.min_length && length <= f.max_length, "has the wrong length");
+                    }
+                    break;
+                case FieldType::Blob: {
+                    size_t bytes_at = 0, length = 0;
+                    if (!detail::blob_header(text, 0, bytes_at, length)) {
+                        // printable blobs are checked by decoding them, which also gives the length
+                        std::string bytes;
+                        bool decoded = false;
+                        try {
+                            decoded = detail::decode_encoded_blob(text, bytes);
+                        } catch (const std::runtime_error&) {}
+                        expect(decoded, "expects a blob");
+                        expect(!f.has_length || (bytes.size() >= f.min_length && bytes.size() <= f.max_length), "has the wrong length");
+                        break;
+                    }
+                    expect(bytes_at + length == text.size(), "expects a blob");
+                    expect(!f.has_length || (length >= f.min_length && length <= f.max_length), "has the wrong length");
+                    break;
+                }
+                case FieldType::Table: {
+                    expect(text.size() >= 2 && ((text.front() == '{' && text.back() == '}') || (text.front() == '[' && text.back() == ']')), "expects a table");
+                    int depth = 0;
+                    for (size_t i = 0; i < text.size(); i++) {
+                        char c = text[i];
+                        if (c == '"' || c == '#') {
+                            i = detail::literal_end(text, i);
+                            expect(i != std::string_view::npos, "has an unterminated string");
+                        }
+                        else if (c == '[' || c == '{') depth++;
+                        else if (c == ']' || c == '}') depth--;
+                        expect(depth >= 0, "has unbalanced brackets");
+                    }
+                    expect(depth == 0, "has unbalanced brackets");
+                    break;
+                }
+                case FieldType::Struct: {
+                    expect(text.size() >= 2 && text.front() == '{' && text.back() == '}', "expects a table");
+                    uint64_t seen = 0;
+                    for_each_entry(text, [&](std::string_view key, std::string_view value) {
+                        if (const Rule* inner = r.nested->take(key, seen)) r.nested->check_value(*inner, value);
+                    });
+                    r.nested->check_required(seen);
+                    break;
+                }
+            }
+        }
+
+        // only called on text check_value accepted
+        Value build_value(const Rule& r, std::string_view text) const {
+            switch (r.field.type) {
+                case FieldType::Int: return Value(detail::parse_int_text(text));
+                case FieldType::Float: return Value(detail::parse_float_text(text));
+                case FieldType::Bool: return Value(text == "true");
+                case FieldType::String: return Value(detail::unescape(text.substr(1, text.size() - 2)));
+                case FieldType::Blob: return Value(detail::parse_blob_text(text));
+                case FieldType::Table: return Value(Table::deserialize(std::string(text)));
+                case FieldType::Struct: {
+                    Table t;
+                    for_each_entry(text, [&](std::string_view key, std::string_view value) {
+                        if (const Rule* inner = r.nested->rule(key)) t[Value(inner->field.name)] = r.nested->build_value(*inner, value);
+                    });
+                    for (const auto& inner : r.nested->rules)
+                        if (inner.field.has_default && !t.exists(Value(inner.field.name))) t[Value(inner.field.name)] = inner.field.default_value;
+                    return Value(t);
+                }
+            }
+            return Value();
+        }
+
+        template<typename F>
+        void for_each_entry(std::string_view text, F&& f) const {
+            try {
+                detail::for_each_table_entry(text, [&](std::string_view key, std::string_view value) {
+                    f(detail::unquote(key), value);
+                });
+            } catch (const std::runtime_error& e) {
+                if (std::string(e.what()).rfind("Invalid ", 0) == 0) throw;
+                reject(e.what());
+            }
+        }
 
-class Table {
-    // table is like lua table, it can be nested and can be array or objects
-    private:
-        std::map<Value, Value> data;
-        bool is_array = false;
     public:
-        Table() = default;
-        Table(const std::map<Value, Value>& d) : data(d) {}
-        Table(const std::vector<Value>& d) {
-            for (size_t i = 0; i < d.size(); i++) {
-                data[Value(static_cast<int>(i))] = d[i];
+        Validator(const Schema& schema, const std::string& type, bool allow_unknown_fields = false) {
+            const SchemaStruct& s = detail::schema_type(schema, type);
+            if (s.fields.size() > 64) throw std::runtime_error("Validators take at most 64 fields");
+            event = s.event;
+            type_name = s.is_event ? s.event : s.name;
+            allow_unknown = allow_unknown_fields;
+            for (const auto& f : s.fields) {
+                Rule r{f, nullptr};
+                if (f.type == FieldType::Struct) r.nested = std::make_shared<Validator>(schema, f.struct_name, allow_unknown_fields);
+                by_name[f.name] = rules.size();
+                rules.push_back(std::move(r));
             }
-            is_array = true;
         }
-        Table(std::initializer_list<std::pair<Value, Value>> init) : data(init.begin(), init.end()) {}
-        Table(std::initializer_list<Value> init) : data() {
-            size_t i = 0;
-            for (const auto& v : init) {
-                data[Value(static_cast<int>(i++))] = v;
+
+        // a spec written as a netvent event, each key holding its schema declaration:
+        //
+        //   "shoot"
+        //   x "int range(0, 4095)"
+        //   player_name "string length(1, 32)"
+        static Validator from_netvent(std::string_view spec, bool allow_unknown_fields = false) {
+            detail::LineReader lines(spec);
+            std::string_view name, key, value;
+            if (!lines.event(name)) throw std::runtime_error("Empty validator spec");
+            Schema schema;
+            SchemaStruct s;
+            s.name = "spec";
+            s.event = std::string(detail::unquote(name));
+            s.is_event = true;
+            while (lines.next(key, value)) {
+                std::vector<detail::SchemaToken> tokens = detail::tokenize_schema(std::string(key) + " " + std::string(detail::unquote(value)));
+                s.fields.push_back(detail::parse_schema_field(tokens, schema));
             }
-            is_array = true;
+            schema.structs.push_back(std::move(s));
+            return Validator(schema, "spec", allow_unknown_fields);
         }
-        Table(std::initializer_list<std::pair<const char*, Value>> init) {
-            for (const auto& [key, value] : init) {
-                data[Value(key)] = value;
+
+        const std::string& event_name() const { return event; }
+
+        // throws on the first problem, without building anything
+        void check(std::string_view text) const {
+            detail::LineReader lines(text);
+            std::string_view name, key, value;
+            if (!lines.event(name)) reject("empty event");
+            if (!event.empty() && detail::unquote(name) != event) reject("expected event \"" + event + "\", got: " + std::string(name));
+            uint64_t seen = 0;
+            while (lines.next(key, value))
+                if (const Rule* r = take(key, seen)) check_value(*r, value);
+            check_required(seen);
+        }
+
+        // check, then build the event the way deserialize_from_netvent would, with values
+        // converted to the declared types and defaults filled in
+        std::pair<Value, std::map<std::string, Value>> decode(std::string_view text) const {
+            check(text);
+            std::map<std::string, Value> result;
+            detail::LineReader lines(text);
+            std::string_view name, key, value;
+            lines.event(name);
+            while (lines.next(key, value))
+                if (const Rule* r = rule(key)) result[r->field.name] = build_value(*r, value);
+                else result[std::string(key)] = Value::deserialize(std::string(value));
+            for (const auto& r : rules)
+                if (r.field.has_default && !result.count(r.field.name)) result[r.field.name] = r.field.default_value;
+            return {Value::deserialize(std::string(name)), std::move(result)};
+        }
+};
+
+// what to do with text that isn't valid utf-8
+enum class Utf8Policy {
+    Accept,     // take the bytes as they are, no check
+    Reject,     // throw
+    Replace,    // swap each bad sequence for U+FFFD
+};
+
+struct DecodeOptions {
+    const Validator* validator = nullptr;   // reject events that don't match, before building them
+    Utf8Policy utf8 = Utf8Policy::Accept;
+};
+
+inline std::pair<Value, std::map<std::string, Value>> deserialize_from_netvent(std::string_view data, const DecodeOptions& options) {
+    // the whole event is checked in one pass before parsing. escapes can't make bad utf-8 (lone
+    // surrogates throw), so good text means good strings
+    std::string repaired;
+    if (options.utf8 != Utf8Policy::Accept && !detail::valid_utf8(data)) {
+        if (options.utf8 == Utf8Policy::Reject) throw std::runtime_error("Invalid utf-8 in netvent event");
+        repaired = detail::repair_utf8(data);
+        data = repaired;
+    }
+    if (options.validator) return options.validator->decode(data);
+    return deserialize_from_netvent(data);
+}
+
+namespace detail {
+
+inline std::string cpp_type(const SchemaField& f) {
+    std::string t;
+    switch (f.type) {
+        case FieldType::Int: t = "int"; break;
+        case FieldType::Float: t = "float"; break;
+        case FieldType::Bool: t = "bool"; break;
+        case FieldType::String: t = "std::string"; break;
+        case FieldType::Table: t = "netvent::Table"; break;
+        case FieldType::Struct: t = f.struct_name; break;
+        case FieldType::Blob: t = "netvent::Blob"; break;
+    }
+    return f.optional ? "std::optional<" + t + ">" : t;
+}
+
+inline std::string cpp_number(double v);
+
+// c++ literal for a schema default
+inline std::string cpp_literal(const SchemaField& f, const Value& v) {
+    switch (f.type) {
+        case FieldType::Int: return std::to_string(v.as_int());
+        case FieldType::Float: return cpp_number(v.as_float()) + "f";
+        case FieldType::Bool: return v.as_bool() ? "true" : "false";
+        default: return "\"" + v.as_string() + "\"";
+    }
+}
+
+inline std::string cpp_default(const SchemaField& f) {
+    if (f.optional) return "";
+    if (f.has_default) return " = " + cpp_literal(f, f.default_value);
+    switch (f.type) {
+        case FieldType::Int: return " = 0";
+        case FieldType::Float: return " = 0.0f";
+        case FieldType::Bool: return " = false";
+        default: return "";
+    }
+}
+
+// text of one field's value, appended to out
+inline std::string gen_append_text(const SchemaField& f, const std::string& expr) {
+    switch (f.type) {
+        case FieldType::Int: return "netvent::detail::append_int(out, " + expr + ");";
+        case FieldType::Float: return "netvent::detail::append_float(out, " + expr + ");";
+        case FieldType::Bool: return "netvent::detail::append_bool(out, " + expr + ");";
+        case FieldType::String: return "netvent::detail::append_string(out, " + expr + ");";
+        case FieldType::Table: return "out += " + expr + ".serialize();";
+        case FieldType::Struct: return expr + ".encode_table(out);";
+        case FieldType::Blob: return "netvent::detail::append_blob(out, " + expr + ".view());";
+    }
+    return "";
+}
+
+inline std::string gen_parse_text(const SchemaField& f) {
+    switch (f.type) {
+        case FieldType::Int: return f.name + " = netvent::detail::parse_int_text(value);";
+        case FieldType::Float: return f.name + " = netvent::detail::parse_float_text(value);";
+        case FieldType::Bool: return f.name + " = netvent::detail::parse_bool_text(value);";
+        case FieldType::String: return f.name + " = netvent::detail::parse_string_text(value);";
+        case FieldType::Table: return f.name + " = netvent::Table::deserialize(std::string(value));";
+        case FieldType::Blob: return f.name + " = netvent::detail::parse_blob_text(value);";
+        case FieldType::Struct:
+            if (f.optional) return f.name + ".emplace();\n                " + f.name + "->decode_table(value);";
+            return f.name + ".decode_table(value);";
+    }
+    return "";
+}
+
+inline std::string cpp_number(double v) {
+    char buf[64];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    std::string s(buf, res.ptr);
+    if (s.find_first_of(".e") == std::string::npos) s += ".0";
+    return s;
+}
+
+inline std::string gen_put_binary(const SchemaField& f, const std::string& expr) {
+    switch (f.type) {
+        case FieldType::Int:
+            if (f.has_range) return "netvent::detail::put_ranged(bits, " + expr + ", " + std::to_string(static_cast<int64_t>(f.min)) + ", " + std::to_string(static_cast<int64_t>(f.max)) + ");";
+            return "netvent::detail::put_bit_varint(bits, netvent::detail::zigzag(" + expr + "));";
+        case FieldType::Float:
+            if (f.step > 0) return "netvent::detail::put_quantized(bits, " + expr + ", " + cpp_number(f.min) + ", " + cpp_number(f.max) + ", " + cpp_number(f.step) + ");";
+            return "netvent::detail::put_float_bits(bits, " + expr + ");";
+        case FieldType::Bool: return "bits.put(" + expr + " ? 1 : 0, 1);";
+        case FieldType::String: return "netvent::detail::put_bit_bytes(bits, " + expr + ");";
+        case FieldType::Table: return "netvent::detail::put_bit_bytes(bits, " + expr + ".serialize());";
+        case FieldType::Struct: return expr + ".encode_bits(bits);";
+        case FieldType::Blob: return "netvent::detail::put_bit_bytes(bits, " + expr + ".view());";
+    }
+    return "";
+}
+
+inline std::string gen_get_binary(const SchemaField& f, const std::string& indent) {
+    switch (f.type) {
+        case FieldType::Int:
+            if (f.has_range) return f.name + " = netvent::detail::get_ranged(bits, " + std::to_string(static_cast<int64_t>(f.min)) + ", " + std::to_string(static_cast<int64_t>(f.max)) + ");";
+            return f.name + " = static_cast<int>(netvent::detail::unzigzag(netvent::detail::get_bit_varint(bits)));";
+        case FieldType::Float:
+            if (f.step > 0) return f.name + " = netvent::detail::get_quantized(bits, " + cpp_number(f.min) + ", " + cpp_number(f.max) + ", " + cpp_number(f.step) + ");";
+            return f.name + " = netvent::detail::get_float_bits(bits);";
+        case FieldType::Bool: return f.name + " = bits.get(1) != 0;";
+        case FieldType::String: return f.name + " = netvent::detail::get_bit_bytes(bits);";
+        case FieldType::Table: return f.name + " = netvent::Table::deserialize(netvent::detail::get_bit_bytes(bits));";
+        case FieldType::Blob: return f.name + " = netvent::Blob(netvent::detail::get_bit_bytes(bits));";
+        case FieldType::Struct:
+            if (f.optional) return f.name + ".emplace();\n" + indent + f.name + "->decode_bits(bits);";
+            return f.name + ".decode_bits(bits);";
+    }
+    return "";
+}
+
+// tagged structs send ranged values as varints and nested structs as bytes, see put_ranged_varint
+inline std::string gen_put_tagged(const SchemaField& f, const std::string& expr) {
+    switch (f.type) {
+        case FieldType::Int:
+            if (f.has_range) return "netvent::detail::put_ranged_varint(bits, " + expr + ", " + std::to_string(static_cast<int64_t>(f.min)) + ", " + std::to_string(static_cast<int64_t>(f.max)) + ");";
+            break;
+        case FieldType::Float:
+            if (f.step > 0) return "netvent::detail::put_bit_varint(bits, netvent::detail::quantize(" + expr + ", " + cpp_number(f.min) + ", " + cpp_number(f.max) + ", " + cpp_number(f.step) + "));";
+            break;
+        case FieldType::Struct: return "netvent::detail::put_bit_bytes(bits, " + expr + ".encode_binary());";
+        default: break;
+    }
+    return gen_put_binary(f, expr);
+}
+
+inline std::string gen_get_tagged(const SchemaField& f, const std::string& indent) {
+    switch (f.type) {
+        case FieldType::Int:
+            if (f.has_range) return f.name + " = netvent::detail::get_ranged_varint(bits, " + std::to_string(static_cast<int64_t>(f.min)) + ", " + std::to_string(static_cast<int64_t>(f.max)) + ");";
+            break;
+        case FieldType::Float:
+            if (f.step > 0) return f.name + " = netvent::detail::dequantize(netvent::detail::get_bit_varint(bits), " + cpp_number(f.min) + ", " + cpp_number(f.max) + ", " + cpp_number(f.step) + ");";
+            break;
+        case FieldType::Struct:
+            if (f.optional) return f.name + ".emplace();\n" + indent + f.name + "->decode_binary(netvent::detail::get_bit_bytes(bits));";
+            return f.name + ".decode_binary(netvent::detail::get_bit_bytes(bits));";
+        default: break;
+    }
+    return gen_get_binary(f, indent);
+}
+
+// when a tagged field has to be sent: optional fields while they hold a value, scalars while they
+// differ from their default, tables and structs always
+inline std::string gen_tagged_condition(const SchemaField& f) {
+    if (f.optional) return f.name;
+    Value def = f.has_default ? f.default_value : Value();
+    switch (f.type) {
+        case FieldType::Int: return f.name + " != " + (f.has_default ? cpp_literal(f, def) : "0");
+        case FieldType::Float: return f.name + " != " + (f.has_default ? cpp_literal(f, def) : "0.0f");
+        case FieldType::Bool: return (f.has_default && def.as_bool() ? "!" : "") + f.name;
+        case FieldType::String: return f.has_default ? f.name + " != " + cpp_literal(f, def) : "!" + f.name + ".empty()";
+        case FieldType::Blob: return "!" + f.name + ".empty()";
+        default: return "";
+    }
+}
+
+inline std::string gen_struct(const SchemaStruct& s) {
+    std::stringstream o;
+    const std::string bit = "(uint64_t(1) << ";
+    o << "struct " << s.name << " {\n";
+    if (s.is_event) o << "    static constexpr const char* event_name = \"" << s.event << "\";\n\n";
+    for (const auto& f : s.fields) o << "    " << cpp_type(f) << " " << f.name << cpp_default(f) << ";\n";
+
+    // text, as a netvent event
+    if (s.is_event) {
+        o << "\n    void encode_text(std::string& out) const {\n"
+          << "        netvent::detail::append_string(out, event_name);\n"
+          << "        out += '\\n';\n";
+        for (const auto& f : s.fields) {
+            std::string ind = f.optional ? "            " : "        ";
+            if (f.optional) o << "        if (" << f.name << ") {\n";
+            o << ind << "out += \"" << f.name << " \";\n"
+              << ind << gen_append_text(f, f.optional ? "(*" + f.name + ")" : f.name) << "\n"
+              << ind << "out += '\\n';\n";
+            if (f.optional) o << "        }\n";
+        }
+        o << "    }\n\n"
+          << "    std::string encode_text() const {\n"
+          << "        std::string out;\n"
+          << "        encode_text(out);\n"
+          << "        return out;\n"
+          << "    }\n\n"
+          << "    void decode_text(std::string_view text) {\n"
+          << "        *this = " << s.name << "();\n"
+          << "        netvent::detail::LineReader lines(text);\n"
+          << "        std::string_view key, value;\n"
+          << "        if (!lines.event(value) || netvent::detail::unquote(value) != event_name)\n"
+          << "            throw std::runtime_error(\"Expected a " << s.event << " event\");\n"
+          << "        uint64_t seen = 0;\n"
+          << "        while (lines.next(key, value)) decode_field(key, value, seen);\n"
+          << "        check_required(seen);\n"
+          << "    }\n";
+    }
+
+    // text, as a table (how nested structs are written)
+    bool any_optional = false;
+    for (const auto& f : s.fields) any_optional = any_optional || f.optional;
+    o << "\n    void encode_table(std::string& out) const {\n"
+      << "        out += '{';\n";
+    // only needed while every earlier field was optional
+    const bool need_first = s.fields.size() >= 2 && s.fields[0].optional;
+    if (need_first) o << "        bool first = true;\n";
+    bool wrote_any = false, maybe_wrote = false; // what the generated code knows about earlier fields
+    for (const auto& f : s.fields) {
+        std::string ind = f.optional ? "            " : "        ";
+        if (f.optional) o << "        if (" << f.name << ") {\n";
+        if (wrote_any) o << ind << "out += ',';\n";
+        else if (maybe_wrote) o << ind << "if (!first) out += ',';\n";
+        if (need_first && !wrote_any) o << ind << "first = false;\n";
+        o << ind << "out += \"\\\"" << f.name << "\\\"=\";\n"
+          << ind << gen_append_text(f, f.optional ? "(*" + f.name + ")" : f.name) << "\n";
+        if (f.optional) o << "        }\n";
+        if (f.optional) maybe_wrote = true;
+        else wrote_any = true;
+    }
+    o << "        out += '}';\n"
+      << "    }\n\n"
+      << "    void decode_table(std::string_view text) {\n"
+      << "        *this = " << s.name << "();\n"
+      << "        uint64_t seen = 0;\n"
+      << "        netvent::detail::for_each_table_entry(text, [&](std::string_view key, std::string_view value) {\n"
+      << "            decode_field(netvent::detail::unquote(key), value, seen);\n"
+      << "        });\n"
+      << "        check_required(seen);\n"
+      << "    }\n";
+
+    // binary: bit packed, declaration order, one presence bit per optional field (or tagged by id)
+    o << "\n    void encode_binary(std::string& out) const {\n"
+      << "        netvent::detail::BitWriter bits(out);\n"
+      << "        encode_bits(bits);\n"
+      << "        bits.flush();\n"
+      << "    }\n\n"
+      << "    std::string encode_binary() const {\n"
+      << "        std::string out;\n"
+      << "        encode_binary(out);\n"
+      << "        return out;\n"
+      << "    }\n\n"
+      << "    void decode_binary(std::string_view bytes) {\n"
+      << "        netvent::detail::ByteReader in(bytes);\n"
+      << "        netvent::detail::BitReader bits(in);\n"
+      << "        decode_bits(bits);\n"
+      << "    }\n\n"
+      << "    void encode_bits(netvent::detail::BitWriter& bits) const {\n";
+    if (s.tagged) {
+        static const char* wires[] = {"WireVarint", "WireBit", "WireFixed32", "WireBytes"};
+        o << "        netvent::detail::FieldTag tag;\n";
+        for (const SchemaField* f : fields_by_id(s)) {
+            std::string cond = gen_tagged_condition(*f);
+            std::string ind = cond.empty() ? "        " : "            ";
+            if (!cond.empty()) o << "        if (" << cond << ") {\n";
+            o << ind << "netvent::detail::put_field_tag(bits, tag, " << f->id << ", netvent::detail::" << wires[wire_type(*f)] << ");\n"
+              << ind << gen_put_tagged(*f, f->optional ? "(*" + f->name + ")" : f->name) << "\n";
+            if (!cond.empty()) o << "        }\n";
+        }
+        o << "        netvent::detail::put_end_tag(bits);\n"
+          << "    }\n\n"
+          << "    // unknown ids are skipped, missing fields keep their defaults\n"
+          << "    void decode_bits(netvent::detail::BitReader& bits) {\n"
+          << "        *this = " << s.name << "();\n"
+          << "        netvent::detail::FieldTag tag;\n"
+          << "        while (netvent::detail::get_field_tag(bits, tag)) {\n"
+          << "            switch (tag.id) {\n";
+        for (const SchemaField* f : fields_by_id(s)) {
+            o << "                case " << f->id << ":\n"
+              << "                    netvent::detail::expect_wire(tag, netvent::detail::" << wires[wire_type(*f)] << ");\n"
+              << "                    " << gen_get_tagged(*f, "                    ") << "\n"
+              << "                    break;\n";
+        }
+        o << "                default:\n"
+          << "                    netvent::detail::skip_field(bits, tag.wire);\n"
+          << "            }\n"
+          << "        }\n"
+          << "    }\n";
+    } else {
+        if (s.fields.empty()) o << "        (void)bits;\n";
+        for (const auto& f : s.fields) {
+            if (f.optional) {
+                o << "        bits.put(" << f.name << " ? 1 : 0, 1);\n"
+                  << "        if (" << f.name << ") " << gen_put_binary(f, "(*" + f.name + ")") << "\n";
+            } else {
+                o << "        " << gen_put_binary(f, f.name) << "\n";
             }
         }
+        o << "    }\n\n"
+          << "    void decode_bits(netvent::detail::BitReader& bits) {\n"
+          << "        *this = " << s.name << "();\n";
+        if (s.fields.empty()) o << "        (void)bits;\n";
+        for (const auto& f : s.fields) {
+            if (f.optional) {
+                o << "        if (bits.get(1)) {\n"
+                  << "            " << gen_get_binary(f, "            ") << "\n"
+                  << "        }\n";
+            } else {
+                o << "        " << gen_get_binary(f, "        ") << "\n";
+            }
+        }
+        o << "    }\n";
+    }
 
-        void push_back(const Value& value) {
-            if (!is_array) throw std::runtime_error("Table is not an array");
-            data[Value(static_cast<int>(data.size()))] = value;
+    // shared by the text decoders
+    o << "\n    private:\n"
+      << "        void decode_field(std::string_view key, std::string_view value, uint64_t& seen) {\n";
+    for (size_t i = 0; i < s.fields.size(); i++) {
+        const auto& f = s.fields[i];
+        o << "            " << (i ? "} else if" : "if") << " (key == \"" << f.name << "\") {\n"
+          << "                " << gen_parse_text(f) << "\n"
+          << "                seen |= " << bit << i << ");\n";
+    }
+    if (s.fields.empty()) o << "            (void)key;\n            (void)value;\n            (void)seen;\n";
+    else o << "            }\n";
+    o << "        }\n\n"
+      << "        static void check_required(uint64_t seen) {\n";
+    for (size_t i = 0; i < s.fields.size(); i++) {
+        if (s.fields[i].optional || s.fields[i].has_default) continue;
+        o << "            if (!(seen & " << bit << i << "))) throw std::runtime_error(\"Missing field " << s.fields[i].name << " in " << s.name << "\");\n";
+    }
+    bool any_required = false;
+    for (const auto& f : s.fields) any_required = any_required || !(f.optional || f.has_default);
+    if (!any_required) o << "            (void)seen;\n";
+    o << "        }\n"
+      << "};\n";
+    return o.str();
+}
+
+} // namespace detail
+
+// c++ source for every struct in the schema, meant to be saved as a header next to netvent.hpp
+inline std::string generate_cpp(const Schema& schema, const std::string& ns = "") {
+    std::stringstream o;
+    o << "// generated by netvent_gen, do not edit\n"
+      << "#pragma once\n"
+      << "#include \"netvent.hpp\"\n"
+      << "#include <optional>\n"
+      << "#include <string>\n"
+      << "#include <string_view>\n\n";
+    if (!ns.empty()) o << "namespace " << ns << " {\n\n";
+    for (size_t i = 0; i < schema.structs.size(); i++) {
+        if (i) o << "\n";
+        o << detail::gen_struct(schema.structs[i]);
+    }
+    if (!ns.empty()) o << "\n} // namespace " << ns << "\n";
+    return o.str();
+}
+
+// ---- typed fields ----
+// text for plain c++ members, used by the typed events below
+
+namespace detail {
+
+template<typename T> struct is_optional : std::false_type {};
+template<typename T> struct is_optional<std::optional<T>> : std::true_type {};
+
+inline void append_typed(std::string& out, int v) { append_int(out, v); }
+inline void append_typed(std::string& out, float v) { append_float(out, v); }
+inline void append_typed(std::string& out, bool v) { append_bool(out, v); }
+inline void append_typed(std::string& out, const std::string& v) { append_string(out, v); }
+inline void append_typed(std::string& out, const Table& v) { out += v.serialize(); }
+inline void append_typed(std::string& out, const Blob& v) { append_blob(out, v.view()); }
+inline void append_typed(std::string& out, const Value& v) { out += v.serialize(); }
+
+inline void parse_typed(std::string_view text, int& v) { v = parse_int_text(text); }
+inline void parse_typed(std::string_view text, float& v) { v = parse_float_text(text); }
+inline void parse_typed(std::string_view text, bool& v) { v = parse_bool_text(text); }
+inline void parse_typed(std::string_view text, std::string& v) { v = parse_string_text(text); }
+inline void parse_typed(std::string_view text, Table& v) { v = Table::deserialize(std::string(trim_view(text))); }
+inline void parse_typed(std::string_view text, Blob& v) { v = parse_blob_text(text); }
+inline void parse_typed(std::string_view text, Value& v) { v = Value::deserialize(std::string(trim_value(text))); }
+
+template<typename T>
+inline void parse_typed(std::string_view text, std::optional<T>& v) {
+    T inner{};
+    parse_typed(text, inner);
+    v = std::move(inner);
+}
+
+} // namespace detail
+
+// ---- aggregate reflection ----
+// plain aggregates get encode/decode for free once their member names are listed:
+//
+//   struct Vector2 { float x, y; };
+//   template<> struct netvent::FieldNames<Vector2> {
+//       static constexpr std::string_view names[] = {"x", "y"};
+//   };
+//
+// members are reached through structured bindings, so the names have to be in declaration
+// order, and a list of the wrong length doesn't compile. an optional `event` member names the
+// event for encode()
+
+template<typename T>
+struct FieldNames;
+
+namespace detail {
+
+template<typename T, typename = void> struct is_reflected : std::false_type {};
+template<typename T> struct is_reflected<T, std::void_t<decltype(FieldNames<T>::names)>> : std::true_type {};
+
+template<typename T, typename = void> struct has_event_name : std::false_type {};
+template<typename T> struct has_event_name<T, std::void_t<decltype(FieldNames<T>::event)>> : std::true_type {};
+
+template<typename T>
+constexpr size_t member_count() {
+    return std::size(FieldNames<std::remove_const_t<T>>::names);
+}
+
+// calls visit with a reference to every member
+template<typename T, typename F>
+inline void with_members(T& obj, F&& visit) {
+    constexpr size_t n = member_count<T>();
+    static_assert(n <= 16, "reflection handles aggregates of up to 16 members");
+    if constexpr (n == 1) {
+        auto& [m0] = obj;
+        visit(m0);
+    } else if constexpr (n == 2) {
+        auto& [m0, m1] = obj;
+        visit(m0, m1);
+    } else if constexpr (n == 3) {
+        auto& [m0, m1, m2] = obj;
+        visit(m0, m1, m2);
+    } else if constexpr (n == 4) {
+        auto& [m0, m1, m2, m3] = obj;
+        visit(m0, m1, m2, m3);
+    } else if constexpr (n == 5) {
+        auto& [m0, m1, m2, m3, m4] = obj;
+        visit(m0, m1, m2, m3, m4);
+    } else if constexpr (n == 6) {
+        auto& [m0, m1, m2, m3, m4, m5] = obj;
+        visit(m0, m1, m2, m3, m4, m5);
+    } else if constexpr (n == 7) {
+        auto& [m0, m1, m2, m3, m4, m5, m6] = obj;
+        visit(m0, m1, m2, m3, m4, m5, m6);
+    } else if constexpr (n == 8) {
+        auto& [m0, m1, m2, m3, m4, m5, m6, m7] = obj;
+        visit(m0, m1, m2, m3, m4, m5, m6, m7);
+    } else if constexpr (n == 9) {
+        auto& [m0, m1, m2, m3, m4, m5, m6, m7, m8] = obj;
+        visit(m0, m1, m2, m3, m4, m5, m6, m7, m8);
+    } else if constexpr (n == 10) {
+        auto& [m0, m1, m2, m3, m4, m5, m6, m7, m8, m9] = obj;
+        visit(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9);
+    } else if constexpr (n == 11) {
+        auto& [m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10] = obj;
+        visit(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10);
+    } else if constexpr (n == 12) {
+        auto& [m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11] = obj;
+        visit(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11);
+    } else if constexpr (n == 13) {
+        auto& [m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12] = obj;
+        visit(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12);
+    } else if constexpr (n == 14) {
+        auto& [m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13] = obj;
+        visit(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13);
+    } else if constexpr (n == 15) {
+        auto& [m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14] = obj;
+        visit(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14);
+    } else if constexpr (n == 16) {
+        auto& [m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15] = obj;
+        visit(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15);
+    }
+}
+
+template<typename T>
+inline void append_member_value(std::string& out, const T& v);
+
+template<typename T>
+inline void parse_member_value(std::string_view text, T& v);
+
+// calls f(name, member) for every member that has something to write
+template<typename T, typename F>
+inline void for_each_present_member(const T& obj, F&& f) {
+    with_members(obj, [&f](const auto&... m) {
+        size_t i = 0;
+        auto visit = [&](const auto& member) {
+            std::string_view name = FieldNames<T>::names[i++];
+            if constexpr (is_optional<std::decay_t<decltype(member)>>::value) {
+                if (member) f(name, *member);
+            } else {
+                f(name, member);
+            }
+        };
+        (visit(m), ...);
+    });
+}
+
+// hands value to the member called key, false if there is none
+template<typename T>
+inline bool parse_member(T& obj, std::string_view key, std::string_view value, uint64_t& seen) {
+    constexpr size_t n = member_count<T>();
+    size_t index = n;
+    for (size_t i = 0; i < n; i++) if (FieldNames<T>::names[i] == key) index = i;
+    if (index == n) return false;
+    with_members(obj, [&](auto&... m) {
+        size_t i = 0;
+        ((i++ == index ? parse_member_value(value, m) : void()), ...);
+    });
+    seen |= uint64_t(1) << index;
+    return true;
+}
+
+template<typename T>
+inline void check_members(const T& obj, uint64_t seen) {
+    with_members(obj, [seen](const auto&... m) {
+        size_t i = 0;
+        auto check = [&](const auto& member) {
+            size_t bit = i++;
+            if (!is_optional<std::decay_t<decltype(member)>>::value && !(seen & (uint64_t(1) << bit)))
+                throw std::runtime_error("Missing field " + std::string(FieldNames<T>::names[bit]));
+        };
+        (check(m), ...);
+    });
+}
+
+// nested aggregates are written as tables
+template<typename T>
+inline void append_member_value(std::string& out, const T& v) {
+    if constexpr (is_reflected<T>::value) {
+        out += '{';
+        bool first = true;
+        for_each_present_member(v, [&](std::string_view name, const auto& member) {
+            if (!first) out += ',';
+            first = false;
+            append_string(out, name);
+            out += '=';
+            append_member_value(out, member);
+        });
+        out += '}';
+    } else {
+        append_typed(out, v);
+    }
+}
+
+template<typename T>
+inline void parse_member_value(std::string_view text, T& v) {
+    if constexpr (is_optional<T>::value) {
+        typename T::value_type inner{};
+        parse_member_value(text, inner);
+        v = std::move(inner);
+    } else if constexpr (is_reflected<T>::value) {
+        uint64_t seen = 0;
+        for_each_table_entry(text, [&](std::string_view key, std::string_view value) {
+            parse_member(v, unquote(key), value, seen);
+        });
+        check_members(v, seen);
+    } else {
+        parse_typed(text, v);
+    }
+}
+
+} // namespace detail
+
+// netvent event text straight from the members, without building Values
+template<typename T>
+inline void encode(std::string& out, const T& obj, std::string_view event_name) {
+    static_assert(detail::is_reflected<T>::value, "specialize netvent::FieldNames for this type");
+    detail::append_string(out, event_name);
+    out += '\n';
+    detail::for_each_present_member(obj, [&out](std::string_view name, const auto& member) {
+        out.append(name.data(), name.size());
+        out += ' ';
+        detail::append_member_value(out, member);
+        out += '\n';
+    });
+}
+
+template<typename T>
+inline std::string encode(const T& obj, std::string_view event_name) {
+    std::string out;
+    encode(out, obj, event_name);
+    return out;
+}
+
+// uses FieldNames<T>::event for the name
+template<typename T>
+inline std::string encode(const T& obj) {
+    static_assert(detail::has_event_name<T>::value, "FieldNames<T> has no event name, pass one to encode()");
+    return encode(obj, FieldNames<T>::event);
+}
+
+// missing members throw unless they're std::optional, unknown keys are skipped
+template<typename T>
+inline T decode(std::string_view text) {
+    static_assert(detail::is_reflected<T>::value, "specialize netvent::FieldNames for this type");
+    T obj{};
+    detail::LineReader lines(text);
+    std::string_view key, value;
+    if (!lines.event(value)) throw std::runtime_error("Empty event");
+    if constexpr (detail::has_event_name<T>::value) {
+        if (detail::unquote(value) != std::string_view(FieldNames<T>::event))
+            throw std::runtime_error("Expected a " + std::string(FieldNames<T>::event) + " event");
+    }
+    uint64_t seen = 0;
+    while (lines.next(key, value)) detail::parse_member(obj, key, value, seen);
+    detail::check_members(obj, seen);
+    return obj;
+}
+
+#if __cplusplus >= 202002L
+
+// ---- typed events (c++20) ----
+// events declared as types, so encoding, decoding and dispatch are worked out by the compiler:
+//
+//   using Shoot = Event<"shoot", Field<"x", int>, Field<"player_name", std::string>>;
+//   Shoot s;
+//   s.get<"x">() = 5;
+//   std::string text = s.encode_text();
+//
+// each field is a base of the event, so get<> is a fixed offset with no lookup, and a name
+// that isn't declared is a compile error
+
+template<size_t N>
+struct FixedString {
+    char data[N] = {};
+
+    constexpr FixedString(const char (&s)[N]) {
+        for (size_t i = 0; i < N; i++) data[i] = s[i];
+    }
+
+    constexpr std::string_view view() const { return std::string_view(data, N - 1); }
+};
+
+template<FixedString Name, typename T>
+struct Field {
+    using type = T;
+    static constexpr std::string_view name = Name.view();
+    T value{};
+};
+
+template<FixedString Name, typename... Fields>
+struct Event : Fields... {
+    private:
+        static_assert(sizeof...(Fields) <= 64, "events take at most 64 fields");
+
+        static constexpr std::string_view names[sizeof...(Fields) + 1] = {Fields::name..., ""};
+
+        static constexpr bool unique_names() {
+            for (size_t a = 0; a < sizeof...(Fields); a++)
+                for (size_t b = 0; b < a; b++)
+                    if (names[a] == names[b]) return false;
+            return true;
         }
+        static_assert(unique_names(), "field names have to be unique");
 
-        void push_back(const Value& key, const Value& value) {
-            if (is_array) throw std::runtime_error("Table is not an array");
-            data[Value(key)] = value;
+        template<size_t... I>
+        bool decode_field(std::string_view key, std::string_view value, uint64_t& seen, std::index_sequence<I...>) {
+            return ((key == Fields::name ? (detail::parse_typed(value, static_cast<Fields&>(*this).value), seen |= uint64_t(1) << I, true) : false) || ...);
+        }
+
+        template<size_t... I>
+        static void check_required(uint64_t seen, std::index_sequence<I...>) {
+            ((detail::is_optional<typename Fields::type>::value || (seen & (uint64_t(1) << I)) ||
+              (throw std::runtime_error("Missing field " + std::string(Fields::name) + " in " + std::string(event_name)), false)), ...);
+        }
+
+        template<typename F>
+        static void append_field(std::string& out, const F& field) {
+            if constexpr (detail::is_optional<typename F::type>::value) {
+                if (!field.value) return;
+                out.append(F::name.data(), F::name.size());
+                out += ' ';
+                detail::append_typed(out, *field.value);
+            } else {
+                out.append(F::name.data(), F::name.size());
+                out += ' ';
+                detail::append_typed(out, field.value);
+            }
+            out += '\n';
+        }
+
+    public:
+        static constexpr std::string_view event_name = Name.view();
+
+        static constexpr size_t index_of(std::string_view key) {
+            for (size_t i = 0; i < sizeof...(Fields); i++) if (names[i] == key) return i;
+            return sizeof...(Fields);
+        }
+
+        template<FixedString Key>
+        auto& get() {
+            constexpr size_t i = index_of(Key.view());
+            static_assert(i < sizeof...(Fields), "no field with this name");
+            using F = std::tuple_element_t<i, std::tuple<Fields...>>;
+            return static_cast<F&>(*this).value;
+        }
+
+        template<FixedString Key>
+        const auto& get() const {
+            return const_cast<Event*>(this)->template get<Key>();
+        }
+
+        void encode_text(std::string& out) const {
+            detail::append_string(out, event_name);
+            out += '\n';
+            (append_field(out, static_cast<const Fields&>(*this)), ...);
         }
 
-        Value& operator[](const Value& key) {
-            return data[key];
+        std::string encode_text() const {
+            std::string out;
+            encode_text(out);
+            return out;
         }
 
-        bool exists(const Value& key) const {
-            return data.find(key) != data.end();
+        // unknown keys are skipped, missing fields throw unless they're std::optional
+        void decode_text(std::string_view text) {
+            *this = Event();
+            detail::LineReader lines(text);
+            std::string_view key, value;
+            if (!lines.event(value) || detail::unquote(value) != event_name)
+                throw std::runtime_error("Expected a " + std::string(event_name) + " event");
+            uint64_t seen = 0;
+            while (lines.next(key, value)) decode_field(key, value, seen, std::index_sequence_for<Fields...>());
+            check_required(seen, std::index_sequence_for<Fields...>());
         }
+};
 
-        bool get_is_array() const { return is_array; }
-        std::variant<std::map<Value, Value>, std::vector<Value>> get_data() const {
-            if (is_array) {
-                std::vector<Value> vec;
-                for (const auto& pair : data) {
-                    vec.push_back(pair.second);
-                }
-                return vec;
-            }
-            return data;
+// a closed set of event types, picked between by name. works with Event<> and with the
+// structs netvent_gen writes for events
+template<typename... Events>
+struct EventList {
+    private:
+        template<typename E>
+        static E decode_as(std::string_view text) {
+            E event;
+            event.decode_text(text);
+            return event;
         }
 
-        std::map<Value, Value> get_data_map() const {
-            if (!is_array) {
-                std::map<Value, Value> map;
-                for (const auto& pair : data) {
-                    map[pair.first] = pair.second;
-                }
-                return map;
-            }
-            throw std::runtime_error("Table is not a map");
+    public:
+        using variant = std::variant<Events...>;
+
+        // calls f with the decoded event, false when the name isn't in the list
+        template<typename F>
+        static bool dispatch(std::string_view text, F&& f) {
+            detail::LineReader lines(text);
+            std::string_view name;
+            if (!lines.event(name)) throw std::runtime_error("Empty event");
+            name = detail::unquote(name);
+            return ((name == Events::event_name ? (f(decode_as<Events>(text)), true) : false) || ...);
         }
 
-        std::vector<Value> get_data_vector() const {
-            if (is_array) {
-                std::vector<Value> vec;
-                for (const auto& pair : data) {
-                    vec.push_back(pair.second);
-                }
-                return vec;
-            }
-            throw std::runtime_error("Table is not an array");
+        static variant decode(std::string_view text) {
+            std::optional<variant> out;
+            if (!dispatch(text, [&out](auto&& event) { out.emplace(std::move(event)); }))
+                throw std::runtime_error("Unknown event");
+            return std::move(*out);
         }
+};
 
-        std::string serialize() const;
-        static Table deserialize(const std::string& data);
-    };
+#endif
 
-inline std::string Value::serialize() const {
-    std::stringstream ss;
-    if (is_int()) {
-        ss << as_int();
-    } else if (is_float()) {
-        ss << std::fixed << std::setprecision(1) << as_float();
-    } else if (is_bool()) {
-        ss << (as_bool() ? "true" : "false");
-    } else if (is_string()) {
-        ss << "\"" << as_string() << "\"";
-    } else if (is_table()) {
-        ss << as_table().serialize();
+// ---- compile-time literals ----
+// constant tables written as netvent text in the source get parsed by the compiler:
+//
+//   constexpr auto defaults = R"(
+//   "server_config"
+//   tick_rate 64
+//   spawn {"x"=1.5,"y"=2.0}
+//   )"_nv;
+//   static_assert(defaults["tick_rate"].as_int() == 64);
+//
+// a malformed literal stops the build, and a constexpr one costs nothing at startup. everything
+// lives in one fixed-size array of entries, nested tables point at their children by index
+
+enum class LiteralKind { Int, Float, Bool, String, Table, Blob };
+
+struct LiteralValue {
+    LiteralKind kind = LiteralKind::Int;
+    int i = 0;
+    float f = 0;
+    bool b = false;
+    bool is_array = false;
+    bool escaped = false;       // text still has backslash escapes or is base64/hex, to_value() resolves them
+    std::string_view text;      // string contents, a blob's bytes (or #base64:/#hex: text), or a table's source
+    size_t first = 0;           // a table's entries in its LiteralEvent
+    size_t count = 0;
+
+    constexpr bool is_int() const { return kind == LiteralKind::Int; }
+    constexpr bool is_float() const { return kind == LiteralKind::Float; }
+    constexpr bool is_bool() const { return kind == LiteralKind::Bool; }
+    constexpr bool is_string() const { return kind == LiteralKind::String; }
+    constexpr bool is_table() const { return kind == LiteralKind::Table; }
+    constexpr bool is_blob() const { return kind == LiteralKind::Blob; }
+
+    constexpr int as_int() const {
+        if (!is_int()) throw std::runtime_error("Literal value is not an int");
+        return i;
     }
-    return ss.str();
-}
 
-inline Value Value::deserialize(const std::string& data) {
-    if (data.empty()) throw std::runtime_error("Empty data");
+    constexpr float as_float() const {
+        if (!is_float()) throw std::runtime_error("Literal value is not a float");
+        return f;
+    }
 
-    // test if it's a number
-    try {
-        if (data.find('.') != std::string::npos) {
-            return Value(std::stof(data));
-        } else {
-            return Value(std::stoi(data));
-        }
-    } catch (...) {}
+    constexpr bool as_bool() const {
+        if (!is_bool()) throw std::runtime_error("Literal value is not a bool");
+        return b;
+    }
 
-    // test if it's a bool
-    if (data == "true") return Value(true);
-    if (data == "false") return Value(false);
+    constexpr std::string_view as_string() const {
+        if (!is_string()) throw std::runtime_error("Literal value is not a string");
+        return text;
+    }
 
-    // test if it's a string (quoted)
-    if (data.length() >= 2 && data[0] == '"' && data.back() == '"') {
-        return Value(data.substr(1, data.length() - 2));
+    constexpr std::string_view as_blob() const {
+        if (!is_blob()) throw std::runtime_error("Literal value is not a blob");
+        return text;
     }
-    
-    // test if it's a table
-    if (data[0] == '[' || data[0] == '{') {
-        return Value(Table::deserialize(data));
+
+    constexpr bool same_key(const LiteralValue& o) const {
+        return kind == o.kind && i == o.i && f == o.f && b == o.b && text == o.text;
     }
+};
 
-    // default to string
-    return Value(data);
-}
+struct LiteralEntry {
+    LiteralValue key;
+    LiteralValue value;
+};
 
-// serialize the table
-inline std::string Table::serialize() const {
-    if (is_array) {
-        std::stringstream ss;
-        ss << "[";
-        bool first = true;
-        for (const auto& pair : data) {
-            if (!first) ss << ",";
-            first = false;
-            ss << pair.second.serialize();
+namespace detail {
+
+constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// ints are plain digits, anything with a '.' is a float (the same split Value::deserialize makes).
+// floats are exact for up to 15 significant digits, which covers anything written in a config
+constexpr LiteralValue parse_literal_number(std::string_view v) {
+    LiteralValue out;
+    size_t p = 0;
+    bool negative = false;
+    if (v[p] == '-' || v[p] == '+') negative = v[p++] == '-';
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool dot = false;
+    for (; p < v.size() && (is_digit(v[p]) || (v[p] == '.' && !dot)); p++) {
+        if (v[p] == '.') { dot = true; continue; }
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(v[p] - '0');
+            if (mantissa) digits++;
+            if (dot) exponent--;
+        } else if (!dot) {
+            exponent++;
         }
-        ss << "]";
-        return ss.str();
     }
-    std::stringstream ss;
-    ss << "{";
-    bool first = true;
-    for (const auto& pair : data) {
-        if (!first) ss << ",";
-        first = false;
-        ss << pair.first.serialize() << "=" << pair.second.serialize();
+    if (p < v.size() && dot && (v[p] == 'e' || v[p] == 'E')) {
+        p++;
+        bool negative_exp = false;
+        if (p < v.size() && (v[p] == '-' || v[p] == '+')) negative_exp = v[p++] == '-';
+        int e = 0;
+        if (p == v.size()) throw std::runtime_error("Malformed netvent literal: bad exponent");
+        for (; p < v.size() && is_digit(v[p]) && e < 1000; p++) e = e * 10 + (v[p] - '0');
+        exponent += negative_exp ? -e : e;
     }
-    ss << "}";
-    return ss.str();
-}
+    size_t end_digits = v[0] == '-' || v[0] == '+' ? 1 : 0;
+    if (p != v.size() || p == end_digits || (dot && p == end_digits + 1)) throw std::runtime_error("Malformed netvent literal: bad number");
 
-inline Table Table::deserialize(const std::string& data) {
-    if (data.empty()) throw std::runtime_error("Empty data");
-    
-    if (data[0] == '[') {
-        if (data.length() < 2 || data.back() != ']') 
-            throw std::runtime_error("Malformed array");
-            
-        if (data.length() == 2) // empty array == "[]"
-            return Table(std::vector<Value>());
-            
-        std::vector<Value> vec;
-        std::string content = data.substr(1, data.length() - 2);
-        size_t pos = 0;
-        size_t next;
-        int depth = 0;
-        std::string item;
-        
-        for (size_t i = 0; i < content.length(); i++) {
-            char c = content[i];
-            if (c == '[' || c == '{') depth++;
-            else if (c == ']' || c == '}') depth--;
-            else if (c == ',' && depth == 0) {
-                item = content.substr(pos, i - pos);
-                if (!item.empty()) {
-                    // get rid of whitespace
-                    item.erase(0, item.find_first_not_of(" \t"));
-                    item.erase(item.find_last_not_of(" \t") + 1);
-                    if (!item.empty())
-                        vec.push_back(Value::deserialize(item));
-                }
-                pos = i + 1;
-            }
-        }
-        
-        item = content.substr(pos);
-        // only add final item if it's not empty (for trailing commas)
-        if (!item.empty()) {
-            // get rid of whitespace
-            item.erase(0, item.find_first_not_of(" \t"));
-            item.erase(item.find_last_not_of(" \t") + 1);
-            if (!item.empty())
-                vec.push_back(Value::deserialize(item));
-        }
-            
-        return Table(vec);
-    } 
-    else if (data[0] == '{') {
-        if (data.length() < 2 || data.back() != '}') 
-            throw std::runtime_error("Malformed table");
-            
-        if (data.length() == 2) // empty table "{}"
-            return Table();
-            
-        std::map<Value, Value> map;
-        std::string content = data.substr(1, data.length() - 2);
-        size_t pos = 0;
-        size_t next;
-        int depth = 0;
-        std::string item;
-        
-        for (size_t i = 0; i < content.length(); i++) {
-            char c = content[i];
-            if (c == '[' || c == '{') depth++;
-            else if (c == ']' || c == '}') depth--;
-            else if (c == ',' && depth == 0) {
-                item = content.substr(pos, i - pos);
-                if (!item.empty()) {
-                    // Trim whitespace
-                    item.erase(0, item.find_first_not_of(" \t"));
-                    item.erase(item.find_last_not_of(" \t") + 1);
-                    if (!item.empty()) {
-                        size_t equals = item.find('=');
-                        if (equals == std::string::npos) 
-                            throw std::runtime_error("Invalid table format: missing '='");
-                        std::string key = item.substr(0, equals);
-                        std::string value = item.substr(equals + 1);
-                        // Trim whitespace from key and value
-                        key.erase(0, key.find_first_not_of(" \t"));
-                        key.erase(key.find_last_not_of(" \t") + 1);
-                        value.erase(0, value.find_first_not_of(" \t"));
-                        value.erase(value.find_last_not_of(" \t") + 1);
-                        if (!key.empty() && !value.empty())
-                            map[Value::deserialize(key)] = Value::deserialize(value);
-                    }
-                }
-                pos = i + 1;
-            }
-        }
-        
-        item = content.substr(pos);
-        // only process final item if it's not empty
-        if (!item.empty()) {
-            // get rid of whitespace
-            item.erase(0, item.find_first_not_of(" \t"));
-            item.erase(item.find_last_not_of(" \t") + 1);
-            if (!item.empty()) {
-                size_t equals = item.find('=');
-                if (equals == std::string::npos) 
-                    throw std::runtime_error("Invalid table format: missing '='");
-                std::string key = item.substr(0, equals);
-                std::string value = item.substr(equals + 1);
+    if (!dot) {
+        if (exponent || mantissa > static_cast<uint64_t>(std::numeric_limits<int>::max()) + (negative ? 1 : 0))
+            throw std::runtime_error("Malformed netvent literal: int out of range");
+        out.kind = LiteralKind::Int;
+        out.i = negative ? static_cast<int>(-static_cast<int64_t>(mantissa)) : static_cast<int>(mantissa);
+        return out;
+    }
+    double d = static_cast<double>(mantissa);
+    for (; exponent > 0; exponent--) d *= 10;
+    // one division by an exact power of ten keeps short fractions correctly rounded
+    double scale = 1;
+    for (; exponent < 0 && scale < 1e22; exponent++) scale *= 10;
+    d /= scale;
+    for (; exponent < 0; exponent++) d /= 10;
+    if (d > std::numeric_limits<float>::max()) throw std::runtime_error("Malformed netvent literal: float out of range");
+    out.kind = LiteralKind::Float;
+    out.f = static_cast<float>(negative ? -d : d);
+    return out;
+}
 
-                // get rid of whitespace
-                key.erase(0, key.find_first_not_of(" \t"));
-                key.erase(key.find_last_not_of(" \t") + 1);
-                value.erase(0, value.find_first_not_of(" \t"));
-                value.erase(value.find_last_not_of(" \t") + 1);
-                if (!key.empty() && !value.empty())
-                    map[Value::deserialize(key)] = Value::deserialize(value);
-            }
+// calls f(item) for every top level comma separated item between the brackets
+template<typename F>
+constexpr void for_each_literal_item(std::string_view content, F&& f) {
+    int depth = 0;
+    bool quoted = false;
+    size_t start = 0;
+    for (size_t i = 0; i <= content.size(); i++) {
+        char c = i < content.size() ? content[i] : ',';
+        if (quoted && c == '\\') i++;
+        else if (c == '"') quoted = !quoted;
+        else if (quoted) continue;
+        else if (c == '#') i = literal_end(content, i);
+        else if (c == '[' || c == '{') depth++;
+        else if (c == ']' || c == '}') {
+            if (--depth < 0) throw std::runtime_error("Malformed netvent literal: unbalanced brackets");
+        } else if (c == ',' && depth == 0) {
+            std::string_view item = trim_value(content.substr(start, i - start));
+            if (!item.empty()) f(item); // trailing commas are fine
+            start = i + 1;
         }
-        
-        return Table(map);
     }
-    throw std::runtime_error("Unknown type");
+    if (depth != 0 || quoted) throw std::runtime_error("Malformed netvent literal: unbalanced brackets");
 }
 
-// Implementation of comparison operators
-inline bool operator<(const Value& lhs, const Value& rhs) {
-    if (lhs.data.index() != rhs.data.index())
-        return lhs.data.index() < rhs.data.index();
-        
-    if (lhs.is_int())
-        return lhs.as_int() < rhs.as_int();
-    if (lhs.is_float())
-        return lhs.as_float() < rhs.as_float();
-    if (lhs.is_bool())
-        return lhs.as_bool() < rhs.as_bool();
-    if (lhs.is_string())
-        return lhs.as_string() < rhs.as_string();
-    if (lhs.is_table())
-        return &lhs.as_table() < &rhs.as_table(); // compare pointers for tables for now
-        
-    return false;
-}
+} // namespace detail
 
-inline bool operator==(const Value& lhs, const Value& rhs) {
-    if (lhs.data.index() != rhs.data.index())
-        return false;
-        
-    if (lhs.is_int())
-        return lhs.as_int() == rhs.as_int();
-    if (lhs.is_float())
-        return lhs.as_float() == rhs.as_float();
-    if (lhs.is_bool())
-        return lhs.as_bool() == rhs.as_bool();
-    if (lhs.is_string())
-        return lhs.as_string() == rhs.as_string();
-    if (lhs.is_table())
-        return &lhs.as_table() == &rhs.as_table(); // compare pointers for tables for now
-        
-    return true;
-}
+template<size_t N = 64>
+class LiteralEvent {
+    private:
+        std::string_view event;
+        LiteralEntry entries[N] = {};
+        size_t fields = 0;      // the event's own fields are entries[0, fields)
+        size_t used = 0;
 
-inline std::string serialize_to_netvent(const Value& event_name, const std::map<std::string, Value>& data) {
-    std::stringstream ss;
-    ss << event_name.serialize() << "\n";
+        constexpr size_t reserve(size_t n) {
+            if (used + n > N) throw std::runtime_error("netvent literal has more entries than its capacity");
+            size_t at = used;
+            used += n;
+            return at;
+        }
 
-    for (const auto& pair : data) {
-        ss << pair.first << " " << pair.second.serialize() << "\n";
-    }
+        constexpr LiteralValue parse_value(std::string_view v) {
+            v = detail::trim_value(v);
+            LiteralValue out;
+            if (v.empty()) throw std::runtime_error("Malformed netvent literal: empty value");
+            size_t bytes_at = 0, length = 0;
+            BlobText encoding = BlobText::Raw;
+            if (detail::blob_header(v, 0, bytes_at, length)) {
+                if (bytes_at + length != v.size()) throw std::runtime_error("Malformed netvent literal: blob length doesn't match its bytes");
+                out.kind = LiteralKind::Blob;
+                out.text = v.substr(bytes_at);
+            } else if (detail::encoded_blob(v, 0, encoding, bytes_at, length) && length == v.size()) {
+                // kept as written, to_value() decodes it
+                const size_t n = length - bytes_at;
+                if (encoding == BlobText::Base64 ? n % 4 || (n >= 3 && v[length - 3] == '=') : n % 2)
+                    throw std::runtime_error("Malformed netvent literal: bad base64 or hex blob");
+                out.kind = LiteralKind::Blob;
+                out.text = v;
+                out.escaped = true;
+            } else if (v == "true" || v == "false") {
+                out.kind = LiteralKind::Bool;
+                out.b = v == "true";
+            } else if (v.front() == '"') {
+                if (!detail::is_quoted(v)) throw std::runtime_error("Malformed netvent literal: unterminated string");
+                out.kind = LiteralKind::String;
+                out.text = v.substr(1, v.size() - 2);
+                out.escaped = out.text.find('\\') != std::string_view::npos;
+            } else if (v.front() == '[' || v.front() == '{') {
+                out.kind = LiteralKind::Table;
+                out.is_array = v.front() == '[';
+                if (v.size() < 2 || v.back() != (out.is_array ? ']' : '}')) throw std::runtime_error("Malformed netvent literal: unterminated table");
+                out.text = v;
+                parse_table(out);
+            } else if (v == "inf" || v == "-inf" || v == "nan") {
+                out.kind = LiteralKind::Float;
+                out.f = v == "nan" ? std::numeric_limits<float>::quiet_NaN() : v == "inf" ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+            } else if (detail::is_digit(v.front()) || v.front() == '-' || v.front() == '+' || v.front() == '.') {
+                out = detail::parse_literal_number(v);
+            } else {
+                out.kind = LiteralKind::String; // bare words are strings, like Value::deserialize
+                out.text = v;
+            }
+            return out;
+        }
 
-    return ss.str();
-}
+        // children get a contiguous block first, then grandchildren go after it
+        constexpr void parse_table(LiteralValue& table) {
+            std::string_view content = table.text.substr(1, table.text.size() - 2);
+            size_t n = 0;
+            detail::for_each_literal_item(content, [&n](std::string_view) { n++; });
+            table.first = reserve(n);
+            table.count = n;
+            size_t at = table.first;
+            detail::for_each_literal_item(content, [&](std::string_view item) {
+                LiteralEntry& e = entries[at];
+                if (table.is_array) {
+                    e.key.i = static_cast<int>(at - table.first);
+                    e.value = parse_value(item);
+                } else {
+                    size_t equals = detail::find_unquoted(item, '=');
+                    if (equals == std::string_view::npos) throw std::runtime_error("Malformed netvent literal: missing '='");
+                    e.key = parse_value(item.substr(0, equals));
+                    if (e.key.is_table()) throw std::runtime_error("Malformed netvent literal: table used as a key");
+                    e.value = parse_value(item.substr(equals + 1));
+                    for (size_t j = table.first; j < at; j++)
+                        if (entries[j].key.same_key(e.key)) throw std::runtime_error("Malformed netvent literal: repeated key");
+                }
+                at++;
+            });
+        }
 
-inline std::pair<Value, std::map<std::string, Value>> deserialize_from_netvent(std::string data) {
-    std::map<std::string, Value> result;
-    std::stringstream ss(data);
-    std::string line;
-    Value event_name;
+        constexpr const LiteralEntry* find_entry(size_t first, size_t count, const LiteralValue& key) const {
+            for (size_t j = first; j < first + count; j++)
+                if (entries[j].key.same_key(key)) return &entries[j];
+            return nullptr;
+        }
 
-    // get out the comments and tabs
-    while (std::getline(ss, line)) {
-        line.erase(0, line.find_first_not_of(" \t"));
-        
-        size_t comment_pos = line.find("//");
-        if (comment_pos != std::string::npos) {
-            line = line.substr(0, comment_pos);
+        static constexpr LiteralValue string_key(std::string_view key) {
+            LiteralValue k;
+            k.kind = LiteralKind::String;
+            k.text = key;
+            return k;
         }
-        
-        line.erase(line.find_last_not_of(" \t") + 1);
-        
-        if (line.empty() || line.substr(0, 2) == "//" || line[0] == '#') 
-            continue;
-            
-        event_name = Value::deserialize(line);
-        break;
-    }
 
-    // process kv pairs
-    while (std::getline(ss, line)) {
-        line.erase(0, line.find_first_not_of(" \t"));
-        
-        // remove inline comments
-        size_t comment_pos = line.find("//");
-        if (comment_pos != std::string::npos) {
-            line = line.substr(0, comment_pos);
-            line.erase(line.find_last_not_of(" \t") + 1);
+    public:
+        constexpr explicit LiteralEvent(std::string_view text) {
+            detail::LineReader lines(text);
+            std::string_view name, key, value;
+            if (!lines.event(name)) throw std::runtime_error("Malformed netvent literal: no event name");
+            event = detail::unquote(name);
+
+            detail::LineReader counter = lines;
+            while (counter.next(key, value)) fields++;
+            size_t at = reserve(fields);
+            while (lines.next(key, value)) {
+                LiteralEntry& e = entries[at];
+                e.key = string_key(key);
+                e.value = parse_value(value);
+                for (size_t j = 0; j < at; j++)
+                    if (entries[j].key.same_key(e.key)) throw std::runtime_error("Malformed netvent literal: repeated key");
+                at++;
+            }
         }
-        
-        // skip empty lines or comments
-        if (line.empty() || line.substr(0, 2) == "//" || line[0] == '#') 
-            continue;
 
-        // find the space between key and value
-        size_t space_pos = line.find(' ');
-        if (space_pos == std::string::npos) 
-            continue;
+        constexpr std::string_view name() const { return event; }
+        constexpr size_t size() const { return fields; }
+        constexpr const LiteralEntry* begin() const { return entries; }
+        constexpr const LiteralEntry* end() const { return entries + fields; }
 
-        std::string key = line.substr(0, space_pos);
-        // find first non-whitespace character after key
-        size_t value_start = line.find_first_not_of(" \t", space_pos);
-        if (value_start == std::string::npos) 
-            continue;
-            
-        std::string value = line.substr(value_start);
-        result[key] = Value::deserialize(value);
-    }
+        constexpr bool contains(std::string_view key) const {
+            return find_entry(0, fields, string_key(key)) != nullptr;
+        }
 
-    return std::make_pair(event_name, result);
-}
+        constexpr LiteralValue operator[](std::string_view key) const {
+            const LiteralEntry* e = find_entry(0, fields, string_key(key));
+            if (!e) throw std::runtime_error("Key not found in netvent literal");
+            return e->value;
+        }
 
-inline std::string to_string(const Value& value) {
-    return value.serialize();
-}
+        // nested tables: by string key, or by position for arrays
+        constexpr LiteralValue at(const LiteralValue& table, std::string_view key) const {
+            const LiteralEntry* e = find_entry(table.first, table.is_table() ? table.count : 0, string_key(key));
+            if (!e) throw std::runtime_error("Key not found in netvent literal");
+            return e->value;
+        }
 
-inline std::string to_string(const Table& table) {
-    return table.serialize();
-}
+        constexpr LiteralValue at(const LiteralValue& table, size_t index) const {
+            if (!table.is_table() || index >= table.count) throw std::runtime_error("Index out of range in netvent literal");
+            return entries[table.first + index].value;
+        }
 
-inline Value from_string(const std::string& str) {
-    return Value::deserialize(str);
-}
+        Value to_value(const LiteralValue& v) const {
+            switch (v.kind) {
+                case LiteralKind::Int: return Value(v.i);
+                case LiteralKind::Float: return Value(v.f);
+                case LiteralKind::Bool: return Value(v.b);
+                case LiteralKind::String: return Value(v.escaped ? detail::unescape(v.text) : std::string(v.text));
+                case LiteralKind::Blob: {
+                    if (!v.escaped) return Value(Blob(v.text.data(), v.text.size()));
+                    std::string bytes;
+                    detail::decode_encoded_blob(v.text, bytes);
+                    return Value(Blob(std::move(bytes)));
+                }
+                case LiteralKind::Table: {
+                    Table t = v.is_array ? Table(std::vector<Value>()) : Table();
+                    for (size_t j = v.first; j < v.first + v.count; j++) t[to_value(entries[j].key)] = to_value(entries[j].value);
+                    return Value(t);
+                }
+            }
+            return Value();
+        }
 
-template<typename T>
-inline Value val(T&& v) {
-    return Value(std::forward<T>(v));
-}
+        // the same pair deserialize_from_netvent gives for the text
+        std::pair<Value, std::map<std::string, Value>> to_event() const {
+            std::map<std::string, Value> data;
+            for (const auto& e : *this) data[std::string(e.key.text)] = to_value(e.value);
+            return {Value(std::string(event)), std::move(data)};
+        }
+};
 
-// Shorthand for creating tables
-inline Table arr_table(std::initializer_list<Value> init) {
-    return Table(init);
-}
+inline namespace literals {
 
-inline Table map_table(std::initializer_list<std::pair<const char*, Value>> init) {
-    return Table(init);
+constexpr LiteralEvent<> operator""_nv(const char* text, size_t size) {
+    return LiteralEvent<>(std::string_view(text, size));
 }
 
+} // namespace literals
+
 } // namespace netvent
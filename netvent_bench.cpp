@@ -0,0 +1,283 @@
+#include "netvent.hpp"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+using namespace netvent;
+
+// times the query, int text, line, string, utf-8 and base64/hex kernels at every simd level this
+// cpu runs, the float text codec, blob decoding, gathered rope output, table inserts, content
+// hashing, the table store and table updates
+// usage: netvent_bench [rows]
+
+template<typename F>
+double best_ms(F&& f) {
+    double best = 1e30;
+    for (int r = 0; r < 5; r++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    const size_t n = argc > 1 ? static_cast<size_t>(std::stoul(argv[1])) : size_t(1) << 22;
+    std::vector<int> ints(n);
+    std::vector<float> floats(n);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        ints[i] = static_cast<int>(seed >> 12);
+        floats[i] = static_cast<float>(seed >> 8) * 1e-3f;
+    }
+
+    std::cout << "active kernels: " << simd_level_name(simd_level())
+              << " (cpu supports " << simd_level_name(supported_simd_level()) << ")" << std::endl;
+    std::cout << n << " rows, best of 5, ms" << std::endl;
+    std::cout << "level      filter_int  filter_float  count  sum_int  sum_float  max_int" << std::endl;
+
+    const SimdLevel active = simd_level();
+    std::vector<uint8_t> sel(n);
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > supported_simd_level()) break;
+        force_simd_level(level);
+        volatile double sink = 0;
+        double fi = best_ms([&] { std::fill(sel.begin(), sel.end(), 1); detail::filter_int(ints.data(), n, CompareOp::Gt, 1 << 19, sel.data()); });
+        double ff = best_ms([&] { std::fill(sel.begin(), sel.end(), 1); detail::filter_float(floats.data(), n, CompareOp::Lt, 8000.0f, sel.data()); });
+        double cm = best_ms([&] { sink = sink + detail::count_mask(sel.data(), n); });
+        double si = best_ms([&] { sink = sink + detail::sum_int(ints.data(), sel.data(), n); });
+        double sf = best_ms([&] { sink = sink + detail::sum_float(floats.data(), sel.data(), n); });
+        double mi = best_ms([&] { sink = sink + detail::extreme_int(ints.data(), sel.data(), n, true); });
+        std::printf("%-10s %10.2f %13.2f %6.2f %8.2f %10.2f %8.2f\n", simd_level_name(level), fi, ff, cm, si, sf, mi);
+    }
+
+    // ints spread over every digit count
+    std::vector<int> mixed(n);
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        mixed[i] = static_cast<int>(seed) >> (i % 31);
+    }
+    std::string text;
+    detail::append_ints(text, mixed.data(), n, ' ');
+    std::vector<std::string_view> tokens;
+    for (size_t start = 0; start < text.size();) {
+        size_t space = std::min(text.find(' ', start), text.size());
+        tokens.push_back(std::string_view(text).substr(start, space - start));
+        start = space + 1;
+    }
+
+    std::cout << std::endl << "level      append_ints  parse_int" << std::endl;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > supported_simd_level()) break;
+        force_simd_level(level);
+        volatile int sink = 0;
+        double fmt = best_ms([&] { std::string out; detail::append_ints(out, mixed.data(), n, ' '); sink = sink + static_cast<int>(out.size()); });
+        double parse = best_ms([&] {
+            int total = 0, v = 0;
+            for (std::string_view t : tokens) total += detail::parse_int(t, v) ? v : 0;
+            sink = sink + total;
+        });
+        std::printf("%-10s %11.2f %10.2f\n", simd_level_name(level), fmt, parse);
+    }
+    force_simd_level(active);
+
+    // physics-like floats against the old fixed/stof path
+    std::vector<float> positions(n);
+    for (size_t i = 0; i < n; i++) positions[i] = static_cast<float>(mixed[i] % 100000) / 64.0f;
+    std::string float_text;
+    detail::append_floats(float_text, positions.data(), n, ' ');
+    std::vector<std::string> float_tokens;
+    for (size_t start = 0; start < float_text.size();) {
+        size_t space = std::min(float_text.find(' ', start), float_text.size());
+        float_tokens.push_back(float_text.substr(start, space - start));
+        start = space + 1;
+    }
+    volatile float fsink = 0;
+    double fmt = best_ms([&] { std::string out; detail::append_floats(out, positions.data(), n, ' '); fsink = fsink + static_cast<float>(out.size()); });
+    double old_fmt = best_ms([&] {
+        std::string out;
+        char buf[64];
+        for (float v : positions) {
+            out.append(buf, std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::fixed, 1).ptr);
+            out += ' ';
+        }
+        fsink = fsink + static_cast<float>(out.size());
+    });
+    double parse = best_ms([&] {
+        float total = 0, v = 0;
+        for (const std::string& t : float_tokens) total += detail::parse_float(t, v) ? v : 0;
+        fsink = fsink + total;
+    });
+    double old_parse = best_ms([&] {
+        float total = 0;
+        for (const std::string& t : float_tokens) total += std::stof(t);
+        fsink = fsink + total;
+    });
+    std::cout << std::endl << "floats     append_floats  parse_float" << std::endl;
+    std::printf("%-10s %13.2f %12.2f\n", "netvent", fmt, parse);
+    std::printf("%-10s %13.2f %12.2f\n", "to_chars/stof", old_fmt, old_parse);
+
+    // the same event hand-edited (indents, comments) and compact
+    std::string compact = "\"physics\"\n", commented = "// physics tick\n\"physics\" // event\n\n";
+    for (int f = 0; f < 24; f++) {
+        std::string key = "field_" + std::to_string(f), value = std::to_string(f * 31) + "." + std::to_string(f);
+        compact += key + " " + value + "\n";
+        commented += "    " + key + "\t" + value + "   // the " + key + ", in world units\n";
+        if (f % 6 == 0) commented += "\n    # section " + std::to_string(f / 6) + "\n";
+    }
+    const int events = static_cast<int>(std::max<size_t>(n / 256, 1));
+    std::cout << std::endl << events << " events, level      compact  commented" << std::endl;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > supported_simd_level()) break;
+        force_simd_level(level);
+        volatile size_t sink = 0;
+        double plain = best_ms([&] { for (int e = 0; e < events; e++) sink = sink + deserialize_from_netvent(compact).second.size(); });
+        double noisy = best_ms([&] { for (int e = 0; e < events; e++) sink = sink + deserialize_from_netvent(commented).second.size(); });
+        std::printf("%-10s %17.2f %10.2f\n", simd_level_name(level), plain, noisy);
+    }
+    force_simd_level(active);
+
+    // chat lines, mostly clean and a few with quotes and newlines to escape
+    std::vector<Value> chat;
+    for (size_t i = 0; i < std::max<size_t>(n / 64, 1); i++) {
+        std::string line = "player_" + std::to_string(i % 97) + ": the quick brown fox jumps over the lazy dog again and again";
+        if (i % 8 == 0) line += " \"quoted\"\nnext line";
+        chat.push_back(Value(line));
+    }
+    std::cout << std::endl << chat.size() << " strings, level  serialize  round trip" << std::endl;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > supported_simd_level()) break;
+        force_simd_level(level);
+        volatile size_t sink = 0;
+        double write = best_ms([&] { for (const Value& v : chat) sink = sink + v.serialize().size(); });
+        double both = best_ms([&] { for (const Value& v : chat) sink = sink + Value::deserialize(v.serialize()).as_string().size(); });
+        std::printf("%-10s %16.2f %11.2f\n", simd_level_name(level), write, both);
+    }
+    force_simd_level(active);
+
+    // utf-8 checks over chat text, mostly ascii with some accents and emoji
+    std::string chat_text;
+    for (const Value& v : chat) chat_text += v.as_string() + (chat_text.size() % 3 ? " caf\xc3\xa9 " : " \xf0\x9f\x99\x82 ");
+    std::cout << std::endl << chat_text.size() / 1000 << " kb, level  valid_utf8 (GB/s)" << std::endl;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > supported_simd_level()) break;
+        force_simd_level(level);
+        volatile bool sink = false;
+        double ms = best_ms([&] { for (int r = 0; r < 20; r++) sink = sink ^ detail::valid_utf8(chat_text); });
+        std::printf("%-10s %17.2f\n", simd_level_name(level), 20.0 * chat_text.size() / (ms * 1e6));
+    }
+    force_simd_level(active);
+
+    // a 64 kb map chunk as a blob against the same bytes as an escaped string
+    std::string chunk(size_t(1) << 16, 'x');
+    for (size_t i = 0; i < chunk.size(); i += 13) chunk[i] = static_cast<char>(i);
+    const std::string as_blob = serialize_to_netvent(Value("map_chunk"), {{"id", Value(9)}, {"data", Value(Blob(chunk))}});
+    const std::string as_string = serialize_to_netvent(Value("map_chunk"), {{"id", Value(9)}, {"data", Value(chunk)}});
+    auto shared_blob = std::make_shared<const std::string>(as_blob);
+    volatile size_t chunk_sink = 0;
+    double blob_ms = best_ms([&] { for (int r = 0; r < 200; r++) chunk_sink = chunk_sink + deserialize_from_netvent(as_blob).second.size(); });
+    double shared_ms = best_ms([&] { for (int r = 0; r < 200; r++) chunk_sink = chunk_sink + deserialize_from_netvent(shared_blob).second.size(); });
+    double string_ms = best_ms([&] { for (int r = 0; r < 200; r++) chunk_sink = chunk_sink + deserialize_from_netvent(as_string).second.size(); });
+    std::cout << std::endl << "200 x 64 kb chunks     blob  blob (shared)  string" << std::endl;
+    std::printf("%-18s %8.2f %14.2f %7.2f\n", "decode", blob_ms, shared_ms, string_ms);
+
+    // the same chunk as printable text, GB/s of raw bytes
+    std::cout << std::endl << "64 kb chunk, level  base64 out  base64 in  hex out  hex in (GB/s)" << std::endl;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > supported_simd_level()) break;
+        force_simd_level(level);
+        std::string base64, hex, back;
+        detail::append_base64(base64, chunk);
+        detail::append_hex(hex, chunk);
+        auto rate = [&](auto&& f) { return 200.0 * chunk.size() / (best_ms([&] { for (int r = 0; r < 200; r++) f(); }) * 1e6); };
+        double base64_out = rate([&] { back.clear(); detail::append_base64(back, chunk); });
+        double base64_in = rate([&] { back.clear(); detail::decode_base64(base64, back); });
+        double hex_out = rate([&] { back.clear(); detail::append_hex(back, chunk); });
+        double hex_in = rate([&] { back.clear(); detail::decode_hex(hex, back); });
+        std::printf("%-18s %11.2f %10.2f %8.2f %7.2f\n", simd_level_name(level), base64_out, base64_in, hex_out, hex_in);
+    }
+    force_simd_level(active);
+
+    // a 4 mb chat history built from 64 kb received segments: joined into a string and
+    // serialized, against kept as a rope and gathered
+    std::vector<std::shared_ptr<const std::string>> segments;
+    for (int i = 0; i < 64; i++) segments.push_back(std::make_shared<const std::string>(size_t(1) << 16, static_cast<char>('a' + i % 26)));
+    volatile size_t history_sink = 0;
+    double joined_ms = best_ms([&] {
+        std::string history;
+        for (const auto& segment : segments) history += *segment;
+        history_sink = history_sink + serialize_to_netvent(Value("chat_log"), {{"history", Value(history)}}).size();
+    });
+    double gathered_ms = best_ms([&] {
+        Rope history;
+        for (const auto& segment : segments) history.append(Blob(segment, 0, segment->size()));
+        GatherOutput out;
+        serialize_to_netvent(Value("chat_log"), {{"history", Value(history)}}, out);
+        history_sink = history_sink + out.pieces().size();
+    });
+    std::cout << std::endl << "4 mb history       string    rope (gathered)" << std::endl;
+    std::printf("%-18s %6.2f %18.3f\n", "serialize (ms)", joined_ms, gathered_ms);
+
+    // building and reading a map of string keys, sorted against insertion-ordered
+    std::vector<Value> keys;
+    for (size_t i = 0; i < 100000; i++) keys.push_back(Value("field_" + std::to_string(i * 2654435761u % 1000003)));
+    std::cout << std::endl << "100k keys          insert  lookup (ms)" << std::endl;
+    for (TableOrder order : {TableOrder::Sorted, TableOrder::Insertion}) {
+        Table table(order);
+        double insert_ms = best_ms([&] {
+            table = Table(order);
+            for (size_t i = 0; i < keys.size(); i++) table[keys[i]] = Value(static_cast<int>(i));
+        });
+        volatile int found = 0;
+        double lookup_ms = best_ms([&] { for (const Value& key : keys) found = found + table.find(key)->as_int(); });
+        std::printf("%-18s %6.2f %7.2f\n", order == TableOrder::Sorted ? "sorted" : "insertion order", insert_ms, lookup_ms);
+    }
+
+    // a map of 1024 small tiles plus the 64 kb chunk, hashed alone and with its canonical text
+    Table tiles(std::vector<Value>{});
+    for (int i = 0; i < 1024; i++) {
+        Table tile;
+        tile[Value("kind")] = Value(i % 7);
+        tile[Value("height")] = Value(0.5f * static_cast<float>(i % 13));
+        tile[Value("name")] = Value("grass");
+        tiles.push_back(Value(tile));
+    }
+    Table map_data;
+    map_data[Value("tiles")] = Value(tiles);
+    map_data[Value("chunk")] = Value(Blob(chunk));
+    volatile uint64_t hash_sink = 0;
+    double hash_ms = best_ms([&] { for (int r = 0; r < 20; r++) hash_sink = hash_sink ^ content_hash(map_data); });
+    double canonical_ms = best_ms([&] { for (int r = 0; r < 20; r++) hash_sink = hash_sink ^ serialize_canonical(map_data).size(); });
+    double plain_ms = best_ms([&] { for (int r = 0; r < 20; r++) hash_sink = hash_sink ^ map_data.serialize().size(); });
+    std::cout << std::endl << "20 x map data      hash  canonical  serialize" << std::endl;
+    std::printf("%-18s %4.2f %10.2f %10.2f\n", "ms", hash_ms, canonical_ms, plain_ms);
+
+    // the tiles read 20 times, parsed each time against through a store
+    const std::string tiles_text = tiles.serialize();
+    double parse_ms = best_ms([&] { for (int r = 0; r < 20; r++) hash_sink = hash_sink ^ Table::deserialize(tiles_text).size(); });
+    TableStore store;
+    double store_ms = best_ms([&] { for (int r = 0; r < 20; r++) hash_sink = hash_sink ^ store.deserialize(tiles_text)->size(); });
+    std::cout << std::endl << "20 x 1024 tiles    parse  store  distinct tables" << std::endl;
+    std::printf("%-18s %5.2f %6.2f %16zu\n", "ms", parse_ms, store_ms, store.size());
+
+    // 100k hp updates over 1000 players of 64 fields: copying each player's table out and back in
+    // by hand, against update_path
+    Table players;
+    for (int id = 0; id < 1000; id++) {
+        Table player;
+        for (int f = 0; f < 64; f++) player[Value("field_" + std::to_string(f))] = Value(f);
+        players[Value(id)] = Value(player);
+    }
+    double by_hand_ms = best_ms([&] {
+        for (int r = 0; r < 100000; r++) {
+            Table player = players[Value(r % 1000)].as_table();
+            player[Value("field_7")] = Value(r);
+            players[Value(r % 1000)] = Value(player);
+        }
+    });
+    double path_ms = best_ms([&] { for (int r = 0; r < 100000; r++) players.update_path({Value(r % 1000), Value("field_7")}, Value(r)); });
+    std::cout << std::endl << "100k updates       by hand  update_path" << std::endl;
+    std::printf("%-18s %7.2f %12.2f\n", "ms", by_hand_ms, path_ms);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "netvent.hpp"
+#include <fstream>
+#include <iostream>
+using namespace netvent;
+
+// turns a .nvs schema into a header of structs with their own encoders and decoders
+// usage: netvent_gen schema.nvs [output.hpp] [--namespace name]
+
+int main(int argc, char** argv) {
+    std::vector<std::string> paths;
+    std::string ns;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--namespace" && i + 1 < argc) ns = argv[++i];
+        else paths.push_back(arg);
+    }
+
+    if (paths.empty() || paths.size() > 2) {
+        std::cerr << "usage: netvent_gen schema.nvs [output.hpp] [--namespace name]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(paths[0]);
+    if (!in) {
+        std::cerr << "netvent_gen: could not open " << paths[0] << std::endl;
+        return 1;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+
+    std::string code;
+    try {
+        code = generate_cpp(parse_schema(text.str()), ns);
+    } catch (const std::exception& e) {
+        std::cerr << paths[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    // default output sits next to the schema
+    std::string output = paths.size() == 2 ? paths[1] : paths[0] + ".hpp";
+    std::ofstream out(output);
+    out << code;
+    if (!out) {
+        std::cerr << "netvent_gen: could not write " << output << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+#include "netvent.hpp"
+#include <iostream>
+using namespace netvent;
+
+// sorts or merges framed event logs by a numeric field
+// usage: netvent_sort [--key field] [--memory MB] [--merge] output input...
+
+int main(int argc, char** argv) {
+    SortOptions options;
+    bool merge_only = false;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--key" && i + 1 < argc) {
+            options.key = argv[++i];
+        } else if (arg == "--memory" && i + 1 < argc) {
+            options.memory_limit = static_cast<size_t>(std::stoul(argv[++i])) << 20;
+        } else if (arg == "--merge") {
+            merge_only = true; // inputs are already sorted, skip the run phase
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.size() < 2) {
+        std::cerr << "usage: netvent_sort [--key field] [--memory MB] [--merge] output input..." << std::endl;
+        return 1;
+    }
+
+    std::string output = paths[0];
+    std::vector<std::string> inputs(paths.begin() + 1, paths.end());
+    try {
+        if (merge_only) merge_event_logs(inputs, output, options);
+        else sort_event_logs(inputs, output, options);
+    } catch (const std::exception& e) {
+        std::cerr << "netvent_sort: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,6 +1,9 @@
 #include "netvent.hpp"
 #include <cassert>
 #include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <filesystem>
 
 using namespace netvent;
 
@@ -361,17 +364,1672 @@ void test_hassle_free_api() {
     assert(val(true).is_bool());
 }
 
+void test_query_engine() {
+    // a few batches of shots, big enough to go through the vector loops and their tails
+    std::vector<EventBatch> batches(3);
+    const char* players[] = {"alice", "bob", "carol"};
+    int expected_shots[3] = {0, 0, 0};
+    int expected_far = 0;
+    float velocity_sum = 0;
+    int velocity_count = 0;
+    for (int i = 0; i < 301; i++) {
+        EventBatch& batch = batches[i % 3];
+        if (i % 5 == 0) {
+            batch.append(Value("move"), {{"player", Value(players[i % 3])}, {"velocity", Value(i * 0.5f)}});
+            velocity_sum += i * 0.5f;
+            velocity_count++;
+            continue;
+        }
+        batch.append(Value("shoot"), {{"player", Value(players[i % 3])}, {"x", Value(i)}});
+        expected_shots[i % 3]++;
+        if (i > 100) expected_far++;
+    }
+
+    Query shots;
+    shots.where_event("shoot").group_by("player").aggregate(AggregateOp::Count);
+    QueryResult per_player = shots.run(batches, 2);
+    assert(per_player.size() == 3);
+    for (int p = 0; p < 3; p++) {
+        assert(per_player[Value(players[p])][0].as_int() == expected_shots[p]);
+    }
+
+    Query far;
+    far.where("x", CompareOp::Gt, 100).aggregate(AggregateOp::Count).aggregate(AggregateOp::Min, "x").aggregate(AggregateOp::Max, "x");
+    QueryResult far_result = far.run(batches);
+    assert(far_result[Value()][0].as_int() == expected_far);
+    assert(far_result[Value()][1].as_int() == 101);
+    assert(far_result[Value()][2].as_int() == 299);
+
+    Query velocity;
+    velocity.group_by_event().aggregate(AggregateOp::Avg, "velocity").aggregate(AggregateOp::Sum, "x");
+    QueryResult by_event = velocity.run(batches);
+    assert(by_event.size() == 2);
+    float avg = by_event[Value("move")][0].as_float();
+    assert(avg > velocity_sum / velocity_count - 0.01f && avg < velocity_sum / velocity_count + 0.01f);
+    assert(by_event[Value("shoot")][1].as_int() == 300 * 301 / 2 - 150 * 61);
+
+    // rows keep their fields when read back
+    auto [name, data] = batches[0].row(1);
+    assert(name.as_string() == "shoot");
+    assert(data["x"].as_int() == 3);
+    assert(data.find("velocity") == data.end());
+
+    // rows whose field isn't a number are counted, but left out of the arithmetic
+    EventBatch mixed;
+    mixed.append(Value("hit"), {{"x", Value(10)}, {"tag", Value("a")}});
+    mixed.append(Value("hit"), {{"x", Value("oops")}, {"tag", Value("b")}});
+    Query stats;
+    stats.aggregate(AggregateOp::Count, "x").aggregate(AggregateOp::Avg, "x").aggregate(AggregateOp::Min, "x")
+         .aggregate(AggregateOp::Max, "tag").aggregate(AggregateOp::Avg, "tag").aggregate(AggregateOp::Sum, "tag");
+    for (const auto& [key, row] : {*stats.run(mixed).begin(), *stats.group_by_event().run(mixed).begin()}) {
+        assert(row[0].as_int() == 2 && row[1].as_float() == 10.0f && row[2].as_int() == 10);
+        assert(row[3] == Value() && row[4] == Value() && row[5] == Value());
+    }
+}
+
+void test_archive() {
+    const std::string path = "test_archive.nva";
+    std::string text_size_check;
+    {
+        ArchiveWriter writer(path, 100);
+        for (int i = 0; i < 250; i++) {
+            std::map<std::string, Value> data = {
+                {"tick", Value(1000 + i)},
+                {"x", Value(i * 0.25f)},
+                {"alive", Value(i % 7 != 0)},
+                {"player", Value(i % 2 ? "alice" : "bob")}
+            };
+            if (i % 10 == 0) data["loot"] = Value(map_table({{"item", "sword"}}));
+            if (i == 3) data["odd"] = Value("three");
+            if (i == 4) data["odd"] = Value(4);
+            text_size_check += serialize_to_netvent(Value(i % 3 ? "move" : "shoot"), data);
+            writer.append(Value(i % 3 ? "move" : "shoot"), data);
+        }
+    }
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    assert(static_cast<size_t>(file.tellg()) * 3 < text_size_check.size());
+
+    ArchiveReader reader(path);
+    assert(reader.row_group_count() == 3);
+    assert(reader.rows(2) == 50);
+
+    // every row comes back the way it went in
+    int i = 0;
+    for (size_t g = 0; g < reader.row_group_count(); g++) {
+        EventBatch batch = reader.read_row_group(g);
+        for (size_t r = 0; r < batch.size(); r++, i++) {
+            auto [name, data] = batch.row(r);
+            assert(name.as_string() == (i % 3 ? "move" : "shoot"));
+            assert(data["tick"].as_int() == 1000 + i);
+            assert(data["x"].as_float() == i * 0.25f);
+            assert(data["alive"].as_bool() == (i % 7 != 0));
+            assert(data["player"].as_string() == (i % 2 ? "alice" : "bob"));
+            assert((data.find("loot") != data.end()) == (i % 10 == 0));
+            if (i % 10 == 0) assert(data["loot"].as_table()["item"].as_string() == "sword");
+            if (i == 3) assert(data["odd"].as_string() == "three");
+            if (i == 4) assert(data["odd"].as_int() == 4);
+        }
+    }
+    assert(i == 250);
+
+    // projections only load what was asked for
+    EventBatch ticks = reader.read_columns(1, {"tick"});
+    assert(ticks.size() == 100 && ticks.get_columns().size() == 1);
+    assert(reader.stats(1).at("tick").min == 1100 && reader.stats(1).at("tick").max == 1199);
+
+    Query late;
+    late.where("tick", CompareOp::Ge, 1200).group_by("player").aggregate(AggregateOp::Count);
+    QueryResult result = reader.scan(late);
+    assert(result[Value("alice")][0].as_int() == 25);
+    assert(result[Value("bob")][0].as_int() == 25);
+
+    // a NaN leaves its row group without a range, so filters can't skip it
+    {
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        EventBatch batch;
+        ArchiveWriter writer(path);
+        for (float x : {nan, 1.0f}) {
+            batch.append(Value("move"), {{"x", Value(x)}});
+            writer.append(Value("move"), {{"x", Value(x)}});
+        }
+        writer.close();
+        Query below;
+        below.where("x", CompareOp::Lt, 5.0f).aggregate(AggregateOp::Count);
+        assert(below.run(batch)[Value()][0].as_int() == 1);
+        ArchiveReader nan_reader(path);
+        assert(!nan_reader.stats(0).at("x").has_range);
+        assert(nan_reader.scan(below)[Value()][0].as_int() == 1);
+    }
+
+    // broken lengths anywhere in the file are turned down before anything is allocated for them
+    {
+        ArchiveWriter writer(path, 2);
+        for (int i = 0; i < 5; i++)
+            writer.append(Value(i % 2 ? "move" : "shoot"), {{"tick", Value(i)}, {"x", Value(i * 0.5f)}, {"odd", i == 3 ? Value(1) : Value("s")}});
+    }
+    std::string good;
+    {
+        std::ifstream in(path, std::ios::binary);
+        good.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    int rejected = 0;
+    for (size_t at = 0; at < good.size(); at++) {
+        for (const std::string& patch : {std::string("\xff"), std::string("\x7f"), std::string(1, '\0'), std::string("\xff\xff\xff\xff\xff\x7f")}) {
+            std::string bad = good;
+            bad.replace(at, std::min(patch.size(), bad.size() - at), patch.substr(0, bad.size() - at));
+            {
+                std::ofstream out(path, std::ios::binary | std::ios::trunc);
+                out << bad;
+            }
+            try {
+                ArchiveReader broken(path);
+                for (size_t g = 0; g < broken.row_group_count(); g++) broken.read_row_group(g);
+            } catch (const std::runtime_error&) {
+                rejected++;
+            }
+        }
+    }
+    assert(rejected > 0);
+
+    // a version this reader doesn't know is turned down
+    {
+        std::fstream patch(path, std::ios::binary | std::ios::in | std::ios::out);
+        patch.seekp(4);
+        patch.put('\x02');
+    }
+    bool threw = false;
+    try { ArchiveReader newer(path); } catch (const std::runtime_error& e) { threw = std::string(e.what()).find("version") != std::string::npos; }
+    assert(threw);
+    std::remove(path.c_str());
+}
+
+void test_event_log_index() {
+    const std::string path = "test_events.nvl";
+    IndexOptions options;
+    options.fields = {"player", "session"};
+    options.range_fields = {"t"};
+    options.max_values = 50;
+    options.block_size = 64;
+    {
+        EventLogWriter writer(path, options);
+        for (int i = 0; i < 20000; i++) {
+            writer.write(Value(i % 4 ? "move" : "shoot"), {
+                {"player", Value(i % 3 ? "alice" : "bob")},
+                {"session", Value(i)}, // too many values, gets dropped from the index
+                {"t", Value(i * 10)}
+            });
+        }
+    }
+
+    EventLogIndex index = EventLogIndex::load(path + ".idx");
+    assert(index.size() == 20000);
+    assert(index.has_field("player") && !index.has_field("session"));
+
+    // bob's shots between t=5000 and t=9000
+    RoaringBitmap hits = index.equals("player", "bob") & index.events("shoot") & index.range("t", 5000, 9000);
+    EventLogReader reader(path);
+    int matched = 0;
+    for (auto& [name, data] : reader.read(index, hits)) {
+        assert(name.as_string() == "shoot" && data["player"].as_string() == "bob");
+        if (data["t"].as_int() >= 5000 && data["t"].as_int() <= 9000) matched++;
+    }
+    int expected = 0;
+    for (int i = 500; i <= 900; i++) if (i % 4 == 0 && i % 3 == 0) expected++;
+    assert(matched == expected);
+    assert(hits.cardinality() < 100);
+
+    // bitmap containers switch between arrays and bitmaps
+    RoaringBitmap alice = index.equals("player", "alice");
+    assert(alice.cardinality() == 20000 - 6667);
+    assert((alice | index.equals("player", "bob")).cardinality() == 20000);
+    assert((alice & index.equals("player", "bob")).empty());
+
+    // plain sequential reads still work without the index
+    EventLogReader again(path);
+    std::pair<Value, std::map<std::string, Value>> event;
+    int count = 0;
+    while (again.next(event)) count++;
+    assert(count == 20000);
+    std::remove(path.c_str());
+    std::remove((path + ".idx").c_str());
+}
+
+void test_sort_event_logs() {
+    // two shards with shuffled timestamps, sorted with a tiny memory limit so it spills runs
+    std::vector<std::string> shards = {"test_shard0.nvl", "test_shard1.nvl"};
+    for (size_t s = 0; s < shards.size(); s++) {
+        EventLogWriter writer(shards[s]);
+        for (int i = 0; i < 500; i++) {
+            int t = (i * 7919 + static_cast<int>(s) * 13) % 1000;
+            writer.write(Value("tick"), {{"t", Value(t)}, {"shard", Value(static_cast<int>(s))}});
+        }
+    }
+
+    SortOptions options;
+    options.key = "t";
+    options.memory_limit = 2048;
+    options.max_fan_in = 4;
+    sort_event_logs(shards, "test_sorted.nvl", options);
+
+    EventLogReader reader("test_sorted.nvl");
+    std::pair<Value, std::map<std::string, Value>> event;
+    int count = 0, last = -1;
+    while (reader.next(event)) {
+        assert(event.second["t"].as_int() >= last);
+        last = event.second["t"].as_int();
+        count++;
+    }
+    assert(count == 1000);
+
+    // merging sorted logs keeps the order too
+    merge_event_logs({"test_sorted.nvl", "test_sorted.nvl"}, "test_merged.nvl", options);
+    EventLogReader merged("test_merged.nvl");
+    count = 0;
+    last = -1;
+    while (merged.next(event)) {
+        assert(event.second["t"].as_int() >= last);
+        last = event.second["t"].as_int();
+        count++;
+    }
+    assert(count == 2000);
+
+    // NaN keys sort first with the events that have no key, the rest stay in order
+    {
+        EventLogWriter writer("test_shard0.nvl");
+        for (int i = 0; i < 500; i++) {
+            float t = i % 5 == 0 ? std::numeric_limits<float>::quiet_NaN() : static_cast<float>((i * 7919) % 1000);
+            writer.write(Value("tick"), {{"t", Value(t)}});
+        }
+    }
+    sort_event_logs({"test_shard0.nvl"}, "test_sorted.nvl", options);
+    EventLogReader nan_sorted("test_sorted.nvl");
+    int nans = 0;
+    float previous = -1;
+    while (nan_sorted.next(event)) {
+        const float t = event.second["t"].as_float();
+        if (std::isnan(t)) {
+            assert(previous < 0);
+            nans++;
+            continue;
+        }
+        assert(t >= previous);
+        previous = t;
+    }
+    assert(nans == 100 && previous >= 0);
+
+    // a run that can't be written leaves no other run files behind, whichever pass it's in
+    for (int blocked = 0; blocked < 50; blocked += 3) {
+        const std::string dir = "test_sorted.nvl.run" + std::to_string(blocked);
+        std::filesystem::create_directory(dir);
+        try { sort_event_logs(shards, "test_sorted.nvl", options); } catch (const std::runtime_error&) {}
+        std::filesystem::remove(dir);
+        for (int id = 0; id < 100; id++) assert(!std::filesystem::exists("test_sorted.nvl.run" + std::to_string(id)));
+    }
+
+    for (const char* p : {"test_shard0.nvl", "test_shard1.nvl", "test_sorted.nvl", "test_merged.nvl"}) std::remove(p);
+}
+
+void test_window_aggregation() {
+    Dispatcher dispatcher;
+    std::vector<std::map<std::string, Value>> tumbling, sliding;
+
+    WindowOptions options;
+    options.size = 10;
+    options.key_field = "player";
+    options.value_field = "damage";
+    options.percentiles = {50, 100};
+    WindowAggregator per_ten(options, [&](const Value& name, const std::map<std::string, Value>& data) {
+        assert(name.as_string() == "window");
+        tumbling.push_back(data);
+    });
+    per_ten.attach(dispatcher, "hit");
+
+    WindowOptions slide_options;
+    slide_options.size = 10;
+    slide_options.slide = 5;
+    WindowAggregator overlapping(slide_options, [&](const Value&, const std::map<std::string, Value>& data) {
+        sliding.push_back(data);
+    });
+    overlapping.attach(dispatcher, "hit");
+
+    for (int t = 0; t < 30; t++) {
+        dispatcher.dispatch(serialize_to_netvent(Value("hit"), {{"t", Value(t)}, {"player", Value("alice")}, {"damage", Value(t)}}));
+    }
+    dispatcher.dispatch(Value("miss"), {{"t", Value(31)}}); // other events don't reach the windows
+    assert(tumbling.size() == 2); // [0,10) and [10,20) closed, [20,30) still open
+    per_ten.flush();
+    overlapping.flush();
+
+    assert(tumbling.size() == 3);
+    assert(tumbling[1]["key"].as_string() == "alice");
+    assert(tumbling[1]["start"].as_int() == 10 && tumbling[1]["end"].as_int() == 20);
+    assert(tumbling[1]["count"].as_int() == 10);
+    assert(tumbling[1]["sum"].as_int() == 145);
+    assert(tumbling[1]["p50"].as_int() == 14);
+    assert(tumbling[1]["p100"].as_int() == 19);
+
+    // windows every 5 ticks: [-5,5) [0,10) ... [25,35)
+    assert(sliding.size() == 7);
+    assert(sliding[0]["start"].as_int() == -5 && sliding[0]["count"].as_int() == 5);
+    assert(sliding[1]["end"].as_int() == 10 && sliding[1]["count"].as_int() == 10);
+    assert(sliding[6]["start"].as_int() == 25 && sliding[6]["count"].as_int() == 5);
+
+    // events behind every open window get dropped
+    per_ten.add(Value("hit"), {{"t", Value(40)}, {"player", Value("bob")}});
+    per_ten.add(Value("hit"), {{"t", Value(5)}, {"player", Value("bob")}});
+    assert(per_ten.late_events() == 1);
+
+    // sums past the int range come out as floats
+    std::vector<std::map<std::string, Value>> big;
+    WindowAggregator totals(options, [&](const Value&, const std::map<std::string, Value>& data) { big.push_back(data); });
+    for (int t = 0; t < 3; t++) totals.add(Value("hit"), {{"t", Value(t)}, {"player", Value("carol")}, {"damage", Value(2e9f)}});
+    totals.flush();
+    assert(big.size() == 1 && big[0]["count"].as_int() == 3);
+    assert(big[0]["sum"].is_float() && big[0]["sum"].as_float() == 6e9f);
+    assert(big[0]["p100"].is_int() && big[0]["p100"].as_int() == 2000000000);
+}
+
+void test_schema_codegen() {
+    Schema schema = parse_schema(R"(
+// nested structs come first
+struct Vector2 {
+    x float
+    y float
+}
+
+event Player "new_player" {
+    x int
+    visible bool
+    velocity Vector2
+    name string? // optional
+})");
+    assert(schema.structs.size() == 2);
+    const SchemaStruct* player = schema.find_event("new_player");
+    assert(player && player->name == "Player" && player->is_event);
+    assert(player->fields.size() == 4);
+    assert(player->field("velocity")->type == FieldType::Struct);
+    assert(player->field("velocity")->struct_name == "Vector2");
+    assert(player->field("name")->optional && !player->field("x")->optional);
+
+    std::string code = generate_cpp(schema, "game");
+    assert(code.find("namespace game {") != std::string::npos);
+    assert(code.find("struct Player {") != std::string::npos);
+    assert(code.find("std::optional<std::string> name;") != std::string::npos);
+    assert(code.find("void decode_text(std::string_view text)") != std::string::npos);
+
+    // mistakes point at their line
+    bool threw = false;
+    try {
+        parse_schema("event A \"a\" {\n    pos Vector3\n}");
+    } catch (const std::runtime_error& e) {
+        threw = std::string(e.what()).find("line 2") != std::string::npos;
+    }
+    assert(threw);
+
+    // the view based helpers the generated decoders use
+    detail::LineReader lines("\"shoot\" // name\n\nx 5 // comment\n# skipped\nname \"bob\"\n");
+    std::string_view key, value;
+    assert(lines.event(value) && value == "\"shoot\"");
+    assert(lines.next(key, value) && key == "x" && detail::parse_int_text(value) == 5);
+    assert(lines.next(key, value) && key == "name" && detail::parse_string_text(value) == "bob");
+    assert(!lines.next(key, value));
+
+    int entries = 0;
+    detail::for_each_table_entry(R"({"a"=1, "b"=[1,2], "c"={"d"=2},})", [&](std::string_view k, std::string_view v) {
+        entries++;
+        if (detail::unquote(k) == "b") assert(v == "[1,2]");
+    });
+    assert(entries == 3);
+}
+
+void test_schema_binary() {
+    Schema schema = parse_schema(R"(
+struct Vector2 {
+    x float range(-64, 64) step(1/256)
+    y float range(-64, 64) step(1/256)
+}
+
+event Player "new_player" {
+    x int range(0, 4095)
+    y float range(0, 4096) step(1/16)
+    visible bool
+    velocity Vector2
+    name string?
+    score int?
+})");
+    const SchemaField* y = schema.find("Player")->field("y");
+    assert(y->has_range && y->max == 4096 && y->step == 0.0625);
+
+    // the player update from lil_test.cpp
+    std::map<std::string, Value> update = {
+        {"x", Value(60)},
+        {"y", Value(60.0f)},
+        {"visible", Value(true)},
+        {"velocity", Value(map_table({{"x", 1.5f}, {"y", -0.25f}}))}
+    };
+    std::string text = serialize_to_netvent(Value("new_player"), update);
+    std::string packed = encode_with_schema(schema, "Player", update);
+    assert(packed.size() < 10 && text.size() > 60);
+
+    auto decoded = decode_with_schema(schema, "Player", packed);
+    assert(decoded["x"].as_int() == 60);
+    assert(decoded["y"].as_float() == 60.0f);
+    assert(decoded["visible"].as_bool());
+    assert(decoded["velocity"].as_table()["y"].as_float() == -0.25f);
+    assert(decoded.find("name") == decoded.end());
+
+    update["score"] = Value(-7);
+    update["name"] = Value("testplayer");
+    decoded = decode_with_schema(schema, "Player", encode_with_schema(schema, "Player", update));
+    assert(decoded["score"].as_int() == -7);
+    assert(decoded["name"].as_string() == "testplayer");
+
+    // quantization rounds to the step and clamps to the range
+    update["y"] = Value(10.03f);
+    update["velocity"] = Value(map_table({{"x", 100.0f}, {"y", 0.0f}}));
+    decoded = decode_with_schema(schema, "Player", encode_with_schema(schema, "Player", update));
+    assert(decoded["y"].as_float() == 10.0f);
+    assert(decoded["velocity"].as_table()["x"].as_float() == 64.0f);
+
+    // ranged ints refuse values outside the range
+    update["x"] = Value(5000);
+    bool threw = false;
+    try { encode_with_schema(schema, "Player", update); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+}
+
+void test_schema_evolution() {
+    // the same event in two builds: v2 renamed x, dropped name, and added level
+    Schema v1 = parse_schema(R"(
+event Player "new_player" {
+    x int @1
+    name string? @2
+    hp int = 100 @3
+    speed float range(0, 10) step(1/8) @4
+})");
+    Schema v2 = parse_schema(R"(
+event Player "new_player" {
+    pos_x int @1
+    hp int = 100 @3
+    speed float range(0, 10) step(1/8) @4
+    level int = 1 @5
+})");
+    const SchemaStruct* player = v2.find("Player");
+    assert(player->tagged && player->field("level")->id == 5);
+    assert(player->field("level")->has_default && player->field("level")->default_value.as_int() == 1);
+
+    // old build to new build: name is skipped, level falls back to its default
+    std::string old_bytes = encode_with_schema(v1, "Player", {
+        {"x", Value(60)}, {"name", Value("testplayer")}, {"hp", Value(80)}, {"speed", Value(2.5f)}
+    });
+    auto decoded = decode_with_schema(v2, "Player", old_bytes);
+    assert(decoded["pos_x"].as_int() == 60);
+    assert(decoded["hp"].as_int() == 80);
+    assert(decoded["speed"].as_float() == 2.5f);
+    assert(decoded["level"].as_int() == 1);
+    assert(decoded.find("name") == decoded.end());
+
+    // new build to old build: level is skipped, hp equal to its default isn't sent at all
+    std::string new_bytes = encode_with_schema(v2, "Player", {
+        {"pos_x", Value(7)}, {"hp", Value(100)}, {"speed", Value(0.0f)}, {"level", Value(12)}
+    });
+    decoded = decode_with_schema(v1, "Player", new_bytes);
+    assert(decoded["x"].as_int() == 7 && decoded["hp"].as_int() == 100);
+    assert(decoded.find("name") == decoded.end());
+
+    // ids have to be given for every field or none, and can't repeat
+    bool threw = false;
+    try { parse_schema("struct A {\n    a int @1\n    b int\n}"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+    threw = false;
+    try { parse_schema("struct A {\n    a int @1\n    b int @1\n}"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+
+    // a type change under the same id is an error rather than garbage
+    Schema v3 = parse_schema("event Player \"new_player\" {\n    pos_x string @1\n}");
+    threw = false;
+    try { decode_with_schema(v3, "Player", new_bytes); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+
+    std::string code = generate_cpp(v2);
+    assert(code.find("int level = 1;") != std::string::npos);
+    assert(code.find("netvent::detail::skip_field(bits, tag.wire);") != std::string::npos);
+}
+
+constexpr auto literal_config = R"(
+"server_config" // comments work here too
+tick_rate 64
+gravity -9.8
+name "arena"
+ranked true
+spawn {"x"=1.5,"y"=2.0,}
+weights [1, 2, [3, 4]]
+)"_nv;
+
+static_assert(literal_config.name() == "server_config");
+static_assert(literal_config.size() == 6);
+static_assert(literal_config["tick_rate"].as_int() == 64);
+static_assert(literal_config["gravity"].as_float() == -9.8f);
+static_assert(literal_config["name"].as_string() == "arena");
+static_assert(literal_config["ranked"].as_bool());
+static_assert(literal_config.at(literal_config["spawn"], "x").as_float() == 1.5f);
+static_assert(literal_config.at(literal_config.at(literal_config["weights"], 2), 1).as_int() == 4);
+static_assert(!literal_config.contains("missing"));
+
+void test_netvent_literals() {
+    // the same data deserialize_from_netvent gives
+    auto [name, data] = literal_config.to_event();
+    auto [expected_name, expected] = deserialize_from_netvent(R"(
+"server_config"
+tick_rate 64
+gravity -9.8
+name "arena"
+ranked true
+spawn {"x"=1.5,"y"=2.0,}
+weights [1, 2, [3, 4]]
+)");
+    assert(name.as_string() == expected_name.as_string());
+    assert(data.size() == expected.size());
+    assert(data["tick_rate"].as_int() == expected["tick_rate"].as_int());
+    assert(data["gravity"].as_float() == expected["gravity"].as_float());
+    assert(data["spawn"].as_table()["y"].as_float() == 2.0f);
+    assert(data["weights"].as_table().get_is_array());
+    assert(data["weights"].as_table()[2].as_table()[0].as_int() == 3);
+
+    // outside a constant expression mistakes are ordinary exceptions
+    auto fails = [](std::string_view text) {
+        try { LiteralEvent<8> e(text); } catch (const std::runtime_error&) { return true; }
+        return false;
+    };
+    assert(fails("\"e\"\nx 12abc\n"));
+    assert(fails("\"e\"\nx {\"a\"=1\n"));
+    assert(fails("\"e\"\nx 1\nx 2\n"));
+    assert(fails("\"e\"\nx [1,2,3,4,5,6,7,8,9]\n")); // over capacity
+    assert(!fails("\"e\"\nx [1,2]\n"));
+}
+
+struct ReflectedPoint {
+    int x = 0;
+    int y = 0;
+};
+
+struct ReflectedSpawn {
+    std::string player;
+    ReflectedPoint at;
+    float angle = 0.0f;
+    std::optional<std::string> team;
+    Table loadout;
+};
+
+template<> struct netvent::FieldNames<ReflectedPoint> {
+    static constexpr std::string_view names[] = {"x", "y"};
+};
+
+template<> struct netvent::FieldNames<ReflectedSpawn> {
+    static constexpr std::string_view event = "spawn";
+    static constexpr std::string_view names[] = {"player", "at", "angle", "team", "loadout"};
+};
+
+struct ReflectedSix {
+    int a, b, c, d, e, f;
+};
+
+// the most members reflection takes, with names that match its own
+struct ReflectedSixteen {
+    int a, b, c, d, e, f, g, h, i, j, k, l, m, n, o;
+    std::string p;
+};
+
+template<> struct netvent::FieldNames<ReflectedSix> {
+    static constexpr std::string_view event = "six";
+    static constexpr std::string_view names[] = {"a", "b", "c", "d", "e", "f"};
+};
+
+template<> struct netvent::FieldNames<ReflectedSixteen> {
+    static constexpr std::string_view event = "sixteen";
+    static constexpr std::string_view names[] = {"a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n", "o", "p"};
+};
+
+void test_aggregate_reflection() {
+    ReflectedSpawn spawn{"bob", {3, -4}, 0.5f, std::nullopt, Table(std::vector<Value>{Value("rifle"), Value(2)})};
+    std::string text = encode(spawn);
+    assert(text == "\"spawn\"\nplayer \"bob\"\nat {\"x\"=3,\"y\"=-4}\nangle 0.5\nloadout [\"rifle\",2]\n");
+
+    // the untyped api reads the same text
+    auto [name, data] = deserialize_from_netvent(text);
+    assert(name.as_string() == "spawn");
+    assert(data["at"].as_table()["y"].as_int() == -4);
+
+    ReflectedSpawn back = decode<ReflectedSpawn>(text);
+    assert(back.player == "bob" && back.at.x == 3 && back.at.y == -4 && back.angle == 0.5f);
+    assert(!back.team && back.loadout[1].as_int() == 2);
+
+    spawn.team = "red";
+    assert(*decode<ReflectedSpawn>(encode(spawn)).team == "red");
+
+    // a different event name, and a missing member
+    bool threw = false;
+    try { decode<ReflectedSpawn>("\"despawn\"\nplayer \"bob\"\n"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+    threw = false;
+    try { decode<ReflectedSpawn>("\"spawn\"\nplayer \"bob\"\nat {\"x\"=1}\nangle 0.0\nloadout []\n"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+    assert(encode(ReflectedPoint{1, 2}, "point") == "\"point\"\nx 1\ny 2\n");
+
+    // wider aggregates, up to the limit
+    ReflectedSix six{1, 2, 3, 4, 5, 6};
+    assert(encode(six) == "\"six\"\na 1\nb 2\nc 3\nd 4\ne 5\nf 6\n");
+    ReflectedSix six_back = decode<ReflectedSix>(encode(six));
+    assert(six_back.a == 1 && six_back.f == 6);
+    ReflectedSixteen sixteen{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, "last"};
+    ReflectedSixteen sixteen_back = decode<ReflectedSixteen>(encode(sixteen));
+    assert(sixteen_back.f == 6 && sixteen_back.n == 14 && sixteen_back.o == 15 && sixteen_back.p == "last");
+}
+
+#if __cplusplus >= 202002L
+using Shoot = Event<"shoot", Field<"x", int>, Field<"y", float>, Field<"player_name", std::string>, Field<"gun_active", std::optional<bool>>>;
+using Join = Event<"join", Field<"player_name", std::string>, Field<"team", int>>;
+using GameEvents = EventList<Shoot, Join>;
+
+void test_typed_events() {
+    Shoot shot;
+    shot.get<"x">() = 5;
+    shot.get<"y">() = 0.5f;
+    shot.get<"player_name">() = "this person";
+    std::string text = shot.encode_text();
+    assert(text == "\"shoot\"\nx 5\ny 0.5\nplayer_name \"this person\"\n");
+
+    // readable by the untyped api and back
+    auto [name, data] = deserialize_from_netvent(text);
+    assert(name.as_string() == "shoot" && data["x"].as_int() == 5);
+    Shoot back;
+    back.decode_text(serialize_to_netvent(Value("shoot"), {{"x", 7}, {"y", 1.5f}, {"player_name", "bob"}, {"gun_active", true}}));
+    assert(back.get<"x">() == 7 && back.get<"gun_active">() == true);
+
+    // dispatch picks the type by name
+    int shots = 0, joins = 0;
+    auto handler = [&](auto&& event) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(event)>, Shoot>) shots += event.template get<"x">();
+        else joins += event.template get<"team">();
+    };
+    assert(GameEvents::dispatch(text, handler));
+    assert(GameEvents::dispatch("\"join\"\nplayer_name \"bob\"\nteam 2\n", handler));
+    assert(!GameEvents::dispatch("\"leave\"\n", handler));
+    assert(shots == 5 && joins == 2);
+
+    GameEvents::variant any = GameEvents::decode(text);
+    assert(std::holds_alternative<Shoot>(any));
+
+    bool threw = false;
+    try { back.decode_text("\"shoot\"\nx 1\n"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+}
+#endif
+
+void test_validator() {
+    Schema schema = parse_schema(R"(
+struct Vector2 {
+    x float range(-64, 64)
+    y float range(-64, 64)
+}
+
+event Player "new_player" {
+    x int range(0, 4095)
+    name string length(1, 16)
+    velocity Vector2
+    hp int = 100
+    title string?
+})");
+    Validator player(schema, "Player");
+    DecodeOptions options;
+    options.validator = &player;
+
+    auto [name, data] = deserialize_from_netvent("\"new_player\"\nx 60\nname \"bob\"\nvelocity {\"x\"=1,\"y\"=-2.5}\n", options);
+    assert(name.as_string() == "new_player");
+    assert(data["x"].as_int() == 60);
+    assert(data["hp"].as_int() == 100);
+    assert(data["velocity"].as_table()["x"].as_float() == 1.0f); // converted to the declared type
+    assert(data.find("title") == data.end());
+
+    auto rejects = [&](const std::string& text) {
+        try { player.check(text); } catch (const std::runtime_error&) { return true; }
+        return false;
+    };
+    const std::string ok = "\"new_player\"\nx 60\nname \"bob\"\nvelocity {\"x\"=1.0,\"y\"=2.0}\n";
+    assert(!rejects(ok));
+    assert(rejects("\"shoot\"\nx 60\nname \"bob\"\nvelocity {\"x\"=1.0,\"y\"=2.0}\n"));         // wrong event
+    assert(rejects("\"new_player\"\nx 5000\nname \"bob\"\nvelocity {\"x\"=1.0,\"y\"=2.0}\n"));  // out of range
+    assert(rejects("\"new_player\"\nx 6.5\nname \"bob\"\nvelocity {\"x\"=1.0,\"y\"=2.0}\n"));   // not an int
+    assert(rejects("\"new_player\"\nx 60\nname \"\"\nvelocity {\"x\"=1.0,\"y\"=2.0}\n"));       // too short
+    assert(rejects("\"new_player\"\nx 60\nname \"bob\"\nvelocity {\"x\"=1.0,\"y\"=99.0}\n"));   // nested range
+    assert(rejects("\"new_player\"\nx 60\nname \"bob\"\nvelocity {\"x\"=1.0}\n"));               // nested required
+    assert(rejects("\"new_player\"\nx 60\nname \"bob\"\n"));                                     // missing field
+    assert(rejects(ok + "x 61\n"));                                                                 // repeated
+    assert(rejects(ok + "admin true\n"));                                                          // unknown
+
+    // a leading '+' is taken the same as plain decoding takes it
+    const std::string plus = "\"new_player\"\nx +5\nname \"bob\"\nvelocity {\"x\"=+1.5,\"y\"=2.0}\n";
+    assert(!rejects(plus) && deserialize_from_netvent(plus, options).second["x"].as_int() == 5);
+    assert(deserialize_from_netvent(plus).second["x"].as_int() == 5);
+    assert(rejects("\"new_player\"\nx +-5\nname \"bob\"\nvelocity {\"x\"=1.0,\"y\"=2.0}\n"));
+
+    // the same checks from a spec written in netvent itself
+    Validator shoot = Validator::from_netvent(R"spec("shoot"
+x "int range(0, 100)"
+player_name "string length(32)"
+gun_active "bool?"
+)spec");
+    assert(shoot.event_name() == "shoot");
+    shoot.check("\"shoot\"\nx 0\nplayer_name \"this person\"\n");
+    bool threw = false;
+    try { shoot.check("\"shoot\"\nx 0\nplayer_name this person\n"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+}
+
+void test_simd_dispatch() {
+    // every kernel set the cpu runs has to agree with the scalar one, tails included
+    const SimdLevel saved = simd_level();
+    const size_t n = 1003;
+    std::vector<int> ints(n);
+    std::vector<float> floats(n);
+    std::vector<uint8_t> other(n);
+    uint32_t seed = 12345;
+    auto next = [&] { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+    for (size_t i = 0; i < n; i++) {
+        ints[i] = static_cast<int>(next() % 2001) - 1000;
+        floats[i] = static_cast<float>(ints[i]) * 0.25f;
+        other[i] = next() % 4 != 0;
+    }
+    ints[17] = std::numeric_limits<int>::min();
+    ints[900] = std::numeric_limits<int>::max();
+
+    auto run = [&](SimdLevel level, CompareOp op) {
+        force_simd_level(level);
+        assert(simd_level() == level);
+        std::vector<uint8_t> sel(n, 1);
+        detail::filter_int(ints.data(), n, op, 250, sel.data());
+        std::vector<uint8_t> fsel(n, 1);
+        detail::filter_float(floats.data(), n, op, -12.5f, fsel.data());
+        detail::and_mask(fsel.data(), other.data(), n);
+        std::vector<double> out = {static_cast<double>(detail::count_mask(sel.data(), n)),
+                                   static_cast<double>(detail::count_mask(fsel.data(), n)),
+                                   static_cast<double>(detail::sum_int(ints.data(), fsel.data(), n)),
+                                   detail::sum_float(floats.data(), fsel.data(), n),
+                                   static_cast<double>(detail::extreme_int(ints.data(), other.data(), n, true)),
+                                   static_cast<double>(detail::extreme_int(ints.data(), sel.data(), n, false)),
+                                   detail::extreme_float(floats.data(), fsel.data(), n, true),
+                                   detail::extreme_float(floats.data(), sel.data(), n, false)};
+        out.insert(out.end(), sel.begin(), sel.end());
+        out.insert(out.end(), fsel.begin(), fsel.end());
+        return out;
+    };
+
+    const CompareOp ops[] = {CompareOp::Eq, CompareOp::Ne, CompareOp::Lt, CompareOp::Le, CompareOp::Gt, CompareOp::Ge};
+    for (CompareOp op : ops) {
+        std::vector<double> expected = run(SimdLevel::Scalar, op);
+        for (SimdLevel level : {SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512}) {
+            if (level > supported_simd_level()) break;
+            assert(run(level, op) == expected);
+        }
+    }
+
+    // nothing selected keeps the identity values
+    std::vector<uint8_t> none(n, 0);
+    assert(detail::extreme_int(ints.data(), none.data(), n, true) == std::numeric_limits<int>::min());
+    assert(detail::count_mask(none.data(), n) == 0);
+
+    assert(std::string(simd_level_name(SimdLevel::AVX2)) == "avx2");
+    if (supported_simd_level() != SimdLevel::AVX512) {
+        bool threw = false;
+        try { force_simd_level(SimdLevel::AVX512); } catch (const std::runtime_error&) { threw = true; }
+        assert(threw);
+    }
+    force_simd_level(saved);
+}
+
+void test_int_text() {
+    // both kernel sets against to_chars/from_chars, including the ends of the range
+    const SimdLevel saved = simd_level();
+    std::vector<int> values = {0, 7, -7, 10, 99, -100, 12345678, 99999999, 100000000, -100000000, 999999999,
+                               1000000000, std::numeric_limits<int>::max(), std::numeric_limits<int>::min()};
+    uint32_t seed = 99;
+    for (int i = 0; i < 2000; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        values.push_back(static_cast<int>(seed) >> (i % 31));
+    }
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42}) {
+        if (level > supported_simd_level()) break;
+        force_simd_level(level);
+        std::string joined;
+        detail::append_ints(joined, values.data(), values.size(), ' ');
+        std::string expected;
+        for (int v : values) {
+            char buf[16];
+            std::string text(buf, std::to_chars(buf, buf + sizeof(buf), v).ptr);
+            std::string single;
+            detail::append_int(single, v);
+            assert(single == text);
+            int back = 0;
+            assert(detail::parse_int(text, back) && back == v);
+            expected += (expected.empty() ? "" : " ") + text;
+        }
+        assert(joined == expected);
+
+        // strict: the whole token, in range
+        int out = 0;
+        for (const char* bad : {"", "-", "+1", " 1", "1 ", "12a", "2147483648", "-2147483649", "99999999999999999999", "1.5"})
+            assert(!detail::parse_int(bad, out));
+        assert(detail::parse_int("000000000000000000042", out) && out == 42);
+        assert(detail::parse_int("-0", out) && out == 0);
+    }
+    force_simd_level(saved);
+
+    // arrays batch their int runs, mixed values keep their order
+    Table t(std::vector<Value>{Value(1), Value(-22), Value("x"), Value(333), Value(2.5f), Value(4)});
+    assert(t.serialize() == "[1,-22,\"x\",333,2.5,4]");
+    Table back = Table::deserialize(t.serialize());
+    assert(back[Value(1)].as_int() == -22 && back[Value(5)].as_int() == 4);
+    assert(Value::deserialize("-2147483648").as_int() == std::numeric_limits<int>::min());
+}
+
+void test_float_text() {
+    // shortest digits that read back exactly, always with a '.'
+    auto text = [](float v) { std::string s; detail::append_float(s, v); return s; };
+    assert(text(60.0f) == "60.0");
+    assert(text(0.1f) == "0.1");
+    assert(text(-2.5f) == "-2.5");
+    assert(text(3.1415927f) == "3.1415927");
+    assert(text(1.0f / 3.0f) == "0.33333334");
+    assert(text(0.0f) == "0.0" && text(-0.0f) == "-0.0");
+    assert(text(1e21f) == "1.0e21" && text(1.5e30f) == "1.5e30");
+    assert(text(1e-7f) == "1.0e-7" && text(0.000123f) == "0.000123");
+    assert(text(std::numeric_limits<float>::max()) == "3.4028235e38");
+    assert(text(std::numeric_limits<float>::denorm_min()) == "1.0e-45");
+
+    // every pattern out of a spread of floats makes it back, and parses like from_chars
+    uint32_t seed = 5;
+    for (int i = 0; i < 100000; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        float f;
+        std::memcpy(&f, &seed, 4);
+        if (!std::isfinite(f)) continue;
+        std::string s = text(f);
+        float back = 0;
+        assert(s.find('.') != std::string::npos);
+        assert(detail::parse_float(s, back) && std::memcmp(&back, &f, 4) == 0);
+        assert(Value::deserialize(s).as_float() == f);
+    }
+    for (const char* good : {"1", "-0.5", "1.", ".5", "1e10", "1E-3", "2.5e+2", "0.000000000000000000000000000001",
+                             "123456789012345678901234567890", "3.4028235e38", "inf", "-nan"}) {
+        float a = 0, b = 0;
+        auto res = std::from_chars(good, good + std::strlen(good), b);
+        assert(detail::parse_float(good, a) && res.ec == std::errc());
+        assert(std::memcmp(&a, &b, 4) == 0 || (std::isnan(a) && std::isnan(b)));
+    }
+    // out of range goes to zero or infinity like strtof
+    float out = 0;
+    assert(detail::parse_float("1e-50", out) && out == 0.0f);
+    assert(detail::parse_float("-1e39", out) && out == -std::numeric_limits<float>::infinity());
+    for (const char* bad : {"", "-", ".", "+1", " 1", "1 ", "1e", "1e+", "1.2.3", "1,5", "e5", "0x10"})
+        assert(!detail::parse_float(bad, out));
+
+    // values with junk after the number aren't numbers, floats need their '.'
+    for (const char* word : {"12abc", "1.5abc", "1e5", "3000000000", "1.5.2", "+-5"})
+        assert(Value::deserialize(word).is_string() && Value::deserialize(word).as_string() == word);
+    assert(Value::deserialize("+5").as_int() == 5 && Value::deserialize("-5").as_int() == -5);
+    assert(Value::deserialize("+1.5").as_float() == 1.5f && Value::deserialize("1.5e3").as_float() == 1500.0f);
+
+    // inf and nan have no '.' but still come back as floats
+    const float inf = std::numeric_limits<float>::infinity();
+    assert(text(inf) == "inf" && text(-inf) == "-inf" && text(std::nanf("")) == "nan");
+    assert(Value::deserialize(Value(inf).serialize()).as_float() == inf);
+    assert(Value::deserialize(Value(-inf).serialize()).as_float() == -inf);
+    assert(std::isnan(Value::deserialize(Value(std::nanf("")).serialize()).as_float()));
+    Table specials(std::vector<Value>{Value(1.5f), Value(inf), Value(-inf)});
+    assert(specials.serialize() == "[1.5,inf,-inf]" && Table::deserialize(specials.serialize()) == specials);
+
+    // whole arrays both ways
+    std::vector<float> values = {1.5f, -0.25f, 1e-10f, 12345.678f};
+    std::string joined;
+    detail::append_floats(joined, values.data(), values.size());
+    assert(joined == "1.5,-0.25,1.0e-10,12345.678");
+    std::vector<float> parsed;
+    assert(detail::parse_floats(joined, parsed) && parsed == values);
+    assert(!detail::parse_floats("1.0,x", parsed));
+
+    Table t(std::vector<Value>{Value(0.1f), Value(0.2f), Value(1), Value(2.75f)});
+    assert(t.serialize() == "[0.1,0.2,1,2.75]");
+    assert(Table::deserialize(t.serialize())[Value(3)].as_float() == 2.75f);
+}
+
+void test_line_tokenizer() {
+    // the simd walk against a plain split, on noise heavy on the characters it looks for and long
+    // enough to cross 64 byte blocks
+    auto reference = [](std::string_view text) {
+        std::vector<std::string> out;
+        bool first = true;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = std::min(text.find('\n', pos), text.size());
+            std::string_view line = text.substr(pos, end - pos);
+            pos = end + 1;
+            line = line.substr(0, std::min(detail::comment_start(line), line.size()));
+            line = detail::trim_view(line);
+            if (line.empty() || line[0] == '#') continue;
+            if (first) {
+                out.push_back("event:" + std::string(line));
+                first = false;
+                continue;
+            }
+            size_t space = line.find_first_of(" \t\r");
+            if (space == std::string_view::npos) continue;
+            out.push_back(std::string(line.substr(0, space)) + "|" + std::string(detail::trim_view(line.substr(space))));
+        }
+        return out;
+    };
+    auto tokenize = [](std::string_view text) {
+        std::vector<std::string> out;
+        detail::LineTokenizer lines(text);
+        std::string_view name, key, value;
+        if (lines.event(name)) out.push_back("event:" + std::string(name));
+        while (lines.next(key, value)) out.push_back(std::string(key) + "|" + std::string(value));
+        return out;
+    };
+
+    const SimdLevel saved = simd_level();
+    const char alphabet[] = "ab1 \t\r\n/#\"\\x  \n";
+    uint32_t seed = 7;
+    for (int round = 0; round < 3000; round++) {
+        std::string text;
+        size_t size = round % 300;
+        for (size_t i = 0; i < size; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            text += alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+        }
+        std::vector<std::string> expected = reference(text);
+        for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512}) {
+            if (level > supported_simd_level()) break;
+            force_simd_level(level);
+            assert(tokenize(text) == expected);
+        }
+    }
+    force_simd_level(saved);
+
+    // comments, indents, tabs and windows line ends come out the same as compact text
+    std::string commented = "// header\n\n  \"shoot\" // name\r\n# note\n\tx\t 5 // five\r\n  name \"bob\"   \n"
+                            "//key 1\nempty   // nothing\n  y 2.5";
+    auto [name, data] = deserialize_from_netvent(commented);
+    assert(name.as_string() == "shoot");
+    assert(data.size() == 3 && data["x"].as_int() == 5 && data["name"].as_string() == "bob" && data["y"].as_float() == 2.5f);
+    assert(deserialize_from_netvent(std::string_view("\"shoot\"\nx 5\nname \"bob\"\ny 2.5")).second.size() == 3);
+}
+
+void test_string_escaping() {
+    // names with every character the text format cares about survive a round trip
+    const std::string names[] = {"plain", "a, b", "x] y}", "say \"hi\"", "back\\slash", "two\nlines\r\n",
+                                 "tab\there", "http://url", "k=v", std::string("nul\0byte", 8), "\x01\x1f", "caf\xc3\xa9 \xf0\x9f\x99\x82",
+                                 "\\\"", std::string(100, 'q') + "\"" + std::string(70, 'z')};
+    for (const std::string& s : names) {
+        Value v(s);
+        assert(Value::deserialize(v.serialize()).as_string() == s);
+
+        Table t;
+        t[Value(s)] = Value(s);
+        t[Value("other")] = Value(1);
+        Table back = Table::deserialize(t.serialize());
+        assert(back.get_data_map().size() == 2 && back[Value(s)].as_string() == s && back[Value("other")].as_int() == 1);
+
+        Table arr(std::vector<Value>{Value(s), Value(2)});
+        Table arr_back = Table::deserialize(arr.serialize());
+        assert(arr_back[Value(0)].as_string() == s && arr_back[Value(1)].as_int() == 2);
+
+        auto [name, data] = deserialize_from_netvent(serialize_to_netvent(Value(s), {{"text", Value(s)}, {"n", Value(3)}}));
+        assert(name.as_string() == s && data["text"].as_string() == s && data["n"].as_int() == 3);
+    }
+    assert(Value("a\"b\\c\n\x01").serialize() == "\"a\\\"b\\\\c\\n\\u0001\"");
+
+    // escapes written by other encoders, including utf-16 surrogate pairs
+    assert(Value::deserialize("\"\\u00e9\\/\\b\\f\"").as_string() == "\xc3\xa9/\b\f");
+    assert(Value::deserialize("\"\\ud83d\\ude42\"").as_string() == "\xf0\x9f\x99\x82");
+    for (const char* bad : {"\"\\q\"", "\"\\u12\"", "\"\\ud83d\"", "\"\\ude42x\""}) {
+        bool threw = false;
+        try { Value::deserialize(bad); } catch (const std::runtime_error&) { threw = true; }
+        assert(threw);
+    }
+
+    // a "//" inside a string isn't a comment, one after it still is
+    auto [name, data] = deserialize_from_netvent("\"chat\" // event\nurl \"http://x\" // link\nmsg \"a \\\"//\\\" b\"\n");
+    assert(name.as_string() == "chat" && data["url"].as_string() == "http://x" && data["msg"].as_string() == "a \"//\" b");
+
+    // every level finds the same clean run
+    const SimdLevel saved = simd_level();
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (level > supported_simd_level()) break;
+        force_simd_level(level);
+        const auto clean_prefix = detail::pick_kernels(detail::string_kernels).clean_prefix;
+        for (size_t n = 0; n < 150; n++) {
+            for (size_t bad = 0; bad <= n; bad += 5) {
+                std::string s(n, '\x7f');
+                if (bad < n) s[bad] = "\"\\\n\x1f"[bad % 4];
+                assert(clean_prefix(s.data(), s.size()) == bad);
+            }
+        }
+    }
+    force_simd_level(saved);
+}
+
+void test_utf8() {
+    auto valid_at = [](SimdLevel level, const std::string& s) {
+        force_simd_level(level);
+        return detail::valid_utf8(s);
+    };
+    const SimdLevel saved = simd_level();
+    std::vector<SimdLevel> levels;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512})
+        if (level <= supported_simd_level()) levels.push_back(level);
+
+    const std::string good[] = {"", "plain ascii", "caf\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x99\x82", "\xf4\x8f\xbf\xbf",
+                                "\xed\x9f\xbf", "\xee\x80\x80", std::string(40, 'a') + "\xf0\x9f\x99\x82"};
+    const std::string bad[] = {"\x80", "\xc0\x80", "\xc1\xbf", "\xe0\x80\x80", "\xed\xa0\x80", "\xf0\x80\x80\x80",
+                               "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff", "\xc3", "\xe2\x82", "\xf0\x9f\x99",
+                               "a\xc3" "a", "\xc3\xa9\xa9", std::string(31, 'a') + "\xe2\x82", std::string(45, 'a') + "\x80"};
+    for (SimdLevel level : levels) {
+        for (const std::string& s : good) assert(valid_at(level, s));
+        for (const std::string& s : bad) assert(!valid_at(level, s));
+    }
+
+    // every level agrees with the scalar check on mostly good text with a few bytes broken,
+    // at every length around the block sizes
+    const std::string pieces[] = {"a", "bc", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x99\x82", "\xed\x9f\xbf"};
+    uint32_t seed = 3;
+    auto next = [&seed] { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+    for (int round = 0; round < 4000; round++) {
+        std::string s;
+        while (s.size() < static_cast<size_t>(round % 140)) s += pieces[next() % 6];
+        if (round % 3 && !s.empty()) s[next() % s.size()] = static_cast<char>(0x80 + next() % 0x80);
+        if (round % 5 == 0 && !s.empty()) s.pop_back();
+        const bool want = valid_at(SimdLevel::Scalar, s);
+        for (SimdLevel level : levels) assert(valid_at(level, s) == want);
+        const std::string fixed = detail::repair_utf8(s);
+        assert(valid_at(SimdLevel::Scalar, fixed) && (fixed == s) == want);
+    }
+    force_simd_level(saved);
+
+    // one U+FFFD per maximal bad piece
+    assert(detail::repair_utf8("a\xff" "b") == "a\xef\xbf\xbd" "b");
+    assert(detail::repair_utf8("\xe2\x82" "A") == "\xef\xbf\xbd" "A");
+    assert(detail::repair_utf8("\xf0\x80\x80") == "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd");
+    assert(detail::repair_utf8("x\xf0\x9f\x99") == "x\xef\xbf\xbd");
+
+    // on the receive path
+    const std::string text = "\"chat\"\nfrom \"bob\"\nmsg \"hi \xc3\x28 there\"\n";
+    DecodeOptions options;
+    assert(deserialize_from_netvent(text, options).second["msg"].as_string() == "hi \xc3\x28 there");
+    options.utf8 = Utf8Policy::Reject;
+    bool threw = false;
+    try { deserialize_from_netvent(text, options); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+    assert(deserialize_from_netvent("\"chat\"\nmsg \"caf\xc3\xa9\"\n", options).second["msg"].as_string() == "caf\xc3\xa9");
+    options.utf8 = Utf8Policy::Replace;
+    assert(deserialize_from_netvent(text, options).second["msg"].as_string() == "hi \xef\xbf\xbd( there");
+}
+
+// blob bytes are skipped at compile time too, newline and "//" included
+constexpr auto literal_blob = R"("chunk"
+data #7:a
+b//c  
+after 1 // done
+)"_nv;
+static_assert(literal_blob["data"].as_blob() == "a\nb//c ");
+static_assert(literal_blob["after"].as_int() == 1);
+
+void test_blobs() {
+    const std::string bytes = std::string("\0\xff\n//\"#12:,]}= x\r\n", 19) + "  ";
+    Value v{Blob(bytes)};
+    assert(v.is_blob() && !v.is_string() && v.as_blob().str() == bytes);
+    assert(Value(Blob("hi", 2)).serialize() == "#2:hi");
+    assert(Value::deserialize(v.serialize()) == v);
+    assert(Value::deserialize("#0:").as_blob().empty());
+    assert(Value::deserialize("#hashtag").as_string() == "#hashtag"); // no header, a bare word
+    bool threw = false;
+    try { Value::deserialize("#10:short"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+
+    // inside tables, as values and keys, blanks at the end of the bytes kept
+    Table t;
+    t[Value("voice")] = v;
+    t[v] = Value(7);
+    Table back = Table::deserialize(t.serialize());
+    assert(back[Value("voice")] == v && back[v].as_int() == 7);
+    Table arr(std::vector<Value>{v, Value(1), v});
+    Table arr_back = Table::deserialize(arr.serialize());
+    assert(arr_back[Value(0)] == v && arr_back[Value(1)].as_int() == 1 && arr_back[Value(2)] == v);
+
+    // in an event the bytes are jumped over, whatever lines they hold
+    std::string big(300000, '\n');
+    for (size_t i = 0; i < big.size(); i += 7) big[i] = '/';
+    std::string text = serialize_to_netvent(Value("chunk"), {{"a", Value(1)}, {"data", Value(Blob(big))}, {"tail", v}, {"z", Value("end")}});
+    text += "# note #3:abc\n";  // still a comment
+    auto [name, data] = deserialize_from_netvent(text);
+    assert(name.as_string() == "chunk" && data.size() == 4);
+    assert(data["data"].as_blob().view() == big && data["tail"] == v && data["z"].as_string() == "end");
+
+    // blobs inside tables and arrays are stepped over too, wherever their bytes break the line
+    Table nested;
+    nested[Value("a")] = Value(Blob("x\ny // z\n"));
+    nested[Value("b")] = Value(2);
+    Table list(std::vector<Value>{Value(1), Value(Blob("]\n,")), Value(2)});
+    std::string nested_text = serialize_to_netvent(Value("nested"), {{"tbl", Value(nested)}, {"list", Value(list)}, {"after", Value(3)}});
+    nested_text += "more [#2:\n\n] // #4:\n\n\n\n\n";
+    auto nested_back = deserialize_from_netvent(nested_text).second;
+    assert(nested_back.size() == 4 && nested_back["tbl"].as_table() == nested && nested_back["list"].as_table() == list);
+    assert(nested_back["after"].as_int() == 3 && nested_back["more"].as_table()[Value(0)].as_blob().view() == "\n\n");
+
+    // with the text shared, the blob points into it
+    auto shared = std::make_shared<const std::string>(text);
+    auto zero_copy = deserialize_from_netvent(shared).second;
+    const Blob& chunk = zero_copy["data"].as_blob();
+    assert(chunk.view() == big && chunk.shared_buffer() == shared);
+    assert(chunk.data() > shared->data() && chunk.data() < shared->data() + shared->size());
+
+    // schemas: length checks in text, length plus bytes in binary, and the generated-style helpers
+    Schema schema = parse_schema(R"(
+event Voice "voice" {
+    seq int
+    frame blob length(1, 64)
+    extra blob?
+})");
+    Validator voice(schema, "Voice");
+    DecodeOptions options;
+    options.validator = &voice;
+    auto ok = deserialize_from_netvent("\"voice\"\nseq 4\nframe #3:a\nb\n", options).second;
+    assert(ok["frame"].as_blob().view() == "a\nb");
+    threw = false;
+    try { voice.check("\"voice\"\nseq 4\nframe #0:\n"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+    threw = false;
+    try { voice.check("\"voice\"\nseq 4\nframe \"abc\"\n"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+
+    std::string packed = encode_with_schema(schema, "Voice", {{"seq", Value(4)}, {"frame", v}});
+    assert(packed.size() < bytes.size() + 8);
+    auto unpacked = decode_with_schema(schema, "Voice", packed);
+    assert(unpacked["frame"] == v && unpacked.find("extra") == unpacked.end());
+    assert(detail::gen_struct(schema.structs.back()).find("netvent::Blob frame;") != std::string::npos);
+}
+
+// printable blobs are decoded at compile time too, "//" in base64 isn't a comment
+constexpr auto literal_base64 = R"("chunk"
+data #base64://8A+w== // done
+key #hex:0aFF
+)"_nv;
+static_assert(literal_base64["data"].is_blob() && literal_base64["key"].is_blob());
+constexpr auto literal_nested_blob = "\"chunk\"\nlist [1, #3:]\n,, 2] // #2:\n\nafter 3\n"_nv;
+static_assert(literal_nested_blob["list"].is_table() && literal_nested_blob["after"].is_int());
+constexpr auto literal_infinity = "\"limits\"\nhigh inf\nlow -inf\n"_nv;
+static_assert(literal_infinity["high"].as_float() == std::numeric_limits<float>::infinity() && literal_infinity["low"].as_float() < 0);
+
+void test_binary_text() {
+    auto base64_at = [](SimdLevel level, const std::string& s) {
+        force_simd_level(level);
+        std::string out;
+        detail::append_base64(out, s);
+        return out;
+    };
+    auto hex_at = [](SimdLevel level, const std::string& s) {
+        force_simd_level(level);
+        std::string out;
+        detail::append_hex(out, s);
+        return out;
+    };
+    const SimdLevel saved = simd_level();
+    std::vector<SimdLevel> levels;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512})
+        if (level <= supported_simd_level()) levels.push_back(level);
+
+    assert(base64_at(SimdLevel::Scalar, "") == "" && base64_at(SimdLevel::Scalar, "f") == "Zg==");
+    assert(base64_at(SimdLevel::Scalar, "fo") == "Zm8=" && base64_at(SimdLevel::Scalar, "foobar") == "Zm9vYmFy");
+    assert(hex_at(SimdLevel::Scalar, std::string("\x00\x9f\xff", 3)) == "009fff");
+
+    // every level writes what the scalar code does and reads it back, at every length around
+    // the block sizes, and turns down the same broken text
+    uint32_t seed = 5;
+    auto next = [&seed] { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+    for (size_t n = 0; n < 200; n++) {
+        std::string bytes(n, '\0');
+        for (char& c : bytes) c = static_cast<char>(next());
+        const std::string base64 = base64_at(SimdLevel::Scalar, bytes), hex = hex_at(SimdLevel::Scalar, bytes);
+        std::string broken = base64;
+        if (!broken.empty()) broken[next() % broken.size()] = ".-_ \n"[next() % 5];
+        for (SimdLevel level : levels) {
+            assert(base64_at(level, bytes) == base64 && hex_at(level, bytes) == hex);
+            std::string out = "x";
+            assert(detail::decode_base64(base64, out) && out == "x" + bytes);
+            out.clear();
+            assert(detail::decode_hex(hex, out) && out == bytes);
+            out.clear();
+            std::string upper = hex;
+            for (char& c : upper) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            assert(detail::decode_hex(upper, out) && out == bytes);
+            out.clear();
+            assert(broken.empty() || (!detail::decode_base64(broken, out) && out.empty()));
+            if (!hex.empty()) {
+                std::string bad_hex = hex;
+                bad_hex[next() % bad_hex.size()] = 'g';
+                assert(!detail::decode_hex(bad_hex, out) && out.empty());
+            }
+        }
+    }
+    force_simd_level(saved);
+
+    // as a Value mode, tables and events included
+    const std::string bytes("\0\xff\n//\"#,]}= x\r\n  ", 18);
+    Value v{Blob(bytes)};
+    assert(Value(Blob("hi", 2)).serialize(BlobText::Base64) == "#base64:aGk=");
+    assert(Value(Blob("hi", 2)).serialize(BlobText::Hex) == "#hex:6869");
+    for (BlobText mode : {BlobText::Base64, BlobText::Hex}) {
+        const std::string text = v.serialize(mode);
+        assert(text.find_first_of("\n\r\"") == std::string::npos);
+        assert(Value::deserialize(text) == v);
+        Table t;
+        t[Value("voice")] = v;
+        t[v] = Value(Table(std::vector<Value>{v, Value(1)}));
+        Table back = Table::deserialize(t.serialize(mode));
+        assert(back[Value("voice")] == v && back[v].as_table()[Value(0)] == v);
+        const std::string event = serialize_to_netvent(Value("chunk"), {{"data", v}, {"z", Value(2)}}, mode);
+        auto data = deserialize_from_netvent(event).second;
+        assert(data["data"] == v && data["z"].as_int() == 2);
+    }
+    assert(Value::deserialize("#hex:").as_blob().empty());
+    bool threw = false;
+    try { Value::deserialize("#base64:aGk"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+    threw = false;
+    try { Value::deserialize("#hex:abc"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+
+    // a "//" inside base64 isn't a comment, one after it is
+    auto data = deserialize_from_netvent("\"chunk\"\ndata #base64://8A+w== // done\n").second;
+    assert(data["data"].as_blob().view() == std::string("\xff\xff\x00\xfb", 4));
+    assert(literal_base64.to_value(literal_base64["data"]) == data["data"]);
+    assert(literal_base64.to_value(literal_base64["key"]).as_blob().view() == "\x0a\xff");
+
+    // schemas check the decoded length
+    Schema schema = parse_schema(R"(
+event Voice "voice" {
+    frame blob length(1, 4)
+})");
+    Validator voice(schema, "Voice");
+    voice.check("\"voice\"\nframe #hex:0a0b0c\n");
+    for (const char* bad : {"\"voice\"\nframe #hex:0a0b0c0d0e\n", "\"voice\"\nframe #base64:A===\n", "\"voice\"\nframe #hex:\n"}) {
+        threw = false;
+        try { voice.check(bad); } catch (const std::runtime_error&) { threw = true; }
+        assert(threw);
+    }
+    assert(detail::parse_blob_text(" #base64:AAEC ").view() == std::string("\0\1\2", 3));
+}
+
+void test_ropes() {
+    // built from segments without joining them, copies share the chunk list
+    auto segment = std::make_shared<const std::string>(std::string(5000, 'a') + std::string(3000, 'b'));
+    Rope history("start ");
+    history.append(Blob(segment, 0, segment->size())).append(std::string(2000, 'c') + "\"quoted\"\n");
+    assert(history.size() == 6 + segment->size() + 2009 && history.chunks().size() == 3);
+    assert(history.chunks()[1].data() == segment->data());
+    const std::string joined = history.str();
+    assert(joined == "start " + *segment + std::string(2000, 'c') + "\"quoted\"\n");
+
+    Rope copy = history;
+    assert(&copy.chunks() == &history.chunks());
+    copy.append(std::string("!"));
+    assert(copy.size() == history.size() + 1 && history.chunks().size() == 3 && copy != history);
+    Rope doubled = history;
+    doubled.append(doubled);
+    assert(doubled.str() == joined + joined);
+
+    // compared by content, wherever the chunks split
+    Rope split;
+    for (size_t i = 0; i < joined.size(); i += 777) split.append(joined.substr(i, 777));
+    assert(split == history && !(split < history) && !(history < split));
+    assert(Rope("abc") < Rope("abd") && Rope("ab") < Rope("abc") && !(Rope("abc") < Rope("ab")));
+    assert(Rope().empty() && Rope() == Rope(""));
+
+    // written as an escaped string, read back as one
+    Value v{history};
+    assert(v.is_rope() && !v.is_string() && Value(copy) == Value(copy) && !(v == Value(copy)));
+    const std::string text = v.serialize();
+    assert(text == Value(joined).serialize());
+    assert(Value::deserialize(text).as_string() == joined);
+
+    // gathered, clean big chunks are pointed at, everything else is copied, and the text is the same
+    Table t;
+    t[Value("log")] = v;
+    t[Value("frame")] = Value(Blob(std::string(4096, '\x01')));
+    t[Value("list")] = Value(Table(std::vector<Value>{Value(1), Value(2.5f), Value("x"), Value(Rope("tiny"))}));
+    std::map<std::string, Value> event = {{"id", Value(17)}, {"history", v}, {"data", Value(t)}};
+    GatherOutput out;
+    serialize_to_netvent(Value("chat_log"), event, out);
+    assert(out.str() == serialize_to_netvent(Value("chat_log"), event) && out.size() == out.str().size());
+    size_t shared = 0;
+    for (std::string_view piece : out.pieces())
+        shared += piece.data() == segment->data() || piece.data() == t[Value("frame")].as_blob().data();
+    assert(shared == 3); // the clean segment in both places and the frame, the chunk with quotes is escaped
+    GatherOutput base64;
+    serialize_to_netvent(Value("chat_log"), event, base64, BlobText::Base64);
+    assert(base64.str() == serialize_to_netvent(Value("chat_log"), event, BlobText::Base64));
+    std::ostringstream stream;
+    out.write(stream);
+    assert(stream.str() == out.str());
+    auto back = deserialize_from_netvent(stream.str()).second;
+    assert(back["history"].as_string() == joined && back["id"].as_int() == 17);
+}
+
+void test_ordered_tables() {
+    // written in the order the keys went in, a key set again keeps its place
+    Table t(TableOrder::Insertion);
+    t[Value("zeta")] = Value(1);
+    t[Value("alpha")] = Value(2);
+    t[Value(3)] = Value("three");
+    t[Value("zeta")] = Value(9);
+    assert(t.get_is_ordered() && !t.get_is_array());
+    assert(t.serialize() == "{\"zeta\"=9,\"alpha\"=2,3=\"three\"}");
+    assert(Table({{Value("zeta"), Value(9)}, {Value("alpha"), Value(2)}}).serialize() == "{\"alpha\"=2,\"zeta\"=9}");
+    assert(t.exists(Value("alpha")) && !t.exists(Value("beta")) && t.find(Value(3))->as_string() == "three");
+    assert(!t.exists(Value(3.0f)) && !t.exists(Value(true)));
+    auto entries = t.get_entries();
+    assert(entries.size() == 3 && entries[0].first.as_string() == "zeta" && entries[2].first.as_int() == 3);
+    assert(t.get_data_map().size() == 3 && t.get_data_map()[Value("alpha")].as_int() == 2);
+
+    // references stay good while it grows, and lookups hold up through the index growing
+    Table big(TableOrder::Insertion);
+    Value& first = big[Value("first")];
+    for (int i = 0; i < 5000; i++) big[Value(i * 7919 % 5003)] = Value(i);
+    big[Value("first")] = big[Value(0)];
+    first = Value(-1);
+    assert(big.find(Value("first"))->as_int() == -1);
+    for (int i = 0; i < 5000; i++) assert(big.find(Value(i * 7919 % 5003))->as_int() == i);
+    assert(big.get_entries()[1].first.as_int() == 0 && big.get_entries().back().second.as_int() == 4999);
+
+    // every kind of key, equal values find each other however they were built
+    Table keys(TableOrder::Insertion, {{Value(-0.0f), Value(1)}, {Value(Blob("ab", 2)), Value(2)}, {Value(false), Value(3)}});
+    Rope split("a");
+    split.append(std::string("b"));
+    keys[Value(split)] = Value(4);
+    assert(keys.find(Value(0.0f))->as_int() == 1 && keys.find(Value(Blob(std::string("ab"))))->as_int() == 2);
+    assert(keys.find(Value(Rope("ab")))->as_int() == 4 && !keys.exists(Value("ab")) && keys.find(Value(false))->as_int() == 3);
+
+    // read back in the order they were written, nested tables too
+    const std::string text = "{b=1, a={y=2, x=3}, c=[{q=1,p=2}]}";
+    Table ordered = Table::deserialize(text, TableOrder::Insertion);
+    assert(ordered.serialize() == "{\"b\"=1,\"a\"={\"y\"=2,\"x\"=3},\"c\"=[{\"q\"=1,\"p\"=2}]}");
+    assert(Table::deserialize(text).serialize() == "{\"a\"={\"x\"=3,\"y\"=2},\"b\"=1,\"c\"=[{\"p\"=2,\"q\"=1}]}");
+    assert(Value::deserialize(text, TableOrder::Insertion).as_table().get_entries()[0].first.as_string() == "b");
+    GatherOutput out;
+    ordered.serialize(out);
+    assert(out.str() == ordered.serialize());
+    assert(Table::deserialize("{}", TableOrder::Insertion).get_is_ordered());
+
+    // copies have entries of their own, moves take them along
+    Table copy = t;
+    copy[Value("omega")] = Value(4);
+    copy[Value("zeta")] = Value(0);
+    assert(t.size() == 3 && t.find(Value("zeta"))->as_int() == 9 && !t.exists(Value("omega")));
+    assert(copy.get_is_ordered() && copy.serialize() == "{\"zeta\"=0,\"alpha\"=2,3=\"three\",\"omega\"=4}");
+    Table assigned;
+    assigned = copy;
+    Table moved = std::move(copy);
+    assert(assigned == moved && assigned.get_is_ordered() && moved.get_entries().back().first.as_string() == "omega");
+    assert(!Table().get_is_ordered() && !Table(TableOrder::Sorted).get_is_ordered());
+}
+
+void test_canonical_text() {
+    // tables compare by content now, and sort that way as keys
+    Table a, b;
+    a[Value("x")] = Value(1);
+    b[Value("x")] = Value(1);
+    assert(Value(a) == Value(b) && !(Value(a) < Value(b)) && a == b);
+    b[Value("y")] = Value(2);
+    assert(a != b && a < b && !(b < a) && Value(a) < Value(b));
+    assert(Table(std::vector<Value>{Value(9)}) < a);  // arrays before maps
+    Table keyed;
+    keyed[Value(b)] = Value("second");
+    keyed[Value(a)] = Value("first");
+    assert(keyed.get_entries()[0].second.as_string() == "first" && keyed.find(Value(b))->as_string() == "second");
+
+    // sorted maps compare straight off their entries, and agree with insertion-ordered copies
+    std::vector<Table> sorted_maps, ordered_maps;
+    for (int i = 0; i < 12; i++) {
+        Table sorted, ordered(TableOrder::Insertion);
+        for (int k = 0; k < i % 4; k++) {
+            const Value key((k * 5 + i) % 3), value(i % 2 ? Value(k) : Value("v"));
+            sorted[key] = value;
+            ordered[key] = value;
+        }
+        sorted_maps.push_back(sorted);
+        ordered_maps.push_back(ordered);
+    }
+    for (size_t i = 0; i < sorted_maps.size(); i++) {
+        for (size_t j = 0; j < sorted_maps.size(); j++) {
+            const bool less = sorted_maps[i] < sorted_maps[j];
+            assert(!(less && sorted_maps[j] < sorted_maps[i]));
+            assert((ordered_maps[i] < sorted_maps[j]) == less && (sorted_maps[i] < ordered_maps[j]) == less);
+            assert((ordered_maps[i] == sorted_maps[j]) == (sorted_maps[i] == sorted_maps[j]));
+        }
+    }
+
+    // one spelling whatever order the keys went in, and the same hash
+    Table ordered(TableOrder::Insertion);
+    ordered[Value("y")] = Value(2);
+    ordered[Value("x")] = Value(1);
+    assert(ordered == b && ordered.serialize() != b.serialize());
+    uint64_t h1 = 0, h2 = 0;
+    assert(serialize_canonical(ordered, &h1) == serialize_canonical(b, &h2) && h1 == h2);
+    assert(serialize_canonical(b) == "{\"x\"=1,\"y\"=2}" && content_hash(b) == h1);
+
+    // numbers normalized, ropes spelled as strings, blobs raw
+    assert(serialize_canonical(Value(-0.0f)) == "0.0" && content_hash(Value(-0.0f)) == content_hash(Value(0.0f)));
+    assert(content_hash(Value(std::nanf("1"))) == content_hash(Value(-std::nanf("2"))));
+    Rope rope("ab");
+    rope.append(std::string("c\"d"));
+    assert(serialize_canonical(Value(rope)) == serialize_canonical(Value("abc\"d")) && content_hash(Value(rope)) == content_hash(Value("abc\"d")));
+    assert(serialize_canonical(Value(Blob("hi", 2))) == "#2:hi");
+
+    // different things hash apart, kinds included
+    std::vector<Value> distinct = {Value(1), Value(1.0f), Value(true), Value("1"), Value(Blob("1", 1)), Value(0), Value(""),
+                                   Value(Table()), Value(Table(std::vector<Value>())), Value(a), Value(b),
+                                   Value(Table(std::vector<Value>{Value(1)})), Value(Table(std::vector<Value>{Value("1")}))};
+    for (size_t i = 0; i < distinct.size(); i++)
+        for (size_t j = i + 1; j < distinct.size(); j++) assert(content_hash(distinct[i]) != content_hash(distinct[j]));
+    std::string long_text(1000, 'q');
+    const uint64_t long_hash = content_hash(Value(long_text));
+    for (size_t i = 0; i < long_text.size(); i += 37) {
+        std::string changed = long_text;
+        changed[i] = 'r';
+        assert(content_hash(Value(changed)) != long_hash);
+    }
+
+    // reads back equal
+    Table doc(TableOrder::Insertion);
+    doc[Value("tiles")] = Value(Table(std::vector<Value>{Value(a), Value(b), Value(a)}));
+    doc[Value("name")] = Value("map \"one\"");
+    doc[Value(2)] = Value(1.5f);
+    const std::string text = serialize_canonical(doc);
+    assert(Table::deserialize(text) == doc && serialize_canonical(Table::deserialize(text)) == text);
+
+    // every sub-table's hash on the way, innermost first, equal ones equal
+    std::vector<std::pair<std::string, uint64_t>> seen;
+    uint64_t whole = content_hashes(doc, [&seen](const Table& t, uint64_t h) { seen.emplace_back(serialize_canonical(t), h); });
+    assert(whole == content_hash(doc) && seen.back().second == whole && seen.size() == 5);
+    for (const auto& [sub, h] : seen)
+        for (const auto& [other, other_h] : seen) assert((sub == other) == (h == other_h));
+}
+
+void test_table_store() {
+    TableStore store;
+    Table grass, water;
+    grass[Value("kind")] = Value("grass");
+    grass[Value("speed")] = Value(1.0f);
+    water[Value("kind")] = Value("water");
+    water[Value("speed")] = Value(0.5f);
+
+    // equal tables come back as one instance
+    auto first = store.intern(grass);
+    auto again = store.intern(Table(grass));
+    assert(first == again && *first == grass && store.size() == 1);
+    assert(store.intern(water) != first && store.size() == 2);
+
+    // nested tables are shared between everything that holds them
+    Table map_a(std::vector<Value>{Value(grass), Value(water), Value(grass)});
+    Table map_b(std::vector<Value>{Value(water), Value(water)});
+    auto a = store.intern(map_a);
+    auto b = store.intern(map_b);
+    assert(*a == map_a && *b == map_b && store.size() == 4);
+    const Table* grass_at = &(*a)[Value(0)].as_table();
+    assert(grass_at == first.get() && grass_at == &(*a)[Value(2)].as_table());
+    assert(&(*a)[Value(1)].as_table() == &(*b)[Value(0)].as_table());
+    Value wrapped = store.intern(Value(map_b));
+    assert(&wrapped.as_table() == b.get() && store.intern(Value(3)).as_int() == 3);
+
+    // insertion order is part of what's written, so it's kept apart
+    Table yx(TableOrder::Insertion), xy(TableOrder::Insertion);
+    yx[Value("y")] = Value(1);
+    yx[Value("x")] = Value(2);
+    xy[Value("x")] = Value(2);
+    xy[Value("y")] = Value(1);
+    auto yx_stored = store.intern(yx);
+    assert(yx_stored->serialize() == yx.serialize() && store.intern(xy)->serialize() == xy.serialize());
+    assert(store.intern(yx) == yx_stored && store.size() == 6);
+
+    // the same text twice is one parse and one table
+    const std::string text = "{tiles=[{kind=\"grass\",speed=1.0},{kind=\"water\",speed=0.5}],name=\"a\"}";
+    auto parsed = store.deserialize(text);
+    assert(store.deserialize(text) == parsed && *parsed == Table::deserialize(text));
+    assert(&(*parsed)[Value("tiles")].as_table()[Value(0)].as_table() == first.get());
+    assert(store.deserialize(text, TableOrder::Insertion)->get_is_ordered());
+
+    // pruning drops only what nobody else holds, parents before the children they kept
+    // the insertion-ordered parse above wasn't kept by anyone
+    const size_t held = store.size();
+    assert(store.prune() >= 1 && store.size() < held && store.deserialize(text) == parsed);
+    a.reset();
+    b.reset();
+    wrapped = Value();
+    first.reset();
+    again.reset();
+    yx_stored.reset();
+    parsed.reset();
+    store.prune();
+    assert(store.size() == 0);
+    assert(store.deserialize(text)->exists(Value("name")));
+}
+
+void test_merge_and_update() {
+    auto player = [](int hp, float x) {
+        Table p;
+        p[Value("hp")] = Value(hp);
+        p[Value("pos")] = Value(Table(std::vector<Value>{Value(x), Value(0.0f)}));
+        p[Value("name")] = Value("bob");
+        return p;
+    };
+    Table players;
+    players[Value(17)] = Value(player(100, 1.0f));
+    players[Value(18)] = Value(player(80, 2.0f));
+
+    // replace takes the incoming value, new keys come along whole
+    Table update;
+    update[Value(17)] = Value(player(90, 1.5f));
+    update[Value(19)] = Value(player(50, 3.0f));
+    const Table* moved = &update[Value(19)].as_table();
+    assert(players.merge(std::move(update)) == 2);
+    assert(players[Value(17)].as_table()[Value("hp")].as_int() == 90 && players.size() == 3);
+    assert(&players[Value(19)].as_table() == moved && update.size() == 0);
+
+    // keep existing only adds
+    Table more;
+    more[Value(17)] = Value(player(1, 0.0f));
+    more[Value(20)] = Value(player(5, 0.0f));
+    assert(players.merge(std::move(more), MergePolicy::KeepExisting) == 1);
+    assert(players[Value(17)].as_table()[Value("hp")].as_int() == 90 && players.exists(Value(20)));
+
+    // deep merges into the tables that are there, unchanged values aren't counted
+    Table& seventeen = players[Value(17)].as_table();
+    Table patch, fields;
+    fields[Value("hp")] = Value(75);
+    fields[Value("name")] = Value("bob");
+    fields[Value("pos")] = Value(Table(std::vector<Value>{Value(4.0f)}));
+    patch[Value(17)] = Value(fields);
+    assert(players.merge(std::move(patch), MergePolicy::Deep) == 2);
+    assert(&players[Value(17)].as_table() == &seventeen && seventeen[Value("hp")].as_int() == 75);
+    assert(seventeen[Value("pos")].as_table()[Value(0)].as_float() == 4.0f && seventeen[Value("pos")].as_table()[Value(1)].as_float() == 0.0f);
+
+    // a table shared elsewhere is copied before it changes, the other holder doesn't see it
+    TableStore store;
+    Value shared = store.intern(Value(player(10, 0.0f)));
+    players[Value(21)] = shared;
+    Table hit;
+    hit[Value(21)] = Value(Table({{Value("hp"), Value(9)}}));
+    assert(players.merge(std::move(hit), MergePolicy::Deep) == 1);
+    assert(players[Value(21)].as_table()[Value("hp")].as_int() == 9 && shared.as_table()[Value("hp")].as_int() == 10);
+
+    // paths make what's missing and say when nothing changed
+    assert(players.update_path({Value(18), Value("hp")}, Value(70)));
+    assert(!players.update_path({Value(18), Value("hp")}, Value(70)));
+    assert(players.update_path({Value(30), Value("stats"), Value("kills")}, Value(3)));
+    assert(players[Value(30)].as_table()[Value("stats")].as_table()[Value("kills")].as_int() == 3);
+    assert(players.update_path({Value(21), Value("name")}, Value("al")) && shared.as_table()[Value("name")].as_string() == "bob");
+    bool threw = false;
+    try { players.update_path({Value(18), Value("hp"), Value("x")}, Value(1)); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+    threw = false;
+    try { players.merge(Table(std::vector<Value>{Value(1)})); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+
+    // insertion-ordered tables keep their order, new keys go at the end
+    Table ordered(TableOrder::Insertion, {{Value("b"), Value(1)}, {Value("a"), Value(2)}});
+    Table incoming(TableOrder::Insertion, {{Value("c"), Value(3)}, {Value("b"), Value(4)}});
+    assert(ordered.merge(std::move(incoming)) == 2);
+    assert(ordered.serialize() == "{\"b\"=4,\"a\"=2,\"c\"=3}");
+    assert(ordered.update_path({Value("d"), Value("e")}, Value(5)) && ordered[Value("d")].as_table().get_is_ordered());
+}
+
 int main() {
     test_simple_array();
     test_nested_structure();
     test_empty_structures();
     test_table_value();
     test_netvent_format();
+    test_line_tokenizer();
+    test_string_escaping();
+    test_utf8();
+    test_blobs();
+    test_binary_text();
+    test_ropes();
+    test_ordered_tables();
+    test_canonical_text();
+    test_table_store();
+    test_merge_and_update();
     test_value_parsing();
+    test_int_text();
+    test_float_text();
     test_array_of_objects();
     test_deeply_nested();
     test_trailing_commas();
     test_hassle_free_api();
+    test_query_engine();
+    test_simd_dispatch();
+    test_archive();
+    test_event_log_index();
+    test_sort_event_logs();
+    test_window_aggregation();
+    test_schema_codegen();
+    test_schema_binary();
+    test_schema_evolution();
+    test_validator();
+    test_netvent_literals();
+    test_aggregate_reflection();
+#if __cplusplus >= 202002L
+    test_typed_events();
+#endif
     std::cout << "All tests passed!" << std::endl;
     return 0;
 } 
\ No newline at end of file